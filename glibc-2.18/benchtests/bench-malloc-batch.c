@@ -0,0 +1,114 @@
+/* Benchmark malloc_batch and free_batch against malloc and free.
+   Copyright (C) 2013 Free Software Foundation, Inc.
+   This file is part of the GNU C Library.
+
+   The GNU C Library is free software; you can redistribute it and/or
+   modify it under the terms of the GNU Lesser General Public
+   License as published by the Free Software Foundation; either
+   version 2.1 of the License, or (at your option) any later version.
+
+   The GNU C Library is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+   Lesser General Public License for more details.
+
+   You should have received a copy of the GNU Lesser General Public
+   License along with the GNU C Library; if not, see
+   <http://www.gnu.org/licenses/>.  */
+
+#include "bench-malloc.h"
+
+/* Each thread handles "packets": it allocates between MIN_OBJECTS and
+   MAX_OBJECTS objects of one size, touches them, and frees them all
+   again.  This is done for half of the time with malloc and free, and
+   for the other half with malloc_batch and free_batch.  */
+#define MIN_OBJECTS	100
+#define MAX_OBJECTS	400
+#define NUM_SIZES	4
+
+static const size_t object_sizes[NUM_SIZES] = { 32, 64, 128, 256 };
+
+static volatile int use_batch;
+
+struct thread_args
+{
+  pthread_t thread;
+  unsigned int seed;
+  size_t objects[2];
+  void *ptrs[MAX_OBJECTS];
+};
+
+static void *
+benchmark_thread (void *arg)
+{
+  struct thread_args *args = arg;
+  unsigned int seed = args->seed;
+
+  while (!timeout)
+    {
+      int batch = use_batch;
+      unsigned int r = next_rand (&seed);
+      size_t size = object_sizes[r % NUM_SIZES];
+      size_t n = MIN_OBJECTS + (r >> 8) % (MAX_OBJECTS - MIN_OBJECTS + 1);
+
+      if (batch)
+	n = malloc_batch (size, n, args->ptrs);
+      else
+	for (size_t i = 0; i < n; i++)
+	  args->ptrs[i] = malloc (size);
+
+      for (size_t i = 0; i < n; i++)
+	*(char *) args->ptrs[i] = i;
+
+      if (batch)
+	free_batch (args->ptrs, n);
+      else
+	for (size_t i = 0; i < n; i++)
+	  free (args->ptrs[i]);
+
+      args->objects[batch] += n;
+    }
+
+  return NULL;
+}
+
+int
+main (int argc, char **argv)
+{
+  struct thread_args *args;
+  unsigned long num_threads;
+  size_t objects[2] = { 0, 0 };
+
+  num_threads = bench_malloc_init (argc, argv);
+
+  args = alloc_thread_args (num_threads, sizeof (*args));
+
+  for (unsigned long i = 0; i < num_threads; i++)
+    {
+      args[i].seed = 2463534242u + i * 7919;
+      start_thread (&args[i].thread, benchmark_thread, &args[i]);
+    }
+
+  /* The threads switch between the two ways at the same time, so
+     each half of the run measures one of them.  */
+  sleep (DURATION / 2);
+  use_batch = 1;
+  sleep (DURATION - DURATION / 2);
+  timeout = 1;
+
+  for (unsigned long i = 0; i < num_threads; i++)
+    {
+      pthread_join (args[i].thread, NULL);
+      objects[0] += args[i].objects[0];
+      objects[1] += args[i].objects[1];
+    }
+
+  double single = objects[0] / (double) (DURATION / 2);
+  double batch = objects[1] / (double) (DURATION - DURATION / 2);
+  printf ("malloc-batch: THREADS:%lu: SINGLE:%g objects/s, "
+	  "BATCH:%g objects/s, SPEEDUP:%.2f\n", num_threads, single, batch,
+	  batch / single);
+
+  free (args);
+  return 0;
+}
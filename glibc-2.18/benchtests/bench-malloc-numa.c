@@ -0,0 +1,159 @@
+/* Benchmark malloc and free with threads spread over all CPUs.
+   Copyright (C) 2013 Free Software Foundation, Inc.
+   This file is part of the GNU C Library.
+
+   The GNU C Library is free software; you can redistribute it and/or
+   modify it under the terms of the GNU Lesser General Public
+   License as published by the Free Software Foundation; either
+   version 2.1 of the License, or (at your option) any later version.
+
+   The GNU C Library is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+   Lesser General Public License for more details.
+
+   You should have received a copy of the GNU Lesser General Public
+   License along with the GNU C Library; if not, see
+   <http://www.gnu.org/licenses/>.  */
+
+#include <sched.h>
+
+#include "bench-malloc.h"
+
+/* Each thread is pinned to a CPU, the threads going round-robin over
+   the CPUs of the system, and replaces a random slot of its working
+   set with a new block that it writes and later reads back.  The
+   blocks are too large for the thread cache, so every request goes to
+   an arena, and the time spent touching them depends on whether the
+   arena's memory is local to the thread's node.  */
+#define WORKING_SET_SIZE 256
+#define MIN_BLOCK_SIZE	2048
+#define MAX_BLOCK_SIZE	32768
+#define CACHE_LINE	64
+
+struct thread_args
+{
+  pthread_t thread;
+  int cpu;
+  unsigned int seed;
+  size_t iters;
+  unsigned long sum;
+  void *working_set[WORKING_SET_SIZE];
+  size_t sizes[WORKING_SET_SIZE];
+};
+
+static void *
+benchmark_thread (void *arg)
+{
+  struct thread_args *args = arg;
+  unsigned int seed = args->seed;
+  unsigned long sum = 0;
+  size_t iters = 0;
+  cpu_set_t set;
+
+  CPU_ZERO (&set);
+  CPU_SET (args->cpu, &set);
+  pthread_setaffinity_np (pthread_self (), sizeof (set), &set);
+
+  while (!timeout)
+    {
+      for (int i = 0; i < 256; i++)
+	{
+	  unsigned int r = next_rand (&seed);
+	  size_t slot = r % WORKING_SET_SIZE;
+	  size_t size = MIN_BLOCK_SIZE
+			+ (r >> 8) % (MAX_BLOCK_SIZE - MIN_BLOCK_SIZE);
+	  unsigned char *p = args->working_set[slot];
+
+	  for (size_t j = 0; j < args->sizes[slot]; j += CACHE_LINE)
+	    sum += p[j];
+	  free (p);
+
+	  p = malloc (size);
+	  for (size_t j = 0; j < size; j += CACHE_LINE)
+	    p[j] = j;
+	  args->working_set[slot] = p;
+	  args->sizes[slot] = size;
+	}
+      iters += 256;
+    }
+
+  for (int i = 0; i < WORKING_SET_SIZE; i++)
+    free (args->working_set[i]);
+
+  args->iters = iters;
+  args->sum = sum;
+  return NULL;
+}
+
+/* Get the lock totals that malloc_info prints after the per-arena
+   statistics.  */
+static void
+lock_stats (size_t *acquired, size_t *contended)
+{
+  char *buf = NULL, *p, *last = NULL;
+  size_t len;
+  FILE *f = open_memstream (&buf, &len);
+
+  *acquired = *contended = 0;
+  if (f == NULL)
+    return;
+  malloc_info (0, f);
+  fclose (f);
+
+  for (p = buf; (p = strstr (p, "<locks ")) != NULL; p++)
+    last = p;
+  if (last != NULL)
+    sscanf (last, "<locks acquired=\"%zu\" contended=\"%zu\"",
+	    acquired, contended);
+  free (buf);
+}
+
+int
+main (int argc, char **argv)
+{
+  struct timespec start, end;
+  struct thread_args *args;
+  unsigned long num_threads;
+  size_t iters = 0, acquired, contended;
+  long ncpus;
+
+  num_threads = bench_malloc_init (argc, argv);
+
+  ncpus = sysconf (_SC_NPROCESSORS_ONLN);
+  if (ncpus < 1)
+    ncpus = 1;
+
+  args = alloc_thread_args (num_threads, sizeof (*args));
+
+  clock_gettime (CLOCK_MONOTONIC, &start);
+
+  for (unsigned long i = 0; i < num_threads; i++)
+    {
+      args[i].cpu = i % ncpus;
+      args[i].seed = 2463534242u + i * 7919;
+      start_thread (&args[i].thread, benchmark_thread, &args[i]);
+    }
+
+  sleep (DURATION);
+  timeout = 1;
+
+  for (unsigned long i = 0; i < num_threads; i++)
+    {
+      pthread_join (args[i].thread, NULL);
+      iters += args[i].iters;
+    }
+
+  clock_gettime (CLOCK_MONOTONIC, &end);
+  lock_stats (&acquired, &contended);
+
+  double secs = elapsed (&start, &end);
+  printf ("malloc-numa: THREADS:%lu: ARENAS:%s: ITERS:%zu: TIME:%gs, "
+	  "%g iter/s, %g ns/iter per thread, LOCKS:%zu: CONTENDED:%zu "
+	  "(%.2f%%)\n", num_threads, arena_mode, iters,
+	  secs, iters / secs, 1e9 * secs * num_threads / iters, acquired,
+	  contended, acquired != 0 ? 100.0 * contended / acquired : 0.0);
+
+  free (args);
+  return 0;
+}
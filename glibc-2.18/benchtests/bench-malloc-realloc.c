@@ -0,0 +1,137 @@
+/* Benchmark growing large blocks with realloc.
+   Copyright (C) 2013 Free Software Foundation, Inc.
+   This file is part of the GNU C Library.
+
+   The GNU C Library is free software; you can redistribute it and/or
+   modify it under the terms of the GNU Lesser General Public
+   License as published by the Free Software Foundation; either
+   version 2.1 of the License, or (at your option) any later version.
+
+   The GNU C Library is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+   Lesser General Public License for more details.
+
+   You should have received a copy of the GNU Lesser General Public
+   License along with the GNU C Library; if not, see
+   <http://www.gnu.org/licenses/>.  */
+
+#include "bench-malloc.h"
+
+/* Each thread grows a buffer like a vector does, doubling it from
+   MIN_SIZE until it reaches its share of TOTAL_SIZE and filling the new
+   part, then frees it and starts over.  After every step it allocates
+   a small block, as other code running between the appends would, so
+   that the buffer usually cannot just be extended into the top of the
+   heap.  Compare with MALLOC_MREMAP_THRESHOLD_=0 in the environment to
+   see the cost of copying.  */
+#define MIN_SIZE	(1024 * 1024)
+#define TOTAL_SIZE	(1024UL * 1024 * 1024)
+#define MAX_STEPS	64
+#define SMALL_SIZE	64
+#define PAGE		4096
+
+static size_t max_size;
+
+struct thread_args
+{
+  pthread_t thread;
+  size_t steps;
+  size_t bytes;
+  int failed;
+};
+
+static void *
+benchmark_thread (void *arg)
+{
+  struct thread_args *args = arg;
+  void *small[MAX_STEPS];
+  size_t steps = 0, bytes = 0;
+
+  while (!timeout)
+    {
+      char *buf = NULL;
+      size_t used = 0;
+      int n = 0;
+
+      for (size_t size = MIN_SIZE; size <= max_size && n < MAX_STEPS;
+	   size *= 2)
+	{
+	  char *p = realloc (buf, size);
+	  if (p == NULL)
+	    {
+	      args->failed = 1;
+	      free (buf);
+	      return NULL;
+	    }
+	  buf = p;
+
+	  /* Touch the new part once per page, as appending to it
+	     would.  */
+	  for (; used < size; used += PAGE)
+	    buf[used] = used;
+
+	  small[n++] = malloc (SMALL_SIZE);
+	  ++steps;
+	  bytes += size;
+	}
+
+      free (buf);
+      while (n > 0)
+	free (small[--n]);
+    }
+
+  args->steps = steps;
+  args->bytes = bytes;
+  return NULL;
+}
+
+int
+main (int argc, char **argv)
+{
+  struct timespec start, end;
+  struct thread_args *args;
+  unsigned long num_threads;
+  size_t steps = 0, bytes = 0;
+
+  num_threads = bench_malloc_init (argc, argv);
+
+  /* Keep the memory used by all threads together bounded.  */
+  max_size = MIN_SIZE;
+  while (max_size * 2 <= TOTAL_SIZE / num_threads)
+    max_size *= 2;
+
+  args = alloc_thread_args (num_threads, sizeof (*args));
+
+  clock_gettime (CLOCK_MONOTONIC, &start);
+
+  for (unsigned long i = 0; i < num_threads; i++)
+    {
+      start_thread (&args[i].thread, benchmark_thread, &args[i]);
+    }
+
+  sleep (DURATION);
+  timeout = 1;
+
+  for (unsigned long i = 0; i < num_threads; i++)
+    {
+      pthread_join (args[i].thread, NULL);
+      if (args[i].failed)
+	{
+	  fprintf (stderr, "realloc failed\n");
+	  return 1;
+	}
+      steps += args[i].steps;
+      bytes += args[i].bytes;
+    }
+
+  clock_gettime (CLOCK_MONOTONIC, &end);
+
+  double secs = elapsed (&start, &end);
+  printf ("malloc-realloc: THREADS:%lu: MAX_SIZE:%zu: STEPS:%zu: "
+	  "TIME:%gs, %g steps/s, %g MB/s grown\n", num_threads, max_size,
+	  steps, secs, steps / secs, bytes / secs / (1024 * 1024));
+
+  free (args);
+  return 0;
+}
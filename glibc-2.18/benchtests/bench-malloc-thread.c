@@ -0,0 +1,108 @@
+/* Benchmark malloc and free with several threads.
+   Copyright (C) 2013 Free Software Foundation, Inc.
+   This file is part of the GNU C Library.
+
+   The GNU C Library is free software; you can redistribute it and/or
+   modify it under the terms of the GNU Lesser General Public
+   License as published by the Free Software Foundation; either
+   version 2.1 of the License, or (at your option) any later version.
+
+   The GNU C Library is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+   Lesser General Public License for more details.
+
+   You should have received a copy of the GNU Lesser General Public
+   License along with the GNU C Library; if not, see
+   <http://www.gnu.org/licenses/>.  */
+
+#include "bench-malloc.h"
+
+/* Each thread replaces a random slot of its working set with a new
+   allocation of random size until it is told to stop.  Most requests
+   are small, as in typical programs, with a tail of larger ones.  */
+#define WORKING_SET_SIZE 1024
+#define NUM_BLOCK_SIZES	16
+
+static const size_t block_sizes[NUM_BLOCK_SIZES] =
+  {
+    8, 8, 16, 16, 16, 24, 24, 32, 32, 48, 64, 96, 128, 256, 512, 4096
+  };
+
+struct thread_args
+{
+  pthread_t thread;
+  unsigned int seed;
+  size_t iters;
+  void *working_set[WORKING_SET_SIZE];
+};
+
+static void *
+benchmark_thread (void *arg)
+{
+  struct thread_args *args = arg;
+  unsigned int seed = args->seed;
+  size_t iters = 0;
+
+  while (!timeout)
+    {
+      /* Check the flag only every so often to keep it out of the
+	 inner loop.  */
+      for (int i = 0; i < 1024; i++)
+	{
+	  unsigned int r = next_rand (&seed);
+	  size_t slot = r % WORKING_SET_SIZE;
+	  size_t size = block_sizes[(r >> 10) % NUM_BLOCK_SIZES];
+
+	  free (args->working_set[slot]);
+	  args->working_set[slot] = malloc (size);
+	}
+      iters += 1024;
+    }
+
+  for (int i = 0; i < WORKING_SET_SIZE; i++)
+    free (args->working_set[i]);
+
+  args->iters = iters;
+  return NULL;
+}
+
+int
+main (int argc, char **argv)
+{
+  struct timespec start, end;
+  struct thread_args *args;
+  unsigned long num_threads;
+  size_t iters = 0;
+
+  num_threads = bench_malloc_init (argc, argv);
+
+  args = alloc_thread_args (num_threads, sizeof (*args));
+
+  clock_gettime (CLOCK_MONOTONIC, &start);
+
+  for (unsigned long i = 0; i < num_threads; i++)
+    {
+      args[i].seed = 2463534242u + i * 7919;
+      start_thread (&args[i].thread, benchmark_thread, &args[i]);
+    }
+
+  sleep (DURATION);
+  timeout = 1;
+
+  for (unsigned long i = 0; i < num_threads; i++)
+    {
+      pthread_join (args[i].thread, NULL);
+      iters += args[i].iters;
+    }
+
+  clock_gettime (CLOCK_MONOTONIC, &end);
+
+  double secs = elapsed (&start, &end);
+  printf ("malloc-thread: THREADS:%lu: ARENAS:%s: ITERS:%zu: TIME:%gs, "
+	  "%g iter/s, %g ns/iter per thread\n", num_threads, arena_mode,
+	  iters, secs, iters / secs, 1e9 * secs * num_threads / iters);
+
+  free (args);
+  return 0;
+}
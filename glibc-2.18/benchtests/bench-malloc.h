@@ -0,0 +1,122 @@
+/* Common code for the multi-threaded malloc benchmarks.
+   Copyright (C) 2013 Free Software Foundation, Inc.
+   This file is part of the GNU C Library.
+
+   The GNU C Library is free software; you can redistribute it and/or
+   modify it under the terms of the GNU Lesser General Public
+   License as published by the Free Software Foundation; either
+   version 2.1 of the License, or (at your option) any later version.
+
+   The GNU C Library is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+   Lesser General Public License for more details.
+
+   You should have received a copy of the GNU Lesser General Public
+   License along with the GNU C Library; if not, see
+   <http://www.gnu.org/licenses/>.  */
+
+#include <errno.h>
+#include <malloc.h>
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+/* The benchmarks take the number of threads to run and, optionally,
+   "cpu" to select arenas by the CPU the threads run on.  They run for
+   DURATION seconds and then set TIMEOUT to tell the threads to stop.  */
+#ifndef DURATION
+# define DURATION 10
+#endif
+
+static volatile int timeout;
+
+/* The arena selection, "cpu" or "default", for the output.  */
+static const char *arena_mode = "default";
+
+/* A simple xorshift generator, cheap enough not to disturb the
+   measurement and without any shared state.  */
+static inline unsigned int
+next_rand (unsigned int *state)
+{
+  unsigned int x = *state;
+  x ^= x << 13;
+  x ^= x >> 17;
+  x ^= x << 5;
+  return *state = x;
+}
+
+static inline double
+elapsed (const struct timespec *start, const struct timespec *end)
+{
+  return (end->tv_sec - start->tv_sec)
+	 + (end->tv_nsec - start->tv_nsec) * 1e-9;
+}
+
+static void
+usage (const char *name)
+{
+  fprintf (stderr, "%s: <num_threads> [cpu]\n", name);
+  exit (1);
+}
+
+/* Parse the command line and set up malloc accordingly.  Return the
+   number of threads to run.  */
+static unsigned long
+bench_malloc_init (int argc, char **argv)
+{
+  unsigned long num_threads;
+  char *endp;
+
+  if (argc != 2 && argc != 3)
+    usage (argv[0]);
+
+  errno = 0;
+  num_threads = strtoul (argv[1], &endp, 10);
+  if (errno != 0 || *endp != '\0' || num_threads == 0)
+    usage (argv[0]);
+
+  if (argc == 3)
+    {
+      if (strcmp (argv[2], "cpu") != 0)
+	usage (argv[0]);
+      if (mallopt (M_ARENA_CPU, 1) == 0)
+	{
+	  fprintf (stderr, "mallopt (M_ARENA_CPU) failed\n");
+	  exit (1);
+	}
+      arena_mode = "cpu";
+    }
+
+  return num_threads;
+}
+
+/* Allocate NUM_THREADS zeroed thread arguments of SIZE bytes each.  */
+static void *
+alloc_thread_args (unsigned long num_threads, size_t size)
+{
+  void *args = calloc (num_threads, size);
+
+  if (args == NULL)
+    {
+      perror ("calloc");
+      exit (1);
+    }
+  return args;
+}
+
+/* Start a benchmark thread running START_ROUTINE on ARG.  */
+static void
+start_thread (pthread_t *thread, void *(*start_routine) (void *), void *arg)
+{
+  int err = pthread_create (thread, NULL, start_routine, arg);
+
+  if (err != 0)
+    {
+      fprintf (stderr, "pthread_create: %s\n", strerror (err));
+      exit (1);
+    }
+}
@@ -0,0 +1,170 @@
+/* Benchmark qsort over element sizes and input orders.
+   Copyright (C) 2013 Free Software Foundation, Inc.
+   This file is part of the GNU C Library.
+
+   The GNU C Library is free software; you can redistribute it and/or
+   modify it under the terms of the GNU Lesser General Public
+   License as published by the Free Software Foundation; either
+   version 2.1 of the License, or (at your option) any later version.
+
+   The GNU C Library is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+   Lesser General Public License for more details.
+
+   You should have received a copy of the GNU Lesser General Public
+   License along with the GNU C Library; if not, see
+   <http://www.gnu.org/licenses/>.  */
+
+#include <malloc.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+/* Every combination of element size, input order and algorithm sorts
+   NELEMS elements over and over, for an equal share of DURATION.  The
+   elements start with a 32-bit key and are padded to their size.
+   "merge" is the normal qsort path, which merges through a temporary
+   array; "inplace" makes malloc fail so that qsort has to fall back to
+   sorting in place, as it does when memory is short.  */
+#define NELEMS	100000
+
+#ifndef DURATION
+# define DURATION 10
+#endif
+
+static const size_t sizes[] = { 4, 8, 16, 32, 64 };
+#define NSIZES (sizeof (sizes) / sizeof (sizes[0]))
+
+enum pattern
+  {
+    RANDOM,
+    SORTED,
+    REVERSED,
+    NEARLY_SORTED,
+    ORGAN_PIPE,
+    FEW_VALUES,
+    NPATTERNS
+  };
+
+static const char *const pattern_names[NPATTERNS] =
+  {
+    "random", "sorted", "reversed", "nearly-sorted", "organ-pipe",
+    "few-values"
+  };
+
+static size_t ncompares;
+
+static int
+compare (const void *a, const void *b)
+{
+  uint32_t ka = *(const uint32_t *) a;
+  uint32_t kb = *(const uint32_t *) b;
+
+  ++ncompares;
+  return ka < kb ? -1 : ka > kb;
+}
+
+static void *
+failing_malloc (size_t size, const void *caller)
+{
+  return NULL;
+}
+
+static void
+fill (char *array, size_t size, enum pattern pat, unsigned int seed)
+{
+  srandom (seed);
+  for (size_t i = 0; i < NELEMS; i++)
+    {
+      uint32_t key;
+
+      switch (pat)
+	{
+	case RANDOM:
+	  key = random ();
+	  break;
+	case SORTED:
+	  key = i;
+	  break;
+	case REVERSED:
+	  key = NELEMS - i;
+	  break;
+	case NEARLY_SORTED:
+	  key = i % 100 == 0 ? (uint32_t) random () : i;
+	  break;
+	case ORGAN_PIPE:
+	  key = i < NELEMS / 2 ? i : NELEMS - i;
+	  break;
+	default:
+	  key = random () % 16;
+	  break;
+	}
+      memset (array + i * size, 0, size);
+      *(uint32_t *) (array + i * size) = key;
+    }
+}
+
+static double
+elapsed (const struct timespec *start, const struct timespec *end)
+{
+  return (end->tv_sec - start->tv_sec)
+	 + (end->tv_nsec - start->tv_nsec) * 1e-9;
+}
+
+int
+main (void)
+{
+  double budget = (double) DURATION / (NSIZES * NPATTERNS * 2);
+  char *array = malloc (NELEMS * sizes[NSIZES - 1]);
+
+  if (array == NULL)
+    {
+      perror ("malloc");
+      return 1;
+    }
+
+  for (size_t s = 0; s < NSIZES; s++)
+    for (int pat = 0; pat < NPATTERNS; pat++)
+      for (int inplace = 0; inplace < 2; inplace++)
+	{
+	  struct timespec start, now;
+	  double secs, fill_secs = 0;
+	  size_t runs = 0;
+
+	  ncompares = 0;
+	  clock_gettime (CLOCK_MONOTONIC, &start);
+	  do
+	    {
+	      struct timespec fill_start, fill_end;
+	      void *(*old_hook) (size_t, const void *) = __malloc_hook;
+
+	      /* Refill outside the timed part; only the sort counts.  */
+	      clock_gettime (CLOCK_MONOTONIC, &fill_start);
+	      fill (array, sizes[s], pat, runs + 1);
+	      clock_gettime (CLOCK_MONOTONIC, &fill_end);
+	      fill_secs += elapsed (&fill_start, &fill_end);
+
+	      if (inplace)
+		__malloc_hook = failing_malloc;
+	      qsort (array, NELEMS, sizes[s], compare);
+	      __malloc_hook = old_hook;
+
+	      ++runs;
+	      clock_gettime (CLOCK_MONOTONIC, &now);
+	    }
+	  while (elapsed (&start, &now) < budget);
+
+	  secs = elapsed (&start, &now) - fill_secs;
+	  printf ("qsort: SIZE:%zu: PATTERN:%s: ALGORITHM:%s: RUNS:%zu: "
+		  "%g ns/elem, %g cmp/elem\n", sizes[s], pattern_names[pat],
+		  inplace ? "inplace" : "merge", runs,
+		  1e9 * secs / (runs * (double) NELEMS),
+		  ncompares / (runs * (double) NELEMS));
+	}
+
+  free (array);
+  return 0;
+}
@@ -78,6 +78,11 @@ static mutex_t list_lock = MUTEX_INITIALIZER;
 #ifdef PER_THREAD
 static size_t narenas = 1;
 static mstate free_list;
+
+/* With M_ARENA_CPU, every ARENA_NODE_CHECK-th arena lookup of a thread
+   checks whether the thread has moved to another NUMA node.  */
+#define ARENA_NODE_CHECK 64
+static __thread unsigned int arena_node_check;
 #endif
 
 #if THREAD_STATS
@@ -87,6 +92,32 @@ static int stat_n_heaps;
 #define THREAD_STAT(x) do ; while(0)
 #endif
 
+/* Lock the mutex of arena AR_PTR and count the acquisition in the
+   arena statistics.  Only when the lock is held by another thread is
+   the clock read, to account for the time spent waiting.  */
+
+static void
+__attribute__ ((noinline))
+arena_lock_wait (mstate ar_ptr)
+{
+  struct timespec start, end;
+
+  __clock_gettime (CLOCK_MONOTONIC, &start);
+  (void)mutex_lock(&ar_ptr->mutex);
+  __clock_gettime (CLOCK_MONOTONIC, &end);
+
+  ++ar_ptr->stats.nlock_contended;
+  ar_ptr->stats.lock_wait_ns += ((uint64_t) (end.tv_sec - start.tv_sec)
+				 * 1000000000
+				 + end.tv_nsec - start.tv_nsec);
+}
+
+#define arena_mutex_lock(ptr) do { \
+  if(mutex_trylock(&(ptr)->mutex)) \
+    arena_lock_wait(ptr); \
+  ++((ptr)->stats.nlock); \
+} while(0)
+
 /* Mapped memory in non-main arenas (reliable only for NO_THREADS). */
 static unsigned long arena_mem;
 
@@ -116,8 +147,10 @@ int __malloc_initialized = -1;
 
 #ifdef PER_THREAD
 # define arena_lock(ptr, size) do { \
+  if(ptr && __builtin_expect(mp_.arena_cpu, 0)) \
+    ptr = arena_check_node(ptr); \
   if(ptr) \
-    (void)mutex_lock(&ptr->mutex); \
+    arena_mutex_lock(ptr); \
   else \
     ptr = arena_get2(ptr, (size), NULL); \
 } while(0)
@@ -130,6 +163,24 @@ int __malloc_initialized = -1;
 } while(0)
 #endif
 
+#ifdef PER_THREAD
+/* Return PTR, or NULL if the calling thread now runs on a NUMA node
+   other than the one of arena PTR, so that arena_get2 picks an arena
+   on the new node.  The node is only looked up now and then since
+   threads rarely migrate.  */
+static mstate
+arena_check_node (mstate ptr)
+{
+  if (++arena_node_check % ARENA_NODE_CHECK != 0)
+    return ptr;
+
+  int node = malloc_getnode ();
+  if (node < 0 || node == ptr->node)
+    return ptr;
+  return NULL;
+}
+#endif
+
 /* find the heap and corresponding arena for a given ptr */
 
 #define heap_for_ptr(ptr) \
@@ -423,9 +474,13 @@ ptmalloc_init (void)
 		{
 		  if (memcmp (envline, "MMAP_MAX_", 9) == 0)
 		    __libc_mallopt(M_MMAP_MAX, atoi(&envline[10]));
+		  else if (memcmp (envline, "HUGEPAGE_", 9) == 0)
+		    __libc_mallopt(M_HUGEPAGE, atoi(&envline[10]));
 #ifdef PER_THREAD
 		  else if (memcmp (envline, "ARENA_MAX", 9) == 0)
 		    __libc_mallopt(M_ARENA_MAX, atoi(&envline[10]));
+		  else if (memcmp (envline, "ARENA_CPU", 9) == 0)
+		    __libc_mallopt(M_ARENA_CPU, atoi(&envline[10]));
 #endif
 		}
 	      break;
@@ -438,6 +493,29 @@ ptmalloc_init (void)
 		}
 	      break;
 #endif
+#ifdef USE_TCACHE
+	    case 11:
+	      if (! __builtin_expect (__libc_enable_secure, 0))
+		{
+		  if (memcmp (envline, "TCACHE_MAX_", 11) == 0)
+		    __libc_mallopt(M_TCACHE_MAX, atoi(&envline[12]));
+		}
+	      break;
+	    case 13:
+	      if (! __builtin_expect (__libc_enable_secure, 0))
+		{
+		  if (memcmp (envline, "TCACHE_COUNT_", 13) == 0)
+		    __libc_mallopt(M_TCACHE_COUNT, atoi(&envline[14]));
+		}
+	      break;
+#endif
+	    case 14:
+	      if (! __builtin_expect (__libc_enable_secure, 0))
+		{
+		  if (memcmp (envline, "TRIM_INTERVAL_", 14) == 0)
+		    __libc_mallopt(M_TRIM_INTERVAL, atoi(&envline[15]));
+		}
+	      break;
 	    case 15:
 	      if (! __builtin_expect (__libc_enable_secure, 0))
 		{
@@ -447,6 +525,13 @@ ptmalloc_init (void)
 		    __libc_mallopt(M_MMAP_THRESHOLD, atoi(&envline[16]));
 		}
 	      break;
+	    case 17:
+	      if (! __builtin_expect (__libc_enable_secure, 0))
+		{
+		  if (memcmp (envline, "MREMAP_THRESHOLD_", 17) == 0)
+		    __libc_mallopt(M_MREMAP_THRESHOLD, atoi(&envline[18]));
+		}
+	      break;
 	    default:
 	      break;
 	    }
@@ -573,13 +658,24 @@ new_heap(size_t size, size_t top_pad)
       }
     }
   }
-  if(__mprotect(p2, size, PROT_READ|PROT_WRITE) != 0) {
+  /* With huge pages, make whole huge pages accessible at a time, so
+     that the kernel can back them.  HEAP_MAX_SIZE alignment makes the
+     heap start on a huge page boundary.  */
+  size_t mprotect_size = size;
+  if (mp_.thp_pagesize != 0)
+    {
+      mprotect_size = (size + mp_.thp_pagesize - 1) & ~(mp_.thp_pagesize - 1);
+      if (mprotect_size > HEAP_MAX_SIZE)
+	mprotect_size = HEAP_MAX_SIZE;
+    }
+  if(__mprotect(p2, mprotect_size, PROT_READ|PROT_WRITE) != 0) {
     __munmap(p2, HEAP_MAX_SIZE);
     return 0;
   }
+  thp_advise(p2, HEAP_MAX_SIZE);
   h = (heap_info *)p2;
   h->size = size;
-  h->mprotect_size = size;
+  h->mprotect_size = mprotect_size;
   THREAD_STAT(stat_n_heaps++);
   return h;
 }
@@ -598,11 +694,21 @@ grow_heap(heap_info *h, long diff)
   if((unsigned long) new_size > (unsigned long) HEAP_MAX_SIZE)
     return -1;
   if((unsigned long) new_size > h->mprotect_size) {
+    unsigned long new_mprotect_size = new_size;
+    if (mp_.thp_pagesize != 0) {
+      new_mprotect_size = (new_mprotect_size + mp_.thp_pagesize - 1)
+			  & ~(mp_.thp_pagesize - 1);
+      if (new_mprotect_size > HEAP_MAX_SIZE)
+	new_mprotect_size = HEAP_MAX_SIZE;
+    }
     if (__mprotect((char *)h + h->mprotect_size,
-		   (unsigned long) new_size - h->mprotect_size,
+		   new_mprotect_size - h->mprotect_size,
 		   PROT_READ|PROT_WRITE) != 0)
       return -2;
-    h->mprotect_size = new_size;
+    /* shrink_heap may have remapped this range, dropping the advice.  */
+    thp_advise((char *)h + h->mprotect_size,
+	       new_mprotect_size - h->mprotect_size);
+    h->mprotect_size = new_mprotect_size;
   }
 
   h->size = new_size;
@@ -674,6 +780,8 @@ heap_trim(heap_info *heap, size_t pad)
       break;
     ar_ptr->system_mem -= heap->size;
     arena_mem -= heap->size;
+    ++ar_ptr->stats.ntrim;
+    ar_ptr->stats.trimmed += heap->size;
     delete_heap(heap);
     heap = prev_heap;
     if(!prev_inuse(p)) { /* consolidate backward */
@@ -688,6 +796,12 @@ heap_trim(heap_info *heap, size_t pad)
   }
   top_size = chunksize(top_chunk);
   extra = (top_size - pad - MINSIZE - 1) & ~(pagesz - 1);
+  /* Do not split a huge page: keep the heap a whole number of them.  */
+  if(mp_.thp_pagesize != 0 && extra > 0) {
+    long new_size = ((long)heap->size - extra + mp_.thp_pagesize - 1)
+		    & ~(long)(mp_.thp_pagesize - 1);
+    extra = (long)heap->size - new_size;
+  }
   if(extra < (long)pagesz)
     return 0;
   /* Try to shrink. */
@@ -695,6 +809,8 @@ heap_trim(heap_info *heap, size_t pad)
     return 0;
   ar_ptr->system_mem -= extra;
   arena_mem -= extra;
+  ++ar_ptr->stats.ntrim;
+  ar_ptr->stats.trimmed += extra;
 
   /* Success. Adjust top accordingly. */
   set_head(top_chunk, (top_size - extra) | PREV_INUSE);
@@ -705,7 +821,7 @@ heap_trim(heap_info *heap, size_t pad)
 /* Create a new arena with initial size "size".  */
 
 static mstate
-_int_new_arena(size_t size)
+_int_new_arena(size_t size, int node)
 {
   mstate a;
   heap_info *h;
@@ -722,8 +838,11 @@ _int_new_arena(size_t size)
     if(!h)
       return 0;
   }
+  if (node >= 0)
+    malloc_bind_node(h, HEAP_MAX_SIZE, node);
   a = h->ar_ptr = (mstate)(h+1);
   malloc_init_state(a);
+  a->node = node;
   /*a->next = NULL;*/
   a->system_mem = a->max_system_mem = h->size;
   arena_mem += h->size;
@@ -783,6 +902,26 @@ get_free_list (void)
   return result;
 }
 
+/* Remove arena A, which the calling thread is about to attach to,
+   from free_list if it is there.  Otherwise the thread would push it
+   a second time when it exits, and get_free_list could hand it out
+   while it is in use.  */
+static void
+remove_from_free_list (mstate a)
+{
+  if (free_list == NULL)
+    return;
+
+  (void)mutex_lock(&list_lock);
+  for (mstate *p = &free_list; *p != NULL; p = &(*p)->next_free)
+    if (*p == a)
+      {
+	*p = a->next_free;
+	break;
+      }
+  (void)mutex_unlock(&list_lock);
+}
+
 /* Lock and return an arena that can be reused for memory allocation.
    Avoid AVOID_ARENA as we have already failed to allocate memory in
    it and it is currently locked.  */
@@ -810,7 +949,7 @@ reused_arena (mstate avoid_arena)
     result = result->next;
 
   /* No arena available.  Wait for the next in line.  */
-  (void)mutex_lock(&result->mutex);
+  arena_mutex_lock(result);
 
  out:
   tsd_setspecific(arena_key, (void *)result);
@@ -819,6 +958,46 @@ reused_arena (mstate avoid_arena)
 
   return result;
 }
+
+/* Lock and return an arena on NUMA node NODE, starting the search
+   after A_TSD so that threads on the same node spread over its
+   arenas.  Only arenas that are not locked are considered unless WAIT
+   is true, in which case the first arena on the node other than
+   AVOID_ARENA is waited for.  Return NULL if there is none.  */
+static mstate
+node_arena (int node, mstate a_tsd, mstate avoid_arena, bool wait)
+{
+  mstate start = a_tsd != NULL ? a_tsd->next : &main_arena;
+  mstate result = start;
+
+  do
+    {
+      if (result->node == node && result != avoid_arena)
+	{
+	  if (wait)
+	    {
+	      arena_mutex_lock(result);
+	      goto out;
+	    }
+	  if (!mutex_trylock(&result->mutex))
+	    {
+	      ++result->stats.nlock;
+	      goto out;
+	    }
+	}
+      result = result->next;
+    }
+  while (result != start);
+
+  return NULL;
+
+ out:
+  /* Idle arenas are mostly those of exited threads.  */
+  remove_from_free_list (result);
+  tsd_setspecific(arena_key, (void *)result);
+  THREAD_STAT(++(result->stat_lock_loop));
+  return result;
+}
 #endif
 
 static mstate
@@ -829,8 +1008,17 @@ arena_get2(mstate a_tsd, size_t size, mstate avoid_arena)
 
 #ifdef PER_THREAD
   static size_t narenas_limit;
+  int node = -1;
 
-  a = get_free_list ();
+  if (__builtin_expect (mp_.arena_cpu, 0))
+    {
+      /* Prefer an idle arena on the node the thread runs on over the
+	 arenas of exited threads.  */
+      node = malloc_getnode ();
+      a = node >= 0 ? node_arena (node, a_tsd, avoid_arena, false) : NULL;
+    }
+  else
+    a = get_free_list ();
   if (a == NULL)
     {
       /* Nothing immediately available, so generate a new arena.  */
@@ -863,13 +1051,25 @@ arena_get2(mstate a_tsd, size_t size, mstate avoid_arena)
 	{
 	  if (catomic_compare_and_exchange_bool_acq (&narenas, n + 1, n))
 	    goto repeat;
-	  a = _int_new_arena (size);
+	  a = _int_new_arena (size, node);
 	  if (__builtin_expect (a == NULL, 0))
 	    catomic_decrement (&narenas);
 	}
       else
-	a = reused_arena (avoid_arena);
+	{
+	  /* Wait for an arena on the local node if there is one.  */
+	  if (node >= 0)
+	    a = node_arena (node, a_tsd, avoid_arena, true);
+	  if (a == NULL)
+	    a = reused_arena (avoid_arena);
+	}
     }
+
+  /* An arena that was idle or shared may hold chunks other threads
+     freed into it since it was last locked; put them back into its
+     bins before it is used.  */
+  if (a != NULL && a->remote_frees != NULL)
+    drain_remote_frees (a);
 #else
   if(!a_tsd)
     a = a_tsd = &main_arena;
@@ -912,7 +1112,7 @@ arena_get2(mstate a_tsd, size_t size, mstate avoid_arena)
   }
 
   /* Nothing immediately available, so generate a new arena.  */
-  a = _int_new_arena(size);
+  a = _int_new_arena(size, -1);
   (void)mutex_unlock(&list_lock);
 #endif
 
@@ -940,10 +1140,17 @@ arena_get_retry (mstate ar_ptr, size_t bytes)
   return ar_ptr;
 }
 
-#ifdef PER_THREAD
+#if defined PER_THREAD || defined USE_TCACHE
 static void __attribute__ ((section ("__libc_thread_freeres_fn")))
 arena_thread_freeres (void)
 {
+# ifdef USE_TCACHE
+  /* Shut down the thread cache first, it returns its chunks to
+     the arenas.  */
+  tcache_thread_shutdown ();
+# endif
+
+# ifdef PER_THREAD
   void *vptr = NULL;
   mstate a = tsd_getspecific(arena_key, vptr);
   tsd_setspecific(arena_key, NULL);
@@ -955,6 +1162,7 @@ arena_thread_freeres (void)
       free_list = a;
       (void)mutex_unlock(&list_lock);
     }
+# endif
 }
 text_set_element (__libc_thread_subfreeres, arena_thread_freeres);
 #endif
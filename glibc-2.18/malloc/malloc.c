@@ -234,6 +234,7 @@
 
 /* For uintptr_t.  */
 #include <stdint.h>
+#include <time.h>     /* for the lock wait statistics */
 
 /* For va_arg, va_start, va_end.  */
 #include <stdarg.h>
@@ -550,6 +551,27 @@ libc_hidden_proto (__libc_malloc)
 void     __libc_free(void*);
 libc_hidden_proto (__libc_free)
 
+/*
+  free_sized(void* p, size_t n);
+  free_aligned_sized(void* p, size_t alignment, size_t n);
+  Like free(p), for a block obtained with a request of n bytes.  n must
+  not be larger than the size asked for.  It is currently not used.
+*/
+void     __libc_free_sized(void*, size_t);
+void     __libc_free_aligned_sized(void*, size_t, size_t);
+
+/*
+  malloc_batch(size_t n_bytes, size_t n, void** ptrs);
+  free_batch(void** ptrs, size_t n);
+  malloc_batch allocates n blocks of n_bytes each into ptrs, locking
+  an arena at most once.  It returns the number of blocks allocated,
+  which is less than n only if memory ran out.  free_batch frees the
+  n blocks in ptrs, which may come from any allocation function,
+  locking each arena once for a run of blocks from it.
+*/
+size_t   __libc_malloc_batch(size_t, size_t, void**);
+void     __libc_free_batch(void**, size_t);
+
 /*
   calloc(size_t n_elements, size_t element_size);
   Returns a pointer to n_elements * element_size bytes, with all locations
@@ -915,6 +937,23 @@ int      __posix_memalign(void **, size_t, size_t);
 # endif
 #endif
 
+/*
+  M_MREMAP_THRESHOLD is the size from which realloc moves a growing
+  block that cannot be extended in place to a chunk of its own
+  mapping rather than to another place in the heap.  The block is
+  copied once, and all further growth is done with mremap, which moves
+  page table entries instead of data.  Smaller blocks are cheap enough
+  to copy.  Zero disables this.
+*/
+
+#ifndef DEFAULT_MREMAP_THRESHOLD
+# if HAVE_MREMAP
+#  define DEFAULT_MREMAP_THRESHOLD (8 * DEFAULT_MMAP_THRESHOLD_MIN)
+# else
+#  define DEFAULT_MREMAP_THRESHOLD 0
+# endif
+#endif
+
 /*
   M_MMAP_THRESHOLD is the request size threshold for using mmap()
   to service a request. Requests of at least this size that cannot
@@ -1050,7 +1089,12 @@ typedef struct malloc_chunk* mchunkptr;
 /* Internal routines.  */
 
 static void*  _int_malloc(mstate, size_t);
+static size_t   _int_malloc_batch(mstate, size_t, size_t, void**);
 static void     _int_free(mstate, mchunkptr, int);
+static void     _int_free_cache(mstate, mchunkptr, int, int);
+static int      queue_remote_free(mstate, mchunkptr);
+static void     drain_remote_frees(mstate);
+static void     deferred_trim(mstate);
 static void*  _int_realloc(mstate, mchunkptr, INTERNAL_SIZE_T,
 			   INTERNAL_SIZE_T);
 static void*  _int_memalign(mstate, size_t, size_t);
@@ -1681,6 +1725,34 @@ typedef struct malloc_chunk* mfastbinptr;
    ----------- Internal state representation and initialization -----------
 */
 
+/*
+  Event counters kept for each arena and reported by malloc_info.  They
+  are all updated with the arena lock held, so plain increments do.
+*/
+
+struct malloc_arena_stats {
+  /* Lock acquisitions through arena_mutex_lock, those that found the
+     lock held by another thread, and the time spent waiting in them.  */
+  size_t           nlock;
+  size_t           nlock_contended;
+  uint64_t         lock_wait_ns;
+
+  /* Requests served by each fastbin, by a smallbin, and requests that
+     had to go on to the unsorted and large bins or the top chunk.  */
+  size_t           fastbin_hits[NFASTBINS];
+  size_t           smallbin_hits;
+  size_t           bin_misses;
+
+  /* Calls to sysmalloc that grew the arena, and requests above the
+     mmap threshold that were mapped directly.  */
+  size_t           top_extend;
+  size_t           mmapped;
+
+  /* Memory returned to the system by systrim, heap_trim and mtrim.  */
+  size_t           ntrim;
+  size_t           trimmed;
+};
+
 struct malloc_state {
   /* Serialize access.  */
   mutex_t mutex;
@@ -1696,6 +1768,13 @@ struct malloc_state {
   /* Fastbins */
   mfastbinptr      fastbinsY[NFASTBINS];
 
+  /* Chunks freed by threads attached to other arenas.  They are
+     pushed without the lock and freed by the next _int_malloc.  */
+  mchunkptr        remote_frees;
+
+  /* Large frees since the last deferred trim.  */
+  int              trim_count;
+
   /* Base of the topmost chunk -- not otherwise kept in a bin */
   mchunkptr        top;
 
@@ -1719,16 +1798,62 @@ struct malloc_state {
   /* Memory allocated from the system in this arena.  */
   INTERNAL_SIZE_T system_mem;
   INTERNAL_SIZE_T max_system_mem;
+
+  /* Statistics for malloc_info.  */
+  struct malloc_arena_stats stats;
+
+  /* NUMA node the heaps of this arena are placed on, or -1.  Only
+     set when M_ARENA_CPU is in effect.  */
+  int node;
 };
 
+#ifdef USE_TCACHE
+/*
+  Thread cache
+
+    Each thread keeps a small, bounded stack of free chunks for each of
+    the smallest TCACHE_MAX_BINS chunk sizes.  The cache is only ever
+    touched by its owning thread, so malloc and free can satisfy most
+    small requests from it without taking the arena lock or issuing
+    any atomic operation.  Chunks in the cache keep their inuse bit
+    set, like fastbin chunks, and still belong to their arena.
+*/
+
+# define TCACHE_MAX_BINS	64
+# define MAX_TCACHE_SIZE	tidx2usize (TCACHE_MAX_BINS - 1)
+
+/* Only used to pre-fill the tunables.  */
+# define tidx2usize(idx)	(((size_t) idx) * MALLOC_ALIGNMENT + MINSIZE - SIZE_SZ)
+
+/* When "x" is from chunksize().  */
+# define csize2tidx(x) (((x) - MINSIZE + MALLOC_ALIGNMENT - 1) / MALLOC_ALIGNMENT)
+
+/* This is another arbitrary limit, which the tunables can change.
+   Each tcache bin will hold at most this number of chunks.  */
+# define TCACHE_FILL_COUNT 7
+
+/* The counts are kept in a byte per bin.  */
+# define MAX_TCACHE_COUNT 255
+#endif
+
 struct malloc_par {
   /* Tunable parameters */
   unsigned long    trim_threshold;
   INTERNAL_SIZE_T  top_pad;
   INTERNAL_SIZE_T  mmap_threshold;
+  INTERNAL_SIZE_T  mremap_threshold;
 #ifdef PER_THREAD
   INTERNAL_SIZE_T  arena_test;
   INTERNAL_SIZE_T  arena_max;
+  /* If non-zero, threads use arenas on the NUMA node they run on.  */
+  int              arena_cpu;
+#endif
+#ifdef USE_TCACHE
+  /* Maximum number of buckets to use.  */
+  size_t           tcache_bins;
+  size_t           tcache_max_bytes;
+  /* Maximum number of chunks in each bucket.  */
+  size_t           tcache_count;
 #endif
 
   /* Memory map support */
@@ -1740,6 +1865,14 @@ struct malloc_par {
      dynamic behavior. */
   int              no_dyn_threshold;
 
+  /* Size of the transparent huge pages that heaps and large mmapped
+     chunks are advised to use, or 0 if they are not used.  */
+  size_t           thp_pagesize;
+
+  /* If non-zero, free does not trim on every large free but only on
+     every trim_interval-th one per arena; see deferred_trim.  */
+  int              trim_interval;
+
   /* Statistics */
   INTERNAL_SIZE_T  mmapped_mem;
   /*INTERNAL_SIZE_T  sbrked_mem;*/
@@ -1760,7 +1893,8 @@ struct malloc_par {
 static struct malloc_state main_arena =
   {
     .mutex = MUTEX_INITIALIZER,
-    .next = &main_arena
+    .next = &main_arena,
+    .node = -1
   };
 
 /* There is only one instance of the malloc parameters.  */
@@ -1771,6 +1905,12 @@ static struct malloc_par mp_ =
     .n_mmaps_max    = DEFAULT_MMAP_MAX,
     .mmap_threshold = DEFAULT_MMAP_THRESHOLD,
     .trim_threshold = DEFAULT_TRIM_THRESHOLD,
+    .mremap_threshold = DEFAULT_MREMAP_THRESHOLD,
+#ifdef USE_TCACHE
+    .tcache_count   = TCACHE_FILL_COUNT,
+    .tcache_bins    = TCACHE_MAX_BINS,
+    .tcache_max_bytes = tidx2usize (TCACHE_MAX_BINS - 1),
+#endif
 #ifdef PER_THREAD
 # define NARENAS_FROM_NCORES(n) ((n) * (sizeof(long) == 4 ? 2 : 8))
     .arena_test     = NARENAS_FROM_NCORES (1)
@@ -1825,6 +1965,7 @@ static void malloc_init_state(mstate av)
 */
 
 static void*  sysmalloc(INTERNAL_SIZE_T, mstate);
+static mchunkptr sysmalloc_mmap(INTERNAL_SIZE_T, mstate);
 static int      systrim(size_t, mstate);
 static void     malloc_consolidate(mstate);
 
@@ -1878,6 +2019,54 @@ static int perturb_byte;
 #define free_perturb(p, n) memset (p, perturb_byte & 0xff, n)
 
 
+#ifdef USE_TCACHE
+static void tcache_thread_shutdown (void);
+#endif
+
+/* ------------------ Transparent huge pages -------------------------- */
+
+#ifdef MADV_HUGEPAGE
+# include <not-cancel.h>
+
+/* Return the size of the transparent huge pages of the kernel, or 0 if
+   it does not provide them.  */
+static size_t
+thp_default_pagesize (void)
+{
+  char buf[32];
+  size_t size = 0;
+  ssize_t n;
+  int fd;
+
+  fd = open_not_cancel_2 ("/sys/kernel/mm/transparent_hugepage/hpage_pmd_size",
+			  O_RDONLY);
+  if (fd < 0)
+    return 0;
+  n = read_not_cancel (fd, buf, sizeof (buf));
+  close_not_cancel_no_status (fd);
+
+  for (ssize_t i = 0; i < n && buf[i] >= '0' && buf[i] <= '9'; ++i)
+    size = size * 10 + buf[i] - '0';
+
+  /* The size must be a power of two multiple of the page size.  */
+  if (size <= GLRO(dl_pagesize) || (size & (size - 1)) != 0)
+    return 0;
+  return size;
+}
+
+/* Advise the kernel to back the SIZE bytes at P, which must be page
+   aligned, with huge pages if they have been enabled.  */
+static void
+thp_advise (void *p, size_t size)
+{
+  if (mp_.thp_pagesize != 0 && size >= mp_.thp_pagesize)
+    __madvise (p, size, MADV_HUGEPAGE);
+}
+#else
+# define thp_default_pagesize() 0
+# define thp_advise(p, size) do ; while (0)
+#endif
+
 /* ------------------- Support for multiple arenas -------------------- */
 #include "arena.c"
 
@@ -2233,6 +2422,92 @@ static void do_check_malloc_state(mstate av)
 
 /* ----------- Routines dealing with system allocation -------------- */
 
+/*
+  sysmalloc_mmap maps a chunk of at least nb bytes on its own, outside
+  of any heap.  It returns the chunk, or NULL if the mapping failed.
+  sysmalloc uses it for requests above the mmap threshold, and
+  _int_realloc to move a growing block to where mremap can grow it.
+*/
+
+static mchunkptr
+sysmalloc_mmap(INTERNAL_SIZE_T nb, mstate av)
+{
+  long            size;           /* arg to mmap call */
+  char*           mm;             /* return value from mmap call*/
+  INTERNAL_SIZE_T front_misalign; /* unusable bytes at front of new space */
+  long            correction;
+  mchunkptr       p;              /* the allocated/returned chunk */
+  unsigned long   sum;            /* for updating stats */
+  size_t          pagemask  = GLRO(dl_pagesize) - 1;
+
+  /*
+    Round up size to nearest page.  For mmapped chunks, the overhead
+    is one SIZE_SZ unit larger than for normal chunks, because there
+    is no following chunk whose prev_size field could be used.
+
+    See the front_misalign handling below, for glibc there is no
+    need for further alignments unless we have have high alignment.
+  */
+  if (MALLOC_ALIGNMENT == 2 * SIZE_SZ)
+    size = (nb + SIZE_SZ + pagemask) & ~pagemask;
+  else
+    size = (nb + SIZE_SZ + MALLOC_ALIGN_MASK + pagemask) & ~pagemask;
+
+  /* Don't try if size wraps around 0 */
+  if ((unsigned long)(size) <= (unsigned long)(nb))
+    return NULL;
+
+  mm = (char*)(MMAP(0, size, PROT_READ|PROT_WRITE, 0));
+  if (mm == MAP_FAILED)
+    return NULL;
+
+  /*
+    The offset to the start of the mmapped region is stored
+    in the prev_size field of the chunk. This allows us to adjust
+    returned start address to meet alignment requirements here
+    and in memalign(), and still be able to compute proper
+    address argument for later munmap in free() and realloc().
+  */
+
+  if (MALLOC_ALIGNMENT == 2 * SIZE_SZ)
+    {
+      /* For glibc, chunk2mem increases the address by 2*SIZE_SZ and
+	 MALLOC_ALIGN_MASK is 2*SIZE_SZ-1.  Each mmap'ed area is page
+	 aligned and therefore definitely MALLOC_ALIGN_MASK-aligned.  */
+      assert (((INTERNAL_SIZE_T)chunk2mem(mm) & MALLOC_ALIGN_MASK) == 0);
+      front_misalign = 0;
+    }
+  else
+    front_misalign = (INTERNAL_SIZE_T)chunk2mem(mm) & MALLOC_ALIGN_MASK;
+  if (front_misalign > 0) {
+    correction = MALLOC_ALIGNMENT - front_misalign;
+    p = (mchunkptr)(mm + correction);
+    p->prev_size = correction;
+    set_head(p, (size - correction) |IS_MMAPPED);
+  }
+  else
+    {
+      p = (mchunkptr)mm;
+      set_head(p, size|IS_MMAPPED);
+    }
+
+  /* update statistics */
+
+  if (++mp_.n_mmaps > mp_.max_n_mmaps)
+    mp_.max_n_mmaps = mp_.n_mmaps;
+
+  sum = mp_.mmapped_mem += size;
+  if (sum > (unsigned long)(mp_.max_mmapped_mem))
+    mp_.max_mmapped_mem = sum;
+  ++av->stats.mmapped;
+
+  thp_advise (mm, size);
+
+  check_chunk(av, p);
+
+  return p;
+}
+
 /*
   sysmalloc handles malloc cases requiring more memory from the system.
   On entry, it is assumed that av->top does not have enough
@@ -2260,8 +2535,6 @@ static void* sysmalloc(INTERNAL_SIZE_T nb, mstate av)
   mchunkptr       remainder;      /* remainder from allocation */
   unsigned long   remainder_size; /* its size */
 
-  unsigned long   sum;            /* for updating stats */
-
   size_t          pagemask  = GLRO(dl_pagesize) - 1;
   bool            tried_mmap = false;
 
@@ -2275,75 +2548,11 @@ static void* sysmalloc(INTERNAL_SIZE_T nb, mstate av)
 
   if ((unsigned long)(nb) >= (unsigned long)(mp_.mmap_threshold) &&
       (mp_.n_mmaps < mp_.n_mmaps_max)) {
-
-    char* mm;             /* return value from mmap call*/
-
   try_mmap:
-    /*
-      Round up size to nearest page.  For mmapped chunks, the overhead
-      is one SIZE_SZ unit larger than for normal chunks, because there
-      is no following chunk whose prev_size field could be used.
-
-      See the front_misalign handling below, for glibc there is no
-      need for further alignments unless we have have high alignment.
-    */
-    if (MALLOC_ALIGNMENT == 2 * SIZE_SZ)
-      size = (nb + SIZE_SZ + pagemask) & ~pagemask;
-    else
-      size = (nb + SIZE_SZ + MALLOC_ALIGN_MASK + pagemask) & ~pagemask;
     tried_mmap = true;
-
-    /* Don't try if size wraps around 0 */
-    if ((unsigned long)(size) > (unsigned long)(nb)) {
-
-      mm = (char*)(MMAP(0, size, PROT_READ|PROT_WRITE, 0));
-
-      if (mm != MAP_FAILED) {
-
-	/*
-	  The offset to the start of the mmapped region is stored
-	  in the prev_size field of the chunk. This allows us to adjust
-	  returned start address to meet alignment requirements here
-	  and in memalign(), and still be able to compute proper
-	  address argument for later munmap in free() and realloc().
-	*/
-
-	if (MALLOC_ALIGNMENT == 2 * SIZE_SZ)
-	  {
-	    /* For glibc, chunk2mem increases the address by 2*SIZE_SZ and
-	       MALLOC_ALIGN_MASK is 2*SIZE_SZ-1.  Each mmap'ed area is page
-	       aligned and therefore definitely MALLOC_ALIGN_MASK-aligned.  */
-	    assert (((INTERNAL_SIZE_T)chunk2mem(mm) & MALLOC_ALIGN_MASK) == 0);
-	    front_misalign = 0;
-	  }
-	else
-	  front_misalign = (INTERNAL_SIZE_T)chunk2mem(mm) & MALLOC_ALIGN_MASK;
-	if (front_misalign > 0) {
-	  correction = MALLOC_ALIGNMENT - front_misalign;
-	  p = (mchunkptr)(mm + correction);
-	  p->prev_size = correction;
-	  set_head(p, (size - correction) |IS_MMAPPED);
-	}
-	else
-	  {
-	    p = (mchunkptr)mm;
-	    set_head(p, size|IS_MMAPPED);
-	  }
-
-	/* update statistics */
-
-	if (++mp_.n_mmaps > mp_.max_n_mmaps)
-	  mp_.max_n_mmaps = mp_.n_mmaps;
-
-	sum = mp_.mmapped_mem += size;
-	if (sum > (unsigned long)(mp_.max_mmapped_mem))
-	  mp_.max_mmapped_mem = sum;
-
-	check_chunk(av, p);
-
-	return chunk2mem(p);
-      }
-    }
+    p = sysmalloc_mmap(nb, av);
+    if (p != NULL)
+      return chunk2mem(p);
   }
 
   /* Record incoming configuration of top */
@@ -2378,6 +2587,7 @@ static void* sysmalloc(INTERNAL_SIZE_T nb, mstate av)
     old_heap_size = old_heap->size;
     if ((long) (MINSIZE + nb - old_size) > 0
 	&& grow_heap(old_heap, MINSIZE + nb - old_size) == 0) {
+      ++av->stats.top_extend;
       av->system_mem += old_heap->size - old_heap_size;
       arena_mem += old_heap->size - old_heap_size;
       set_head(old_top, (((char *)old_heap + old_heap->size) - (char *)old_top)
@@ -2385,8 +2595,11 @@ static void* sysmalloc(INTERNAL_SIZE_T nb, mstate av)
     }
     else if ((heap = new_heap(nb + (MINSIZE + sizeof(*heap)), mp_.top_pad))) {
       /* Use a newly allocated heap.  */
+      if (av->node >= 0)
+	malloc_bind_node(heap, HEAP_MAX_SIZE, av->node);
       heap->ar_ptr = av;
       heap->prev = old_heap;
+      ++av->stats.top_extend;
       av->system_mem += heap->size;
       arena_mem += heap->size;
       /* Set up the new top.  */
@@ -2440,6 +2653,18 @@ static void* sysmalloc(INTERNAL_SIZE_T nb, mstate av)
 
   size = (size + pagemask) & ~pagemask;
 
+  /* With huge pages, grow the break up to a huge page boundary so that
+     the kernel can back the whole heap with them.  Rounding SIZE alone
+     would not do, as the break need not be aligned to begin with.  */
+  if (mp_.thp_pagesize != 0 && size > 0)
+    {
+      char *cur_brk = (char *) (MORECORE (0));
+
+      if (cur_brk != (char *) (MORECORE_FAILURE))
+	size = (((unsigned long) cur_brk + size + mp_.thp_pagesize - 1)
+		& ~(mp_.thp_pagesize - 1)) - (unsigned long) cur_brk;
+    }
+
   /*
     Don't try to call MORECORE if argument is so big as to appear
     negative. Note that since mmap takes size_t arg, it may succeed
@@ -2454,6 +2679,12 @@ static void* sysmalloc(INTERNAL_SIZE_T nb, mstate av)
     void (*hook) (void) = force_reg (__after_morecore_hook);
     if (__builtin_expect (hook != NULL, 0))
       (*hook) ();
+    if (mp_.thp_pagesize != 0)
+      {
+	/* The break need not be page aligned; skip to the next page.  */
+	char *start = (char *) (((unsigned long) brk + pagemask) & ~pagemask);
+	thp_advise (start, brk + size - start);
+      }
   } else {
   /*
     If have mmap, try using it as a backup when MORECORE fails or
@@ -2497,6 +2728,7 @@ static void* sysmalloc(INTERNAL_SIZE_T nb, mstate av)
   if (brk != (char*)(MORECORE_FAILURE)) {
     if (mp_.sbrk_base == 0)
       mp_.sbrk_base = brk;
+    ++av->stats.top_extend;
     av->system_mem += size;
 
     /*
@@ -2567,9 +2799,11 @@ static void* sysmalloc(INTERNAL_SIZE_T nb, mstate av)
 
 	correction += old_size;
 
-	/* Extend the end address to hit a page boundary */
+	/* Extend the end address to hit a page boundary, or a huge page
+	   boundary if huge pages are used.  */
+	size_t endmask = mp_.thp_pagesize != 0 ? mp_.thp_pagesize - 1 : pagemask;
 	end_misalign = (INTERNAL_SIZE_T)(brk + size + correction);
-	correction += ((end_misalign + pagemask) & ~pagemask) - end_misalign;
+	correction += ((end_misalign + endmask) & ~endmask) - end_misalign;
 
 	assert(correction >= 0);
 	snd_brk = (char*)(MORECORE(correction));
@@ -2719,6 +2953,15 @@ static int systrim(size_t pad, mstate av)
   /* Release in pagesize units, keeping at least one page */
   extra = (top_size - pad - MINSIZE - 1) & ~(pagesz - 1);
 
+  /* Do not split a huge page: keep the break at a huge page boundary.  */
+  if (mp_.thp_pagesize != 0 && extra > 0)
+    {
+      unsigned long top_end = (unsigned long) av->top + top_size;
+      unsigned long new_end = (top_end - extra + mp_.thp_pagesize - 1)
+			      & ~(mp_.thp_pagesize - 1);
+      extra = (long) (top_end - new_end);
+    }
+
   if (extra > 0) {
 
     /*
@@ -2750,6 +2993,8 @@ static int systrim(size_t pad, mstate av)
 
 	if (released != 0) {
 	  /* Success. Adjust top. */
+	  ++av->stats.ntrim;
+	  av->stats.trimmed += released;
 	  av->system_mem -= released;
 	  set_head(av->top, (top_size - released) | PREV_INUSE);
 	  check_malloc_state(av);
@@ -2834,6 +3079,132 @@ mremap_chunk(mchunkptr p, size_t new_size)
 
 #endif /* HAVE_MREMAP */
 
+/*------------------------ Thread cache. -----------------------------------*/
+
+#ifdef USE_TCACHE
+
+/* We overlay this structure on the user-data portion of a chunk when
+   the chunk is stored in the per-thread cache.  */
+typedef struct tcache_entry
+{
+  struct tcache_entry *next;
+  /* This field exists to detect double frees.  */
+  struct tcache_perthread_struct *key;
+} tcache_entry;
+
+/* There is one of these for each thread, which contains the
+   per-thread cache (hence "tcache_perthread_struct").  Keeping
+   overall size low is mildly important.  Note that COUNTS and ENTRIES
+   are redundant (we could have just counted the linked list each
+   time), this is for performance reasons.  */
+typedef struct tcache_perthread_struct
+{
+  unsigned char counts[TCACHE_MAX_BINS];
+  tcache_entry *entries[TCACHE_MAX_BINS];
+} tcache_perthread_struct;
+
+static __thread tcache_perthread_struct *tcache;
+static __thread int tcache_shutting_down;
+
+/* Caller must ensure that we know tc_idx is valid and there's room
+   for more chunks.  */
+static __always_inline void
+tcache_put (mchunkptr chunk, size_t tc_idx)
+{
+  tcache_entry *e = (tcache_entry *) chunk2mem (chunk);
+
+  /* Mark this chunk as "in the tcache" so the test in _int_free will
+     detect a double free.  */
+  e->key = tcache;
+
+  e->next = tcache->entries[tc_idx];
+  tcache->entries[tc_idx] = e;
+  ++(tcache->counts[tc_idx]);
+}
+
+/* Caller must ensure that we know tc_idx is valid and there's
+   available chunks to remove.  */
+static __always_inline void *
+tcache_get (size_t tc_idx)
+{
+  tcache_entry *e = tcache->entries[tc_idx];
+  tcache->entries[tc_idx] = e->next;
+  --(tcache->counts[tc_idx]);
+  e->key = NULL;
+  return (void *) e;
+}
+
+/* Called when a thread exits, from arena_thread_freeres.  The cached
+   chunks go back to their arenas so that they can be coalesced and
+   reused by other threads.  */
+static void
+tcache_thread_shutdown (void)
+{
+  int i;
+  tcache_perthread_struct *tcache_tmp = tcache;
+
+  if (tcache == NULL)
+    return;
+
+  /* Disable the tcache and prevent it from being reinitialized.  */
+  tcache = NULL;
+  tcache_shutting_down = 1;
+
+  for (i = 0; i < TCACHE_MAX_BINS; ++i)
+    {
+      while (tcache_tmp->entries[i])
+	{
+	  tcache_entry *e = tcache_tmp->entries[i];
+	  tcache_tmp->entries[i] = e->next;
+	  e->key = NULL;
+	  __libc_free (e);
+	}
+    }
+
+  __libc_free (tcache_tmp);
+}
+
+static void
+tcache_init (void)
+{
+  mstate ar_ptr;
+  void *victim = 0;
+  const size_t bytes = sizeof (tcache_perthread_struct);
+
+  if (tcache_shutting_down)
+    return;
+
+  arena_get (ar_ptr, bytes);
+  if (!ar_ptr)
+    return;
+  victim = _int_malloc (ar_ptr, bytes);
+  if (!victim)
+    {
+      ar_ptr = arena_get_retry (ar_ptr, bytes);
+      if (ar_ptr != NULL)
+	victim = _int_malloc (ar_ptr, bytes);
+    }
+  if (ar_ptr != NULL)
+    (void)mutex_unlock (&ar_ptr->mutex);
+
+  /* In a low memory situation, we may not be able to allocate memory
+     - in which case, we just keep trying later.  However, we
+     typically do this very early, so either there is sufficient
+     memory, or there isn't enough memory to do non-trivial
+     allocations anyway.  */
+  if (victim)
+    {
+      tcache = (tcache_perthread_struct *) victim;
+      memset (tcache, 0, sizeof (tcache_perthread_struct));
+    }
+}
+
+# define MAYBE_INIT_TCACHE() \
+  if (__builtin_expect (tcache == NULL, 0)) \
+    tcache_init ();
+
+#endif /* USE_TCACHE */
+
 /*------------------------ Public wrappers. --------------------------------*/
 
 void*
@@ -2847,6 +3218,25 @@ __libc_malloc(size_t bytes)
   if (__builtin_expect (hook != NULL, 0))
     return (*hook)(bytes, RETURN_ADDRESS (0));
 
+#ifdef USE_TCACHE
+  /* _int_free also calls request2size, be careful to not pad twice.  */
+  size_t tbytes;
+  checked_request2size (bytes, tbytes);
+  size_t tc_idx = csize2tidx (tbytes);
+
+  MAYBE_INIT_TCACHE ();
+
+  if (tc_idx < mp_.tcache_bins
+      && tcache != NULL
+      && tcache->entries[tc_idx] != NULL)
+    {
+      victim = tcache_get (tc_idx);
+      if (__builtin_expect (perturb_byte, 0))
+	alloc_perturb (victim, bytes);
+      return victim;
+    }
+#endif
+
   arena_lookup(ar_ptr);
 
   arena_lock(ar_ptr, bytes);
@@ -2904,6 +3294,34 @@ __libc_free(void* mem)
 }
 libc_hidden_def (__libc_free)
 
+void
+__libc_free_sized(void* mem, size_t bytes)
+{
+  void (*hook) (void *, const void *)
+    = force_reg (__free_hook);
+  if (__builtin_expect (hook != NULL, 0)) {
+    (*hook)(mem, RETURN_ADDRESS (0));
+    return;
+  }
+
+  if (mem == 0)
+    return;
+
+  /* The size is not used: free has to read the chunk header for its
+     integrity checks anyway, so trusting the caller's size would save
+     nothing unless those checks were skipped.  */
+  __libc_free (mem);
+}
+
+void
+__libc_free_aligned_sized(void* mem, size_t alignment, size_t bytes)
+{
+  /* A block from memalign is carved out so that its chunk is no smaller
+     than a plain request of BYTES would be.  The alignment does not
+     matter when freeing it.  */
+  __libc_free_sized (mem, bytes);
+}
+
 void*
 __libc_realloc(void* oldmem, size_t bytes)
 {
@@ -2969,7 +3387,7 @@ __libc_realloc(void* oldmem, size_t bytes)
     ++(ar_ptr->stat_lock_wait);
   }
 #else
-  (void)mutex_lock(&ar_ptr->mutex);
+  arena_mutex_lock(ar_ptr);
 #endif
 
 #if !defined PER_THREAD
@@ -3225,6 +3643,103 @@ __libc_calloc(size_t n, size_t elem_size)
   return mem;
 }
 
+size_t
+__libc_malloc_batch(size_t bytes, size_t n, void** ptrs)
+{
+  mstate ar_ptr;
+  size_t i = 0;
+
+  void *(*hook) (size_t, const void *)
+    = force_reg (__malloc_hook);
+  if (__builtin_expect (hook != NULL, 0)) {
+    for (; i < n; ++i)
+      if ((ptrs[i] = (*hook)(bytes, RETURN_ADDRESS (0))) == NULL)
+	break;
+    return i;
+  }
+
+#ifdef USE_TCACHE
+  size_t tbytes;
+  checked_request2size (bytes, tbytes);
+  size_t tc_idx = csize2tidx (tbytes);
+
+  MAYBE_INIT_TCACHE ();
+
+  if (tc_idx < mp_.tcache_bins && tcache != NULL)
+    for (; i < n && tcache->entries[tc_idx] != NULL; ++i)
+      {
+	ptrs[i] = tcache_get (tc_idx);
+	if (__builtin_expect (perturb_byte, 0))
+	  alloc_perturb (ptrs[i], bytes);
+      }
+  if (i == n)
+    return n;
+#endif
+
+  arena_get(ar_ptr, bytes);
+  if(!ar_ptr)
+    return i;
+  i += _int_malloc_batch(ar_ptr, bytes, n - i, ptrs + i);
+  if (i < n) {
+    ar_ptr = arena_get_retry(ar_ptr, bytes);
+    if (__builtin_expect(ar_ptr == NULL, 0))
+      return i;
+    i += _int_malloc_batch(ar_ptr, bytes, n - i, ptrs + i);
+  }
+  (void)mutex_unlock(&ar_ptr->mutex);
+  return i;
+}
+
+void
+__libc_free_batch(void** ptrs, size_t n)
+{
+  mstate ar_ptr = NULL;                 /* arena currently locked */
+
+  void (*hook) (void *, const void *)
+    = force_reg (__free_hook);
+  if (__builtin_expect (hook != NULL, 0)) {
+    for (size_t i = 0; i < n; ++i)
+      (*hook)(ptrs[i], RETURN_ADDRESS (0));
+    return;
+  }
+
+  for (size_t i = 0; i < n; ++i) {
+    void *mem = ptrs[i];
+    if (mem == 0)
+      continue;
+
+    mchunkptr p = mem2chunk(mem);
+    if (chunk_is_mmapped(p)) {
+      __libc_free(mem);
+      continue;
+    }
+
+    mstate av = arena_for_chunk(p);
+#ifdef USE_TCACHE
+    /* _int_free puts the chunk in the tcache without taking the lock
+       if there is room.  */
+    size_t tc_idx = csize2tidx (chunksize (p));
+    if (tcache != NULL && tc_idx < mp_.tcache_bins
+	&& tcache->counts[tc_idx] < mp_.tcache_count) {
+      _int_free(av, p, av == ar_ptr);
+      continue;
+    }
+#endif
+
+    /* Never hold two arena locks at once.  */
+    if (av != ar_ptr) {
+      if (ar_ptr != NULL)
+	(void)mutex_unlock(&ar_ptr->mutex);
+      ar_ptr = av;
+      arena_mutex_lock(ar_ptr);
+    }
+    _int_free(ar_ptr, p, 1);
+  }
+
+  if (ar_ptr != NULL)
+    (void)mutex_unlock(&ar_ptr->mutex);
+}
+
 /*
   ------------------------------ malloc ------------------------------
 */
@@ -3263,6 +3778,10 @@ _int_malloc(mstate av, size_t bytes)
 
   checked_request2size(bytes, nb);
 
+  /* Take back the chunks other threads have freed into this arena.  */
+  if (__builtin_expect (av->remote_frees != NULL, 0))
+    drain_remote_frees (av);
+
   /*
     If the size qualifies as a fastbin, first check corresponding bin.
     This code is safe to execute even if av is not yet initialized, so we
@@ -3290,6 +3809,35 @@ _int_malloc(mstate av, size_t bytes)
 	  return NULL;
 	}
       check_remalloced_chunk(av, victim, nb);
+      ++av->stats.fastbin_hits[idx];
+#ifdef USE_TCACHE
+      /* While we're here, if we see other chunks of the same size,
+	 stash them in the tcache.  */
+      size_t tc_idx = csize2tidx (nb);
+      if (tcache != NULL && tc_idx < mp_.tcache_bins)
+	{
+	  mchunkptr tc_victim;
+
+	  /* While bin not empty and tcache not full, move chunks.  */
+	  while (tcache->counts[tc_idx] < mp_.tcache_count)
+	    {
+	      pp = *fb;
+	      do
+		{
+		  tc_victim = pp;
+		  if (tc_victim == NULL)
+		    break;
+		}
+	      while ((pp = catomic_compare_and_exchange_val_acq (fb,
+								  tc_victim->fd,
+								  tc_victim))
+		     != tc_victim);
+	      if (tc_victim == NULL)
+		break;
+	      tcache_put (tc_victim, tc_idx);
+	    }
+	}
+#endif
       void *p = chunk2mem(victim);
       if (__builtin_expect (perturb_byte, 0))
 	alloc_perturb (p, bytes);
@@ -3326,6 +3874,32 @@ _int_malloc(mstate av, size_t bytes)
 	if (av != &main_arena)
 	  victim->size |= NON_MAIN_ARENA;
 	check_malloced_chunk(av, victim, nb);
+	++av->stats.smallbin_hits;
+#ifdef USE_TCACHE
+	/* While we're here, if we see other chunks of the same size,
+	   stash them in the tcache.  */
+	size_t tc_idx = csize2tidx (nb);
+	if (tcache != NULL && tc_idx < mp_.tcache_bins)
+	  {
+	    mchunkptr tc_victim;
+
+	    /* While bin not empty and tcache not full, move chunks over.  */
+	    while (tcache->counts[tc_idx] < mp_.tcache_count
+		   && (tc_victim = last (bin)) != bin)
+	      {
+		bck = tc_victim->bk;
+		if (__builtin_expect (bck->fd != tc_victim, 0))
+		  break;
+		set_inuse_bit_at_offset (tc_victim, nb);
+		if (av != &main_arena)
+		  tc_victim->size |= NON_MAIN_ARENA;
+		bin->bk = bck;
+		bck->fd = bin;
+
+		tcache_put (tc_victim, tc_idx);
+	      }
+	  }
+#endif
 	void *p = chunk2mem(victim);
 	if (__builtin_expect (perturb_byte, 0))
 	  alloc_perturb (p, bytes);
@@ -3364,6 +3938,8 @@ _int_malloc(mstate av, size_t bytes)
     otherwise need to expand memory to service a "small" request.
   */
 
+  ++av->stats.bin_misses;
+
   for(;;) {
 
     int iters = 0;
@@ -3716,12 +4292,79 @@ _int_malloc(mstate av, size_t bytes)
   }
 }
 
+/*
+  Allocate up to n chunks of n_bytes each from av, which is locked.
+  Requests that a fastbin or smallbin of the exact size can serve go
+  through _int_malloc.  Once those bins are empty, as many chunks as
+  fit are split off the top chunk at once, without looking at the
+  other bins for each of them.  Returns the number of chunks allocated.
+*/
+
+static size_t
+_int_malloc_batch(mstate av, size_t bytes, size_t n, void** ptrs)
+{
+  INTERNAL_SIZE_T nb;               /* normalized request size */
+  mchunkptr       victim;           /* chunk being split off top */
+  INTERNAL_SIZE_T size;             /* what is left of top */
+  mbinptr         bin = NULL;       /* smallbin for nb, if any */
+  size_t          i = 0;
+
+  checked_request2size(bytes, nb);
+  if (in_smallbin_range(nb))
+    bin = bin_at(av, smallbin_index(nb));
+
+  while (i < n) {
+    if (bin != NULL && last(bin) == bin &&
+	(nb > get_max_fast() || fastbin(av, fastbin_index(nb)) == NULL) &&
+	av->remote_frees == NULL &&
+	(unsigned long)(chunksize(av->top)) >= (unsigned long)(nb + MINSIZE)) {
+      victim = av->top;
+      size = chunksize(victim);
+
+      size_t k = (size - MINSIZE) / nb;
+      if (k > n - i)
+	k = n - i;
+      av->stats.bin_misses += k;
+
+      for (; k > 0; --k) {
+	set_head(victim, nb | PREV_INUSE |
+		 (av != &main_arena ? NON_MAIN_ARENA : 0));
+	ptrs[i] = chunk2mem(victim);
+	if (__builtin_expect (perturb_byte, 0))
+	  alloc_perturb (ptrs[i], bytes);
+	++i;
+	size -= nb;
+	victim = chunk_at_offset(victim, nb);
+      }
+      av->top = victim;
+      set_head(victim, size | PREV_INUSE);
+      continue;
+    }
+
+    /* Bins to search first, no top chunk yet, or top is too small.  */
+    void *p = _int_malloc(av, bytes);
+    if (p == NULL)
+      break;
+    ptrs[i++] = p;
+  }
+
+  return i;
+}
+
 /*
   ------------------------------ free ------------------------------
 */
 
 static void
 _int_free(mstate av, mchunkptr p, int have_lock)
+{
+  _int_free_cache (av, p, have_lock, 1);
+}
+
+/* Like _int_free, but if USE_TCACHE is zero never put P into the
+   calling thread's tcache, so that it ends up in AV's bins.  */
+static void
+_int_free_cache(mstate av, mchunkptr p, int have_lock, int use_tcache)
 {
   INTERNAL_SIZE_T size;        /* its size */
   mfastbinptr*    fb;          /* associated fastbin */
@@ -3761,6 +4404,44 @@ _int_free(mstate av, mchunkptr p, int have_lock)
 
   check_inuse_chunk(av, p);
 
+#ifdef USE_TCACHE
+  {
+    size_t tc_idx = csize2tidx (size);
+
+    if (use_tcache && tcache != NULL && tc_idx < mp_.tcache_bins
+	&& !chunk_is_mmapped (p))
+      {
+	/* Check to see if it's already in the tcache.  */
+	tcache_entry *e = (tcache_entry *) chunk2mem (p);
+
+	/* This test succeeds on double free.  However, we don't 100%
+	   trust it (it also matches random payload data at a 1 in
+	   2^<size_t> chance), so verify it's not an unlikely
+	   coincidence before aborting.  */
+	if (__builtin_expect (e->key == tcache, 0))
+	  {
+	    tcache_entry *tmp;
+	    for (tmp = tcache->entries[tc_idx]; tmp; tmp = tmp->next)
+	      if (tmp == e)
+		{
+		  errstr = "free(): double free detected in tcache";
+		  goto errout;
+		}
+	    /* If we get here, it was a coincidence.  We've wasted a
+	       few cycles, but don't abort.  */
+	  }
+
+	if (tcache->counts[tc_idx] < mp_.tcache_count)
+	  {
+	    if (__builtin_expect (perturb_byte, 0))
+	      free_perturb (chunk2mem (p), size - 2 * SIZE_SZ);
+	    tcache_put (p, tc_idx);
+	    return;
+	  }
+      }
+  }
+#endif
+
   /*
     If eligible, place chunk on a fastbin so it can be found
     and used quickly in malloc.
@@ -3840,6 +4521,10 @@ _int_free(mstate av, mchunkptr p, int have_lock)
 
   else if (!chunk_is_mmapped(p)) {
     if (! have_lock) {
+      /* Do not contend for the lock of an arena the thread is not
+	 attached to; hand the chunk to the arena's users instead.  */
+      if (queue_remote_free (av, p))
+	return;
 #if THREAD_STATS
       if(!mutex_trylock(&av->mutex))
 	++(av->stat_lock_direct);
@@ -3848,7 +4533,7 @@ _int_free(mstate av, mchunkptr p, int have_lock)
 	++(av->stat_lock_wait);
       }
 #else
-      (void)mutex_lock(&av->mutex);
+      arena_mutex_lock(av);
 #endif
       locked = 1;
     }
@@ -3962,22 +4647,26 @@ _int_free(mstate av, mchunkptr p, int have_lock)
     */
 
     if ((unsigned long)(size) >= FASTBIN_CONSOLIDATION_THRESHOLD) {
-      if (have_fastchunks(av))
-	malloc_consolidate(av);
+      if (mp_.trim_interval > 0)
+	deferred_trim(av);
+      else {
+	if (have_fastchunks(av))
+	  malloc_consolidate(av);
 
-      if (av == &main_arena) {
+	if (av == &main_arena) {
 #ifndef MORECORE_CANNOT_TRIM
-	if ((unsigned long)(chunksize(av->top)) >=
-	    (unsigned long)(mp_.trim_threshold))
-	  systrim(mp_.top_pad, av);
+	  if ((unsigned long)(chunksize(av->top)) >=
+	      (unsigned long)(mp_.trim_threshold))
+	    systrim(mp_.top_pad, av);
 #endif
-      } else {
-	/* Always try heap_trim(), even if the top chunk is not
-	   large, because the corresponding heap might go away.  */
-	heap_info *heap = heap_for_ptr(top(av));
+	} else {
+	  /* Always try heap_trim(), even if the top chunk is not
+	     large, because the corresponding heap might go away.  */
+	  heap_info *heap = heap_for_ptr(top(av));
 
-	assert(heap->ar_ptr == av);
-	heap_trim(heap, mp_.top_pad);
+	  assert(heap->ar_ptr == av);
+	  heap_trim(heap, mp_.top_pad);
+	}
       }
     }
 
@@ -3995,6 +4684,68 @@ _int_free(mstate av, mchunkptr p, int have_lock)
   }
 }
 
+/*
+  ------------------------- remote frees -------------------------
+
+  A chunk freed by a thread that is not attached to the chunk's arena
+  (typically the consumer side of a producer/consumer pair) would
+  otherwise make that thread take the arena lock, contending with the
+  threads that allocate from it.  Instead the chunk is pushed onto the
+  arena's remote_frees list with a single compare-and-exchange, and
+  the next _int_malloc on the arena, which holds the lock anyway, frees
+  the whole list.  The chunks keep their inuse bit while queued.
+  Draining returns them to the arena's bins rather than to the tcache
+  of whichever thread happens to drain, so that after a drain they
+  count as free space of the arena: mallinfo, malloc_info and
+  malloc_trim drain too, as does arena_get2 when it hands an idle
+  arena to another thread.
+
+  Only the draining side ever removes entries, and it takes the whole
+  list at once, so there is no ABA problem.
+*/
+
+static int
+queue_remote_free (mstate av, mchunkptr p)
+{
+  void *vptr = NULL;
+  mstate self = tsd_getspecific (arena_key, vptr);
+
+  if (self == av)
+    return 0;
+
+  mchunkptr fd;
+  mchunkptr old = av->remote_frees;
+  do
+    {
+      /* A chunk freed twice would make a cycle out of the list.  */
+      if (__builtin_expect (old == p, 0))
+	{
+	  malloc_printerr (check_action, "double free or corruption (remote)",
+			   chunk2mem (p));
+	  return 1;
+	}
+      p->fd = fd = old;
+    }
+  while ((old = catomic_compare_and_exchange_val_rel (&av->remote_frees, p, fd))
+	 != fd);
+
+  return 1;
+}
+
+/* Free the chunks queued on AV by other threads.  AV must be locked.  */
+static void
+drain_remote_frees (mstate av)
+{
+  mchunkptr p = atomic_exchange_acq (&av->remote_frees, NULL);
+
+  while (p != NULL)
+    {
+      mchunkptr next = p->fd;
+      _int_free_cache (av, p, 1, 0);
+      p = next;
+    }
+}
+
 /*
   ------------------------- malloc_consolidate -------------------------
 
@@ -4165,6 +4916,24 @@ _int_realloc(mstate av, mchunkptr oldp, INTERNAL_SIZE_T oldsize,
   }
 
   else {
+    /* If the block ends at the top of a heap that is too small, try
+       to grow the heap in place.  */
+    if (next == av->top && av != &main_arena &&
+	(unsigned long)(oldsize + nextsize) < (unsigned long)(nb + MINSIZE)) {
+      heap_info *heap = heap_for_ptr(next);
+      size_t old_heap_size = heap->size;
+
+      if (grow_heap(heap, nb + MINSIZE - (oldsize + nextsize)) == 0) {
+	++av->stats.top_extend;
+	av->system_mem += heap->size - old_heap_size;
+	arena_mem += heap->size - old_heap_size;
+	if ((unsigned long)(av->system_mem) > (unsigned long)(av->max_system_mem))
+	  av->max_system_mem = av->system_mem;
+	nextsize += heap->size - old_heap_size;
+	set_head(next, nextsize | PREV_INUSE);
+      }
+    }
+
     /* Try to expand forward into top */
     if (next == av->top &&
 	(unsigned long)(newsize = oldsize + nextsize) >=
@@ -4185,6 +4954,18 @@ _int_realloc(mstate av, mchunkptr oldp, INTERNAL_SIZE_T oldsize,
       unlink(next, bck, fwd);
     }
 
+    /* A large block that cannot grow in place is likely to be grown
+       again.  Give it a mapping of its own, so that this is the last
+       time it is copied.  */
+    else if (mp_.mremap_threshold != 0 &&
+	     (unsigned long)(nb) >= (unsigned long)(mp_.mremap_threshold) &&
+	     mp_.n_mmaps < mp_.n_mmaps_max &&
+	     (newp = sysmalloc_mmap(nb, av)) != NULL) {
+      MALLOC_COPY(chunk2mem(newp), chunk2mem(oldp), oldsize - SIZE_SZ);
+      _int_free(av, oldp, 1);
+      return chunk2mem(newp);
+    }
+
     /* allocate, copy, free */
     else {
       newmem = _int_malloc(av, nb - MALLOC_ALIGN_MASK);
@@ -4404,12 +5185,20 @@ _int_pvalloc(mstate av, size_t bytes)
   ------------------------------ malloc_trim ------------------------------
 */
 
-static int mtrim(mstate av, size_t pad)
-{
-  /* Ensure initialization/consolidation */
-  malloc_consolidate (av);
+#ifdef MADV_FREE
+/* Set once the kernel has rejected MADV_FREE.  */
+static int madv_free_unsupported;
+#endif
 
-  const size_t ps = GLRO(dl_pagesize);
+/* Give the whole pages inside the free chunks of arena AV back to the
+   system.  With LAZY set, the kernel is allowed to reclaim them only
+   when it needs the memory, which is cheaper for both the release and
+   the next use.  With huge pages, only whole huge pages are released
+   so that none is split.  */
+static int
+release_free_pages (mstate av, int lazy)
+{
+  const size_t ps = mp_.thp_pagesize ? : GLRO(dl_pagesize);
   int psindex = bin_index (ps);
   const size_t psm1 = ps - 1;
 
@@ -4443,7 +5232,20 @@ static int mtrim(mstate av, size_t pad)
 		       content.  */
 		    memset (paligned_mem, 0x89, size & ~psm1);
 #endif
-		    __madvise (paligned_mem, size & ~psm1, MADV_DONTNEED);
+#ifdef MADV_FREE
+		    if (! lazy || madv_free_unsupported
+			|| __madvise (paligned_mem, size & ~psm1,
+				      MADV_FREE) != 0)
+#endif
+		      {
+#ifdef MADV_FREE
+			if (lazy)
+			  madv_free_unsupported = 1;
+#endif
+			__madvise (paligned_mem, size & ~psm1, MADV_DONTNEED);
+		      }
+		    ++av->stats.ntrim;
+		    av->stats.trimmed += size & ~psm1;
 
 		    result = 1;
 		  }
@@ -4451,6 +5253,21 @@ static int mtrim(mstate av, size_t pad)
 	  }
       }
 
+  return result;
+}
+
+static int mtrim(mstate av, size_t pad)
+{
+  /* Return queued remote frees so that they can be trimmed too.  */
+  if (av->remote_frees != NULL)
+    drain_remote_frees (av);
+
+  /* Ensure initialization/consolidation */
+  malloc_consolidate (av);
+  av->trim_count = 0;
+
+  int result = release_free_pages (av, 0);
+
 #ifndef MORECORE_CANNOT_TRIM
   return result | (av == &main_arena ? systrim (pad, av) : 0);
 #else
@@ -4458,6 +5275,40 @@ static int mtrim(mstate av, size_t pad)
 #endif
 }
 
+/*
+  Trimming in free costs system calls, and free only looks at the top
+  of the heap.  When M_TRIM_INTERVAL is set, _int_free calls this
+  instead for every free of at least FASTBIN_CONSOLIDATION_THRESHOLD
+  bytes.  Only every trim_interval-th such call on an arena does the
+  work: it trims the top of the heap as free would have done, and also
+  releases the free pages in the middle of the heap, lazily where the
+  kernel supports it.  malloc_trim restarts the count.
+*/
+
+static void
+deferred_trim (mstate av)
+{
+  if (++av->trim_count < mp_.trim_interval)
+    return;
+  av->trim_count = 0;
+
+  if (have_fastchunks (av))
+    malloc_consolidate (av);
+
+  release_free_pages (av, 1);
+
+  if (av == &main_arena)
+    {
+#ifndef MORECORE_CANNOT_TRIM
+      if ((unsigned long) chunksize (av->top)
+	  >= (unsigned long) mp_.trim_threshold)
+	systrim (mp_.top_pad, av);
+#endif
+    }
+  else
+    heap_trim (heap_for_ptr (top (av)), mp_.top_pad);
+}
+
 
 int
 __malloc_trim(size_t s)
@@ -4532,6 +5383,10 @@ int_mallinfo(mstate av, struct mallinfo *m)
   /* Ensure initialization */
   if (av->top == 0)  malloc_consolidate(av);
 
+  /* Chunks waiting on the remote free list are free, not in use.  */
+  if (av->remote_frees != NULL)
+    drain_remote_frees (av);
+
   check_malloc_state(av);
 
   /* Account for top */
@@ -4625,6 +5480,8 @@ __malloc_stats (void)
     fprintf(stderr, "Arena %d:\n", i);
     fprintf(stderr, "system bytes     = %10u\n", (unsigned int)mi.arena);
     fprintf(stderr, "in use bytes     = %10u\n", (unsigned int)mi.uordblks);
+    fprintf(stderr, "lock waits       = %10lu\n",
+	    (unsigned long)ar_ptr->stats.nlock_contended);
 #if MALLOC_DEBUG > 1
     if (i > 0)
       dump_heap(heap_for_ptr(top(ar_ptr)));
@@ -4709,6 +5566,13 @@ int __libc_mallopt(int param_number, int value)
     mp_.no_dyn_threshold = 1;
     break;
 
+  case M_MREMAP_THRESHOLD:
+    if (!HAVE_MREMAP || value < 0)
+      res = 0;
+    else
+      mp_.mremap_threshold = value;
+    break;
+
   case M_CHECK_ACTION:
     check_action = value;
     break;
@@ -4727,6 +5591,52 @@ int __libc_mallopt(int param_number, int value)
     if (value > 0)
       mp_.arena_max = value;
     break;
+
+  case M_ARENA_CPU:
+    if (value == 0 || value == 1)
+      mp_.arena_cpu = value;
+    else
+      res = 0;
+    break;
+#endif
+
+  case M_TRIM_INTERVAL:
+    if (value >= 0)
+      mp_.trim_interval = value;
+    else
+      res = 0;
+    break;
+
+  case M_HUGEPAGE:
+    if (value == 0)
+      mp_.thp_pagesize = 0;
+    else if (value == 1)
+      {
+	mp_.thp_pagesize = thp_default_pagesize ();
+	if (mp_.thp_pagesize == 0)
+	  res = 0;
+      }
+    else
+      res = 0;
+    break;
+
+#ifdef USE_TCACHE
+  case M_TCACHE_COUNT:
+    if (value >= 0 && value <= MAX_TCACHE_COUNT)
+      mp_.tcache_count = value;
+    else
+      res = 0;
+    break;
+
+  case M_TCACHE_MAX:
+    if (value >= 0 && (size_t) value <= MAX_TCACHE_SIZE)
+      {
+	mp_.tcache_max_bytes = value;
+	mp_.tcache_bins = csize2tidx (request2size (value)) + 1;
+      }
+    else
+      res = 0;
+    break;
 #endif
   }
   (void)mutex_unlock(&av->mutex);
@@ -4899,6 +5809,7 @@ malloc_printerr(int action, const char *str, void *ptr)
     abort ();
 }
 
+#include <inttypes.h>
 #include <sys/param.h>
 
 /* We need a wrapper function for one of the additions of POSIX.  */
@@ -4949,6 +5860,33 @@ malloc_info (int options, FILE *fp)
   size_t total_max_system = 0;
   size_t total_aspace = 0;
   size_t total_aspace_mprotect = 0;
+  struct malloc_arena_stats total_stats;
+
+  memset (&total_stats, 0, sizeof (total_stats));
+
+  void mi_stats (const struct malloc_arena_stats *st)
+  {
+    fprintf (fp,
+	     "<stats>\n"
+	     "<locks acquired=\"%zu\" contended=\"%zu\" wait_ns=\"%" PRIu64
+	     "\"/>\n", st->nlock, st->nlock_contended, st->lock_wait_ns);
+
+    for (size_t i = 0; i < NFASTBINS; ++i)
+      if (st->fastbin_hits[i] != 0)
+	fprintf (fp, "<fastbin size=\"%zu\" hits=\"%zu\"/>\n",
+		 (size_t) (i + 2) << (SIZE_SZ == 8 ? 4 : 3),
+		 st->fastbin_hits[i]);
+
+    fprintf (fp,
+	     "<smallbin hits=\"%zu\"/>\n"
+	     "<bins misses=\"%zu\"/>\n"
+	     "<top extend=\"%zu\"/>\n"
+	     "<mmap count=\"%zu\"/>\n"
+	     "<trim count=\"%zu\" size=\"%zu\"/>\n"
+	     "</stats>\n",
+	     st->smallbin_hits, st->bin_misses, st->top_extend, st->mmapped,
+	     st->ntrim, st->trimmed);
+  }
 
   void mi_arena (mstate ar_ptr)
   {
@@ -4969,6 +5907,10 @@ malloc_info (int options, FILE *fp)
 
     mutex_lock (&ar_ptr->mutex);
 
+    /* Chunks waiting on the remote free list are free, not in use.  */
+    if (ar_ptr->remote_frees != NULL)
+      drain_remote_frees (ar_ptr);
+
     for (size_t i = 0; i < NFASTBINS; ++i)
       {
 	mchunkptr p = fastbin (ar_ptr, i);
@@ -5038,8 +5980,22 @@ malloc_info (int options, FILE *fp)
 	avail += sizes[NFASTBINS - 1 + i].total;
       }
 
+    struct malloc_arena_stats stats = ar_ptr->stats;
+
     mutex_unlock (&ar_ptr->mutex);
 
+    total_stats.nlock += stats.nlock;
+    total_stats.nlock_contended += stats.nlock_contended;
+    total_stats.lock_wait_ns += stats.lock_wait_ns;
+    for (size_t i = 0; i < NFASTBINS; ++i)
+      total_stats.fastbin_hits[i] += stats.fastbin_hits[i];
+    total_stats.smallbin_hits += stats.smallbin_hits;
+    total_stats.bin_misses += stats.bin_misses;
+    total_stats.top_extend += stats.top_extend;
+    total_stats.mmapped += stats.mmapped;
+    total_stats.ntrim += stats.ntrim;
+    total_stats.trimmed += stats.trimmed;
+
     total_nfastblocks += nfastblocks;
     total_fastavail += fastavail;
 
@@ -5089,6 +6045,8 @@ malloc_info (int options, FILE *fp)
 	total_aspace_mprotect += ar_ptr->system_mem;
       }
 
+    mi_stats (&stats);
+
     fputs ("</heap>\n", fp);
   }
 
@@ -5112,11 +6070,12 @@ malloc_info (int options, FILE *fp)
 	   "<system type=\"current\" size=\"%zu\"/>\n"
 	   "<system type=\"max\" size=\"%zu\"/>\n"
 	   "<aspace type=\"total\" size=\"%zu\"/>\n"
-	   "<aspace type=\"mprotect\" size=\"%zu\"/>\n"
-	   "</malloc>\n",
+	   "<aspace type=\"mprotect\" size=\"%zu\"/>\n",
 	   total_nfastblocks, total_fastavail, total_nblocks, total_avail,
 	   total_system, total_max_system,
 	   total_aspace, total_aspace_mprotect);
+  mi_stats (&total_stats);
+  fputs ("</malloc>\n", fp);
 
   return 0;
 }
@@ -5125,6 +6084,10 @@ malloc_info (int options, FILE *fp)
 strong_alias (__libc_calloc, __calloc) weak_alias (__libc_calloc, calloc)
 strong_alias (__libc_free, __cfree) weak_alias (__libc_free, cfree)
 strong_alias (__libc_free, __free) strong_alias (__libc_free, free)
+weak_alias (__libc_free_sized, free_sized)
+weak_alias (__libc_free_aligned_sized, free_aligned_sized)
+weak_alias (__libc_malloc_batch, malloc_batch)
+weak_alias (__libc_free_batch, free_batch)
 strong_alias (__libc_malloc, __malloc) strong_alias (__libc_malloc, malloc)
 strong_alias (__libc_memalign, __memalign)
 weak_alias (__libc_memalign, memalign)
@@ -55,6 +55,24 @@ extern void free (void *__ptr) __THROW;
 /* Free a block allocated by `calloc'. */
 extern void cfree (void *__ptr) __THROW;
 
+/* Free a block allocated by `malloc', `realloc' or `calloc' with a
+   request of SIZE bytes.  */
+extern void free_sized (void *__ptr, size_t __size) __THROW;
+
+/* Free a block of SIZE bytes allocated by `memalign', `aligned_alloc'
+   or `posix_memalign' with ALIGNMENT.  */
+extern void free_aligned_sized (void *__ptr, size_t __alignment,
+				size_t __size) __THROW;
+
+/* Allocate N blocks of SIZE bytes each and store them in PTRS.  Return
+   the number of blocks allocated, which is less than N only if memory
+   ran out.  */
+extern size_t malloc_batch (size_t __size, size_t __n, void **__ptrs)
+     __THROW __wur;
+
+/* Free the N blocks in PTRS.  Null pointers are ignored.  */
+extern void free_batch (void **__ptrs, size_t __n) __THROW;
+
 /* Allocate SIZE bytes allocated to ALIGNMENT bytes.  */
 extern void *memalign (size_t __alignment, size_t __size)
      __THROW __attribute_malloc__ __wur;
@@ -116,6 +134,12 @@ extern struct mallinfo mallinfo (void) __THROW;
 #define M_PERTURB	    -6
 #define M_ARENA_TEST	    -7
 #define M_ARENA_MAX	    -8
+#define M_TCACHE_COUNT	    -9
+#define M_TCACHE_MAX	    -10
+#define M_HUGEPAGE	    -11
+#define M_TRIM_INTERVAL	    -12
+#define M_ARENA_CPU	    -13
+#define M_MREMAP_THRESHOLD  -14
 
 /* General SVID/XPG interface to tunable parameters. */
 extern int mallopt (int __param, int __val) __THROW;
@@ -0,0 +1,107 @@
+/* Test free_sized and free_aligned_sized.
+   Copyright (C) 2013 Free Software Foundation, Inc.
+   This file is part of the GNU C Library.
+
+   The GNU C Library is free software; you can redistribute it and/or
+   modify it under the terms of the GNU Lesser General Public
+   License as published by the Free Software Foundation; either
+   version 2.1 of the License, or (at your option) any later version.
+
+   The GNU C Library is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+   Lesser General Public License for more details.
+
+   You should have received a copy of the GNU Lesser General Public
+   License along with the GNU C Library; if not, see
+   <http://www.gnu.org/licenses/>.  */
+
+#include <malloc.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define N 500
+
+static void *arr[N];
+static size_t sizes[N];
+
+static int
+do_test (void)
+{
+  int result = 0;
+
+  free_sized (NULL, 0);
+  free_sized (NULL, 100);
+  free_aligned_sized (NULL, 64, 100);
+
+  /* A small block freed with its size is handed out again for the
+     same size.  */
+  void *p = malloc (40);
+  free_sized (p, 40);
+  void *q = malloc (40);
+  if (q != p)
+    puts ("note: small block was not reused");
+  free_sized (q, 40);
+
+  /* Sizes from tiny to above the mmap threshold, each written in full
+     and freed with the size it was requested with.  Blocks shrunk by
+     realloc are freed with their new size.  */
+  for (int round = 0; round < 3; ++round)
+    {
+      for (int i = 0; i < N; ++i)
+	{
+	  sizes[i] = (i % 10 == 9) ? 200000 + i : (size_t) (i * 13) % 2000;
+	  arr[i] = malloc (sizes[i]);
+	  if (arr[i] == NULL)
+	    {
+	      puts ("malloc failed");
+	      return 1;
+	    }
+	  memset (arr[i], i & 0xff, sizes[i]);
+	  if (i % 7 == 0 && sizes[i] > 16)
+	    {
+	      sizes[i] /= 2;
+	      arr[i] = realloc (arr[i], sizes[i]);
+	    }
+	}
+
+      for (int i = 0; i < N; ++i)
+	{
+	  for (size_t j = 0; j < sizes[i]; ++j)
+	    if (((unsigned char *) arr[i])[j] != (i & 0xff))
+	      {
+		printf ("block %d was overwritten at %zu\n", i, j);
+		result = 1;
+		break;
+	      }
+	  free_sized (arr[i], sizes[i]);
+	}
+    }
+
+  /* Aligned blocks.  */
+  for (size_t align = 16; align <= 4096; align *= 2)
+    for (size_t size = 1; size < 3000; size += 97)
+      {
+	p = memalign (align, size);
+	if (p == NULL || ((unsigned long) p & (align - 1)) != 0)
+	  {
+	    printf ("memalign (%zu, %zu) failed\n", align, size);
+	    return 1;
+	  }
+	memset (p, 0x55, size);
+	free_aligned_sized (p, align, size);
+      }
+
+  /* Blocks freed with a smaller size than they were allocated with are
+     fine too.  */
+  p = malloc (1000);
+  free_sized (p, 500);
+  p = calloc (10, 100);
+  free_sized (p, 1);
+
+  return result;
+}
+
+#define TEST_FUNCTION do_test ()
+#include "../test-skeleton.c"
@@ -0,0 +1,137 @@
+/* Test M_ARENA_CPU.
+   Copyright (C) 2013 Free Software Foundation, Inc.
+   This file is part of the GNU C Library.
+
+   The GNU C Library is free software; you can redistribute it and/or
+   modify it under the terms of the GNU Lesser General Public
+   License as published by the Free Software Foundation; either
+   version 2.1 of the License, or (at your option) any later version.
+
+   The GNU C Library is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+   Lesser General Public License for more details.
+
+   You should have received a copy of the GNU Lesser General Public
+   License along with the GNU C Library; if not, see
+   <http://www.gnu.org/licenses/>.  */
+
+#include <malloc.h>
+#include <pthread.h>
+#include <sched.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#define NTHREADS 8
+#define N 1000
+
+static long ncpus;
+
+/* Allocate and free blocks too large for the thread cache while moving
+   from CPU to CPU, so that the thread keeps switching arenas if the
+   CPUs are on different nodes.  Blocks allocated on one CPU are freed
+   on another.  */
+static void *
+tf (void *arg)
+{
+  unsigned long id = (unsigned long) arg;
+  unsigned char *blocks[N];
+
+  for (int i = 0; i < N; ++i)
+    {
+      if (i % 100 == 0)
+	{
+	  cpu_set_t set;
+	  CPU_ZERO (&set);
+	  CPU_SET ((id + i / 100) % ncpus, &set);
+	  /* Failure only means the thread stays where it is.  */
+	  pthread_setaffinity_np (pthread_self (), sizeof (set), &set);
+	}
+
+      size_t size = 2048 + (i % 32) * 64;
+      blocks[i] = malloc (size);
+      if (blocks[i] == NULL)
+	{
+	  puts ("malloc failed");
+	  return (void *) 1;
+	}
+      memset (blocks[i], id & 0xff, size);
+
+      if (i % 3 == 0)
+	{
+	  int j = i / 2;
+	  if (blocks[j] != NULL && blocks[j][0] != (id & 0xff))
+	    {
+	      printf ("block %d of thread %lu was overwritten\n", j, id);
+	      return (void *) 1;
+	    }
+	  free (blocks[j]);
+	  blocks[j] = NULL;
+	}
+    }
+
+  for (int i = 0; i < N; ++i)
+    free (blocks[i]);
+  return NULL;
+}
+
+static int
+do_test (void)
+{
+  pthread_t th[NTHREADS];
+  int result = 0;
+
+  ncpus = sysconf (_SC_NPROCESSORS_ONLN);
+  if (ncpus < 1)
+    ncpus = 1;
+
+  if (mallopt (M_ARENA_CPU, 2) != 0)
+    {
+      puts ("mallopt (M_ARENA_CPU, 2) succeeded");
+      result = 1;
+    }
+  if (mallopt (M_ARENA_CPU, 1) == 0)
+    {
+      puts ("mallopt (M_ARENA_CPU, 1) failed");
+      return 1;
+    }
+
+  for (unsigned long i = 0; i < NTHREADS; ++i)
+    if (pthread_create (&th[i], NULL, tf, (void *) i) != 0)
+      {
+	puts ("pthread_create failed");
+	return 1;
+      }
+
+  for (int i = 0; i < NTHREADS; ++i)
+    {
+      void *res;
+      if (pthread_join (th[i], &res) != 0)
+	{
+	  puts ("pthread_join failed");
+	  return 1;
+	}
+      if (res != NULL)
+	result = 1;
+    }
+
+  /* Turning the mode off again must keep the arenas usable.  */
+  if (mallopt (M_ARENA_CPU, 0) == 0)
+    {
+      puts ("mallopt (M_ARENA_CPU, 0) failed");
+      result = 1;
+    }
+  if (pthread_create (&th[0], NULL, tf, (void *) 0) != 0
+      || pthread_join (th[0], NULL) != 0)
+    {
+      puts ("pthread_create or pthread_join failed");
+      return 1;
+    }
+
+  return result;
+}
+
+#define TEST_FUNCTION do_test ()
+#include "../test-skeleton.c"
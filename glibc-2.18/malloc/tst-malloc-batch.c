@@ -0,0 +1,134 @@
+/* Test malloc_batch and free_batch.
+   Copyright (C) 2013 Free Software Foundation, Inc.
+   This file is part of the GNU C Library.
+
+   The GNU C Library is free software; you can redistribute it and/or
+   modify it under the terms of the GNU Lesser General Public
+   License as published by the Free Software Foundation; either
+   version 2.1 of the License, or (at your option) any later version.
+
+   The GNU C Library is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+   Lesser General Public License for more details.
+
+   You should have received a copy of the GNU Lesser General Public
+   License along with the GNU C Library; if not, see
+   <http://www.gnu.org/licenses/>.  */
+
+#include <malloc.h>
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define N 400
+
+static void *thread_ptrs[N];
+
+/* Fill each block with its index and check that no other block wrote
+   over it.  */
+static int
+check_blocks (void **ptrs, size_t n, size_t size)
+{
+  for (size_t i = 0; i < n; ++i)
+    memset (ptrs[i], i & 0xff, size);
+  for (size_t i = 0; i < n; ++i)
+    for (size_t j = 0; j < size; ++j)
+      if (((unsigned char *) ptrs[i])[j] != (i & 0xff))
+	{
+	  printf ("block %zu of size %zu overlaps another\n", i, size);
+	  return 1;
+	}
+  return 0;
+}
+
+static void *
+tf (void *arg)
+{
+  size_t size = (size_t) arg;
+
+  if (malloc_batch (size, N, thread_ptrs) != N)
+    {
+      puts ("malloc_batch failed in thread");
+      return (void *) 1;
+    }
+  return NULL;
+}
+
+static int
+do_test (void)
+{
+  static const size_t sizes[] = { 0, 1, 8, 24, 100, 500, 1000, 5000,
+				  300000 };
+  void *ptrs[N];
+  pthread_t th;
+  void *res;
+  int result = 0;
+
+  if (malloc_batch (100, 0, ptrs) != 0)
+    {
+      puts ("malloc_batch with n == 0 allocated something");
+      result = 1;
+    }
+  free_batch (ptrs, 0);
+
+  for (size_t s = 0; s < sizeof (sizes) / sizeof (sizes[0]); ++s)
+    for (int round = 0; round < 3; ++round)
+      {
+	size_t n = sizes[s] > 100000 ? 10 : N;
+	size_t got = malloc_batch (sizes[s], n, ptrs);
+	if (got != n)
+	  {
+	    printf ("malloc_batch (%zu, %zu) returned %zu\n", sizes[s], n, got);
+	    return 1;
+	  }
+	if (check_blocks (ptrs, n, sizes[s]))
+	  result = 1;
+	/* Free half one by one and the rest as a batch.  */
+	for (size_t i = 0; i < n; i += 2)
+	  {
+	    free (ptrs[i]);
+	    ptrs[i] = NULL;
+	  }
+	free_batch (ptrs, n);
+      }
+
+  /* A batch from another thread's arena, mixed with blocks from this
+     thread and null pointers.  */
+  if (pthread_create (&th, NULL, tf, (void *) 200) != 0)
+    {
+      puts ("pthread_create failed");
+      return 1;
+    }
+  if (pthread_join (th, &res) != 0)
+    {
+      puts ("pthread_join failed");
+      return 1;
+    }
+  if (res != NULL)
+    return 1;
+  if (check_blocks (thread_ptrs, N, 200))
+    result = 1;
+  for (size_t i = 0; i < N; i += 3)
+    {
+      free (thread_ptrs[i]);
+      thread_ptrs[i] = i % 2 ? malloc (i) : NULL;
+    }
+  free_batch (thread_ptrs, N);
+
+  /* The freed blocks are used again.  */
+  if (malloc_batch (200, N, ptrs) != N)
+    {
+      puts ("malloc_batch failed after free_batch");
+      return 1;
+    }
+  if (check_blocks (ptrs, N, 200))
+    result = 1;
+  free_batch (ptrs, N);
+
+  return result;
+}
+
+#define TEST_FUNCTION do_test ()
+#include "../test-skeleton.c"
@@ -0,0 +1,173 @@
+/* Test malloc with heaps backed by transparent huge pages.
+   Copyright (C) 2013 Free Software Foundation, Inc.
+   This file is part of the GNU C Library.
+
+   The GNU C Library is free software; you can redistribute it and/or
+   modify it under the terms of the GNU Lesser General Public
+   License as published by the Free Software Foundation; either
+   version 2.1 of the License, or (at your option) any later version.
+
+   The GNU C Library is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+   Lesser General Public License for more details.
+
+   You should have received a copy of the GNU Lesser General Public
+   License along with the GNU C Library; if not, see
+   <http://www.gnu.org/licenses/>.  */
+
+#include <malloc.h>
+#include <pthread.h>
+#include <inttypes.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define N 4096
+
+/* Nonzero if the kernel backs memory advised with MADV_HUGEPAGE with
+   transparent huge pages.  */
+static int thp_enabled;
+
+static int
+check_thp_enabled (void)
+{
+  char buf[128];
+  FILE *fp = fopen ("/sys/kernel/mm/transparent_hugepage/enabled", "r");
+  int ret = 0;
+
+  if (fp == NULL)
+    return 0;
+  /* The selected mode is in brackets, e.g. "always [madvise] never".  */
+  if (fgets (buf, sizeof (buf), fp) != NULL)
+    ret = strstr (buf, "[never]") == NULL;
+  fclose (fp);
+  return ret;
+}
+
+/* Return the AnonHugePages size in kB of the mapping that contains P,
+   or -1 if it cannot be found.  */
+static long
+anon_huge_kb (void *p)
+{
+  char line[256];
+  FILE *fp = fopen ("/proc/self/smaps", "r");
+  int found = 0;
+  long kb = -1;
+
+  if (fp == NULL)
+    return -1;
+  while (fgets (line, sizeof (line), fp) != NULL)
+    {
+      uintptr_t start, end;
+
+      /* Mappings start with their address range, their fields with
+	 a name that is not followed by a dash.  */
+      if (sscanf (line, "%" SCNxPTR "-%" SCNxPTR, &start, &end) == 2)
+	{
+	  if (found)
+	    break;
+	  found = start <= (uintptr_t) p && (uintptr_t) p < end;
+	}
+      else if (found && sscanf (line, "AnonHugePages: %ld kB", &kb) == 1)
+	break;
+    }
+  fclose (fp);
+  return found ? kb : -1;
+}
+
+/* Grow and shrink a heap, checking that no block is damaged when the
+   heap is trimmed at huge page boundaries.  */
+static void *
+tf (void *arg)
+{
+  static __thread unsigned char *arr[N];
+  int i;
+
+  for (i = 0; i < N; ++i)
+    {
+      size_t size = 64 + (i % 97) * 64;
+      arr[i] = malloc (size);
+      if (arr[i] == NULL)
+	{
+	  puts ("malloc failed");
+	  return (void *) 1;
+	}
+      memset (arr[i], i & 0xff, size);
+    }
+
+  /* Free the upper half so that the top chunk can be trimmed.  */
+  for (i = N / 2; i < N; ++i)
+    free (arr[i]);
+  malloc_trim (0);
+
+  for (i = 0; i < N / 2; ++i)
+    {
+      size_t size = 64 + (i % 97) * 64;
+      if (arr[i][0] != (i & 0xff) || arr[i][size - 1] != (i & 0xff))
+	{
+	  printf ("block %d damaged\n", i);
+	  return (void *) 1;
+	}
+      free (arr[i]);
+    }
+
+  /* This one is mapped directly.  */
+  void *big = malloc (8 * 1024 * 1024);
+  if (big == NULL)
+    {
+      puts ("malloc failed");
+      return (void *) 1;
+    }
+  memset (big, 1, 8 * 1024 * 1024);
+
+  /* The block spans several huge pages, so at least one of them must
+     be backed by a huge page.  */
+  if (thp_enabled && anon_huge_kb (big) <= 0)
+    {
+      printf ("no huge pages in the mapping of %p\n", big);
+      free (big);
+      return (void *) 1;
+    }
+  free (big);
+
+  return NULL;
+}
+
+static int
+do_test (void)
+{
+  pthread_t th;
+  void *res;
+
+  if (mallopt (M_HUGEPAGE, 2) != 0)
+    {
+      puts ("mallopt (M_HUGEPAGE, 2) succeeded");
+      return 1;
+    }
+
+  /* MALLOC_HUGEPAGE_ is set in the environment, but huge pages may not
+     be available; the allocator must work either way, and must use
+     them if they are.  */
+  thp_enabled = check_thp_enabled ();
+  if (!thp_enabled)
+    puts ("transparent huge pages not enabled, not checking their use");
+  if (tf (NULL) != NULL)
+    return 1;
+
+  if (pthread_create (&th, NULL, tf, NULL) != 0)
+    {
+      puts ("pthread_create failed");
+      return 1;
+    }
+  if (pthread_join (th, &res) != 0)
+    {
+      puts ("pthread_join failed");
+      return 1;
+    }
+
+  return res != NULL;
+}
+
+#define TEST_FUNCTION do_test ()
+#include "../test-skeleton.c"
@@ -0,0 +1,90 @@
+/* Test the arena statistics reported by malloc_info.
+   Copyright (C) 2013 Free Software Foundation, Inc.
+   This file is part of the GNU C Library.
+
+   The GNU C Library is free software; you can redistribute it and/or
+   modify it under the terms of the GNU Lesser General Public
+   License as published by the Free Software Foundation; either
+   version 2.1 of the License, or (at your option) any later version.
+
+   The GNU C Library is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+   Lesser General Public License for more details.
+
+   You should have received a copy of the GNU Lesser General Public
+   License along with the GNU C Library; if not, see
+   <http://www.gnu.org/licenses/>.  */
+
+#include <malloc.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define N 64
+
+static void *arr[N];
+
+static int
+do_test (void)
+{
+  char *buf = NULL;
+  size_t len = 0;
+  int result = 0;
+
+  /* Free more small chunks than the thread cache holds, so that the
+     rest of them is served from a fastbin when allocated again.  */
+  for (int round = 0; round < 2; ++round)
+    {
+      for (int i = 0; i < N; ++i)
+	if ((arr[i] = malloc (24)) == NULL)
+	  {
+	    puts ("malloc failed");
+	    return 1;
+	  }
+      for (int i = 0; i < N; ++i)
+	free (arr[i]);
+    }
+
+  /* A large request goes to mmap, and growing the heap extends top.  */
+  void *big = malloc (16 * 1024 * 1024);
+  if (big == NULL)
+    {
+      puts ("malloc failed");
+      return 1;
+    }
+  free (big);
+
+  FILE *fp = open_memstream (&buf, &len);
+  if (fp == NULL)
+    {
+      puts ("open_memstream failed");
+      return 1;
+    }
+  if (malloc_info (0, fp) != 0)
+    {
+      puts ("malloc_info failed");
+      return 1;
+    }
+  fclose (fp);
+
+  fputs (buf, stdout);
+
+  static const char *const expected[] =
+    {
+      "<stats>", "<locks acquired=\"", "<fastbin size=\"", "<bins misses=\"",
+      "<top extend=\"", "<mmap count=\"", "</stats>\n</malloc>"
+    };
+  for (size_t i = 0; i < sizeof (expected) / sizeof (expected[0]); ++i)
+    if (strstr (buf, expected[i]) == NULL)
+      {
+	printf ("\"%s\" missing from malloc_info output\n", expected[i]);
+	result = 1;
+      }
+
+  free (buf);
+  return result;
+}
+
+#define TEST_FUNCTION do_test ()
+#include "../test-skeleton.c"
@@ -0,0 +1,142 @@
+/* Test growing large blocks with realloc.
+   Copyright (C) 2013 Free Software Foundation, Inc.
+   This file is part of the GNU C Library.
+
+   The GNU C Library is free software; you can redistribute it and/or
+   modify it under the terms of the GNU Lesser General Public
+   License as published by the Free Software Foundation; either
+   version 2.1 of the License, or (at your option) any later version.
+
+   The GNU C Library is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+   Lesser General Public License for more details.
+
+   You should have received a copy of the GNU Lesser General Public
+   License along with the GNU C Library; if not, see
+   <http://www.gnu.org/licenses/>.  */
+
+#include <malloc.h>
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define MIN_SIZE (16 * 1024)
+#define MAX_SIZE (8 * 1024 * 1024)
+
+static int
+check (const unsigned char *p, size_t size)
+{
+  for (size_t i = 0; i < size; i += 511)
+    if (p[i] != (unsigned char) (i * 7))
+      {
+	printf ("byte %zu changed\n", i);
+	return 1;
+      }
+  return 0;
+}
+
+static void
+fill (unsigned char *p, size_t from, size_t to)
+{
+  for (size_t i = from; i < to; ++i)
+    p[i] = i * 7;
+}
+
+/* Grow a block by doubling, with a small allocation after each step
+   so that the block cannot simply be extended into the top chunk.
+   Past the mremap threshold the block moves to its own mapping and is
+   grown with mremap from then on.  Then shrink it again.  */
+static void *
+grow (void *arg)
+{
+  void *small[32];
+  unsigned char *p = NULL;
+  size_t size, old = 0;
+  int n = 0;
+
+  for (size = MIN_SIZE; size <= MAX_SIZE; size *= 2)
+    {
+      unsigned char *q = realloc (p, size);
+      if (q == NULL)
+	{
+	  puts ("realloc failed");
+	  free (p);
+	  return (void *) 1;
+	}
+      p = q;
+      if (check (p, old))
+	return (void *) 1;
+      fill (p, old, size);
+      old = size;
+      small[n++] = malloc (100);
+    }
+
+  for (size = MAX_SIZE / 4; size >= MIN_SIZE; size /= 4)
+    {
+      unsigned char *q = realloc (p, size);
+      if (q == NULL)
+	{
+	  puts ("shrinking realloc failed");
+	  free (p);
+	  return (void *) 1;
+	}
+      p = q;
+      if (check (p, size))
+	return (void *) 1;
+    }
+
+  free (p);
+  while (n > 0)
+    free (small[--n]);
+  return NULL;
+}
+
+static int
+do_test (void)
+{
+  pthread_t th;
+  void *res;
+  int result = 0;
+
+  if (mallopt (M_MREMAP_THRESHOLD, -1) != 0)
+    {
+      puts ("mallopt (M_MREMAP_THRESHOLD, -1) succeeded");
+      result = 1;
+    }
+
+  /* With and without moving blocks to their own mappings, in the main
+     arena and in the arena of a new thread.  */
+  int thresholds[] = { 256 * 1024, 0 };
+  for (int i = 0; i < 2; ++i)
+    {
+      if (mallopt (M_MREMAP_THRESHOLD, thresholds[i]) == 0)
+	{
+	  /* Fails only if the system has no mremap.  */
+	  printf ("mallopt (M_MREMAP_THRESHOLD, %d) failed\n", thresholds[i]);
+	  continue;
+	}
+
+      if (grow (NULL) != NULL)
+	result = 1;
+
+      if (pthread_create (&th, NULL, grow, NULL) != 0)
+	{
+	  puts ("pthread_create failed");
+	  return 1;
+	}
+      if (pthread_join (th, &res) != 0)
+	{
+	  puts ("pthread_join failed");
+	  return 1;
+	}
+      if (res != NULL)
+	result = 1;
+    }
+
+  return result;
+}
+
+#define TEST_FUNCTION do_test ()
+#include "../test-skeleton.c"
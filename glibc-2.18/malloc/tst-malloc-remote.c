@@ -0,0 +1,100 @@
+/* Test freeing chunks from a thread not attached to their arena.
+   Copyright (C) 2013 Free Software Foundation, Inc.
+   This file is part of the GNU C Library.
+
+   The GNU C Library is free software; you can redistribute it and/or
+   modify it under the terms of the GNU Lesser General Public
+   License as published by the Free Software Foundation; either
+   version 2.1 of the License, or (at your option) any later version.
+
+   The GNU C Library is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+   Lesser General Public License for more details.
+
+   You should have received a copy of the GNU Lesser General Public
+   License along with the GNU C Library; if not, see
+   <http://www.gnu.org/licenses/>.  */
+
+#include <malloc.h>
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define N 2000
+
+static void *arr[N];
+
+/* Allocate blocks too large for the fastbins, so that freeing them
+   needs the arena.  */
+static void *
+producer (void *arg)
+{
+  for (int i = 0; i < N; ++i)
+    {
+      size_t size = 2048 + (i % 64) * 16;
+      arr[i] = malloc (size);
+      if (arr[i] == NULL)
+	{
+	  puts ("malloc failed");
+	  return (void *) 1;
+	}
+      memset (arr[i], 0x5a, size);
+    }
+  return NULL;
+}
+
+static void *
+consumer (void *arg)
+{
+  for (int i = 0; i < N; ++i)
+    free (arr[i]);
+  return NULL;
+}
+
+static int
+run (void *(*fn) (void *))
+{
+  pthread_t th;
+  void *res;
+
+  if (pthread_create (&th, NULL, fn, NULL) != 0)
+    {
+      puts ("pthread_create failed");
+      return 1;
+    }
+  if (pthread_join (th, &res) != 0)
+    {
+      puts ("pthread_join failed");
+      return 1;
+    }
+  return res != NULL;
+}
+
+static int
+do_test (void)
+{
+  int round;
+
+  struct mallinfo before = mallinfo ();
+
+  for (round = 0; round < 10; ++round)
+    if (run (producer) != 0 || run (consumer) != 0)
+      return 1;
+
+  /* mallinfo frees the chunks still queued on the arenas.  */
+  struct mallinfo after = mallinfo ();
+  printf ("in use before: %d, after: %d\n", before.uordblks, after.uordblks);
+  if (after.uordblks > before.uordblks + 64 * 1024)
+    {
+      puts ("remotely freed chunks were not returned to their arena");
+      return 1;
+    }
+
+  malloc_trim (0);
+  return 0;
+}
+
+#define TEST_FUNCTION do_test ()
+#include "../test-skeleton.c"
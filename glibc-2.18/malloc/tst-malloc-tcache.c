@@ -0,0 +1,140 @@
+/* Test the per-thread cache of small chunks.
+   Copyright (C) 2013 Free Software Foundation, Inc.
+   This file is part of the GNU C Library.
+
+   The GNU C Library is free software; you can redistribute it and/or
+   modify it under the terms of the GNU Lesser General Public
+   License as published by the Free Software Foundation; either
+   version 2.1 of the License, or (at your option) any later version.
+
+   The GNU C Library is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+   Lesser General Public License for more details.
+
+   You should have received a copy of the GNU Lesser General Public
+   License along with the GNU C Library; if not, see
+   <http://www.gnu.org/licenses/>.  */
+
+#include <malloc.h>
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+/* Number of chunks of each size a thread keeps live at once.  This is
+   larger than the default cache depth so that every bin fills up.  */
+#define NCHUNKS 16
+#define MAXSIZE 1024
+#define NTHREADS 50
+
+static int errors;
+
+static void *
+tf (void *arg)
+{
+  void *arr[NCHUNKS];
+  size_t size;
+  int round, i;
+
+  for (round = 0; round < 4; ++round)
+    for (size = 1; size <= MAXSIZE; size += 8)
+      {
+	for (i = 0; i < NCHUNKS; ++i)
+	  {
+	    arr[i] = malloc (size);
+	    if (arr[i] == NULL)
+	      {
+		puts ("malloc failed");
+		return (void *) 1;
+	      }
+	    memset (arr[i], i, size);
+	  }
+	for (i = 0; i < NCHUNKS; ++i)
+	  {
+	    unsigned char *p = arr[i];
+	    if (p[0] != i || p[size - 1] != i)
+	      {
+		printf ("chunk of size %zu clobbered\n", size);
+		return (void *) 1;
+	      }
+	    free (arr[i]);
+	  }
+      }
+
+  return NULL;
+}
+
+static int
+run_threads (void)
+{
+  int i;
+
+  for (i = 0; i < NTHREADS; ++i)
+    {
+      pthread_t th;
+      void *res;
+
+      if (pthread_create (&th, NULL, tf, NULL) != 0)
+	{
+	  puts ("pthread_create failed");
+	  return 1;
+	}
+      if (pthread_join (th, &res) != 0)
+	{
+	  puts ("pthread_join failed");
+	  return 1;
+	}
+      if (res != NULL)
+	return 1;
+    }
+
+  return 0;
+}
+
+static int
+do_test (void)
+{
+  if (mallopt (M_TCACHE_COUNT, 256) != 0)
+    {
+      puts ("mallopt (M_TCACHE_COUNT, 256) succeeded");
+      ++errors;
+    }
+  if (mallopt (M_TCACHE_MAX, 1 << 20) != 0)
+    {
+      puts ("mallopt (M_TCACHE_MAX, 1 << 20) succeeded");
+      ++errors;
+    }
+  if (mallopt (M_TCACHE_COUNT, 7) != 1 || mallopt (M_TCACHE_MAX, 1024) != 1)
+    {
+      puts ("mallopt failed for a valid thread cache setting");
+      ++errors;
+    }
+
+  /* Warm up, so the arena of the worker threads exists.  */
+  if (run_threads () != 0)
+    return 1;
+  struct mallinfo before = mallinfo ();
+
+  /* The chunks cached by each exiting thread must be returned to the
+     arenas; otherwise the in-use total grows with every thread.  */
+  if (run_threads () != 0)
+    return 1;
+  struct mallinfo after = mallinfo ();
+
+  printf ("in use before: %d, after: %d\n", before.uordblks, after.uordblks);
+  if (after.uordblks > before.uordblks + 64 * 1024)
+    {
+      puts ("thread caches were not drained at thread exit");
+      ++errors;
+    }
+
+  /* Disabling the cache must still work.  */
+  if (mallopt (M_TCACHE_COUNT, 0) != 1 || run_threads () != 0)
+    ++errors;
+
+  return errors != 0;
+}
+
+#define TEST_FUNCTION do_test ()
+#include "../test-skeleton.c"
@@ -0,0 +1,100 @@
+/* Test deferred trimming with M_TRIM_INTERVAL.
+   Copyright (C) 2013 Free Software Foundation, Inc.
+   This file is part of the GNU C Library.
+
+   The GNU C Library is free software; you can redistribute it and/or
+   modify it under the terms of the GNU Lesser General Public
+   License as published by the Free Software Foundation; either
+   version 2.1 of the License, or (at your option) any later version.
+
+   The GNU C Library is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+   Lesser General Public License for more details.
+
+   You should have received a copy of the GNU Lesser General Public
+   License along with the GNU C Library; if not, see
+   <http://www.gnu.org/licenses/>.  */
+
+#include <malloc.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define N 400
+#define SIZE (64 * 1024)
+
+static unsigned char *arr[N];
+
+static int
+check (int i, int c)
+{
+  if (arr[i][0] != c || arr[i][SIZE / 2] != c || arr[i][SIZE - 1] != c)
+    {
+      printf ("block %d damaged\n", i);
+      return 1;
+    }
+  return 0;
+}
+
+static int
+do_test (void)
+{
+  if (mallopt (M_TRIM_INTERVAL, -1) != 0)
+    {
+      puts ("mallopt (M_TRIM_INTERVAL, -1) succeeded");
+      return 1;
+    }
+  if (mallopt (M_TRIM_INTERVAL, 4) != 1)
+    {
+      puts ("mallopt (M_TRIM_INTERVAL, 4) failed");
+      return 1;
+    }
+
+  for (int round = 0; round < 3; ++round)
+    {
+      for (int i = 0; i < N; ++i)
+	{
+	  arr[i] = malloc (SIZE);
+	  if (arr[i] == NULL)
+	    {
+	      puts ("malloc failed");
+	      return 1;
+	    }
+	  memset (arr[i], i & 0xff, SIZE);
+	}
+
+      /* Free every other block.  The deferred trims release the pages
+	 of the holes in the middle of the heap, which must not touch
+	 the blocks still in use.  */
+      for (int i = 0; i < N; i += 2)
+	free (arr[i]);
+      for (int i = 1; i < N; i += 2)
+	if (check (i, i & 0xff))
+	  return 1;
+
+      /* Reuse the released holes.  */
+      for (int i = 0; i < N; i += 2)
+	{
+	  arr[i] = malloc (SIZE);
+	  if (arr[i] == NULL)
+	    {
+	      puts ("malloc failed");
+	      return 1;
+	    }
+	  memset (arr[i], 0xa5, SIZE);
+	}
+      for (int i = 0; i < N; ++i)
+	if (check (i, i % 2 == 0 ? 0xa5 : i & 0xff))
+	  return 1;
+
+      for (int i = 0; i < N; ++i)
+	free (arr[i]);
+    }
+
+  malloc_trim (0);
+  return 0;
+}
+
+#define TEST_FUNCTION do_test ()
+#include "../test-skeleton.c"
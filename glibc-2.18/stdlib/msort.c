@@ -95,6 +95,28 @@ msort_with_tmp (const struct msort_param *p, void *b, size_t n)
 	  tmp += sizeof (uint64_t);
 	}
       break;
+    case 5:
+      while (n1 > 0 && n2 > 0)
+	{
+	  uint64_t *bq;
+
+	  if ((*cmp) (b1, b2, arg) <= 0)
+	    {
+	      bq = (uint64_t *) b1;
+	      b1 += 2 * sizeof (uint64_t);
+	      --n1;
+	    }
+	  else
+	    {
+	      bq = (uint64_t *) b2;
+	      b2 += 2 * sizeof (uint64_t);
+	      --n2;
+	    }
+	  ((uint64_t *) tmp)[0] = bq[0];
+	  ((uint64_t *) tmp)[1] = bq[1];
+	  tmp += 2 * sizeof (uint64_t);
+	}
+      break;
     case 2:
       while (n1 > 0 && n2 > 0)
 	{
@@ -289,6 +311,11 @@ qsort_r (void *b, size_t n, size_t s, __compar_d_fn_t cmp, void *arg)
 	  else if (s == sizeof (uint64_t)
 		   && ((char *) b - (char *) 0) % __alignof__ (uint64_t) == 0)
 	    p.var = 1;
+	  else if (s == 2 * sizeof (uint64_t)
+		   && ((char *) b - (char *) 0) % __alignof__ (uint64_t) == 0)
+	    /* Two-word keys such as a pointer and a length, or a pair
+	       of doubles, are common enough to avoid the copy loop.  */
+	    p.var = 5;
 	  else if ((s & (sizeof (unsigned long) - 1)) == 0
 		   && ((char *) b - (char *) 0)
 		      % __alignof__ (unsigned long) == 0)
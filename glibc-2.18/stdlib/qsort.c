@@ -18,232 +18,560 @@
 
 /* If you consider tuning this algorithm, you should consult first:
    Engineering a sort function; Jon Bentley and M. Douglas McIlroy;
-   Software - Practice and Experience; Vol. 23 (11), 1249-1265, 1993.  */
+   Software - Practice and Experience; Vol. 23 (11), 1249-1265, 1993.
 
-#include <alloca.h>
-#include <limits.h>
+   The partitioning scheme follows Orson Peters' pattern-defeating
+   quicksort (arXiv:2106.05123), with the block partitioning from
+   BlockQuicksort: How Branch Mispredictions don't affect Quicksort;
+   Stefan Edelkamp and Armin Weiss; ESA 2016.  */
+
+#include <stdbool.h>
+#include <stdint.h>
 #include <stdlib.h>
-#include <string.h>
-
-/* Byte-wise swap two items of size SIZE. */
-#define SWAP(a, b, size)						      \
-  do									      \
-    {									      \
-      size_t __size = (size);						      \
-      char *__a = (a), *__b = (b);					      \
-      do								      \
-	{								      \
-	  char __tmp = *__a;						      \
-	  *__a++ = *__b;						      \
-	  *__b++ = __tmp;						      \
-	} while (--__size > 0);						      \
-    } while (0)
-
-/* Discontinue quicksort algorithm when partition gets below this size.
-   This particular magic number was chosen to work best on a Sun 4/260. */
-#define MAX_THRESH 4
-
-/* Stack node declarations used to store unfulfilled partition obligations. */
-typedef struct
+
+/* How elements are exchanged.  Chosen once per call from the size of
+   the elements and the alignment of the array, so that the common
+   scalar sizes are moved in one or two loads and stores instead of
+   byte by byte.  */
+enum swap_type
   {
-    char *lo;
-    char *hi;
-  } stack_node;
-
-/* The next 4 #defines implement a very fast in-line stack abstraction. */
-/* The stack needs log (total_elements) entries (we could even subtract
-   log(MAX_THRESH)).  Since total_elements has type size_t, we get as
-   upper bound for log (total_elements):
-   bits per byte (CHAR_BIT) * sizeof(size_t).  */
-#define STACK_SIZE	(CHAR_BIT * sizeof(size_t))
-#define PUSH(low, high)	((void) ((top->lo = (low)), (top->hi = (high)), ++top))
-#define	POP(low, high)	((void) (--top, (low = top->lo), (high = top->hi)))
-#define	STACK_NOT_EMPTY	(stack < top)
-
-
-/* Order size using quicksort.  This implementation incorporates
-   four optimizations discussed in Sedgewick:
-
-   1. Non-recursive, using an explicit stack of pointer that store the
-      next array partition to sort.  To save time, this maximum amount
-      of space required to store an array of SIZE_MAX is allocated on the
-      stack.  Assuming a 32-bit (64 bit) integer for size_t, this needs
-      only 32 * sizeof(stack_node) == 256 bytes (for 64 bit: 1024 bytes).
-      Pretty cheap, actually.
-
-   2. Chose the pivot element using a median-of-three decision tree.
-      This reduces the probability of selecting a bad pivot value and
-      eliminates certain extraneous comparisons.
-
-   3. Only quicksorts TOTAL_ELEMS / MAX_THRESH partitions, leaving
-      insertion sort to order the MAX_THRESH items within each partition.
-      This is a big win, since insertion sort is faster for small, mostly
-      sorted array segments.
-
-   4. The larger of the two sub-partitions is always pushed onto the
-      stack first, with the algorithm then concentrating on the
-      smaller partition.  This *guarantees* no more than log (total_elems)
-      stack size is needed (actually O(1) in this case)!  */
+    SWAP_WORDS_32,
+    SWAP_WORDS_64,
+    SWAP_WORDS_128,
+    SWAP_LONGS,
+    SWAP_BYTES
+  };
+
+struct sort_param
+{
+  size_t s;
+  enum swap_type var;
+  __compar_d_fn_t cmp;
+  void *arg;
+};
+
+static inline void
+do_swap (const struct sort_param *p, char *a, char *b)
+{
+  switch (p->var)
+    {
+    case SWAP_WORDS_32:
+      {
+	uint32_t t = *(uint32_t *) a;
+	*(uint32_t *) a = *(uint32_t *) b;
+	*(uint32_t *) b = t;
+      }
+      break;
+    case SWAP_WORDS_64:
+      {
+	uint64_t t = *(uint64_t *) a;
+	*(uint64_t *) a = *(uint64_t *) b;
+	*(uint64_t *) b = t;
+      }
+      break;
+    case SWAP_WORDS_128:
+      {
+	uint64_t t0 = ((uint64_t *) a)[0];
+	uint64_t t1 = ((uint64_t *) a)[1];
+	((uint64_t *) a)[0] = ((uint64_t *) b)[0];
+	((uint64_t *) a)[1] = ((uint64_t *) b)[1];
+	((uint64_t *) b)[0] = t0;
+	((uint64_t *) b)[1] = t1;
+      }
+      break;
+    case SWAP_LONGS:
+      {
+	unsigned long *al = (unsigned long *) a;
+	unsigned long *bl = (unsigned long *) b;
+	unsigned long *end = (unsigned long *) (a + p->s);
+	do
+	  {
+	    unsigned long t = *al;
+	    *al++ = *bl;
+	    *bl++ = t;
+	  }
+	while (al < end);
+      }
+      break;
+    default:
+      {
+	size_t n = p->s;
+	do
+	  {
+	    char t = *a;
+	    *a++ = *b;
+	    *b++ = t;
+	  }
+	while (--n > 0);
+      }
+      break;
+    }
+}
 
-void
-_quicksort (void *const pbase, size_t total_elems, size_t size,
-	    __compar_d_fn_t cmp, void *arg)
+/* Return true if the element at A sorts before the one at B.  */
+static inline bool
+less (const struct sort_param *p, const char *a, const char *b)
 {
-  char *base_ptr = (char *) pbase;
+  return (*p->cmp) ((const void *) a, (const void *) b, p->arg) < 0;
+}
+
+/* Partitions below this many elements are sorted with insertion sort.  */
+#define INSERTION_SORT_THRESH 24
 
-  const size_t max_thresh = MAX_THRESH * size;
+/* Partitions above this many elements use Tukey's ninther for the
+   pivot instead of the median of three.  */
+#define NINTHER_THRESH 128
 
-  if (total_elems == 0)
-    /* Avoid lossage with unsigned arithmetic below.  */
+/* partial_insertion_sort gives up after moving elements this many
+   places in total.  */
+#define PARTIAL_INSERTION_SORT_LIMIT 8
+
+/* Number of elements the block partition classifies before swapping.
+   The offsets within a block are kept in unsigned chars.  */
+#define BLOCK_SIZE 64
+
+/* Sort [BEGIN, END) with insertion sort.  */
+static void
+insertion_sort (const struct sort_param *p, char *begin, char *end)
+{
+  const size_t s = p->s;
+
+  if (begin == end)
     return;
 
-  if (total_elems > MAX_THRESH)
+  for (char *cur = begin + s; cur < end; cur += s)
+    for (char *sift = cur; sift > begin && less (p, sift, sift - s);
+	 sift -= s)
+      do_swap (p, sift, sift - s);
+}
+
+/* Sort [BEGIN, END) with insertion sort, assuming that the element
+   before BEGIN is not greater than any element in the range, so the
+   inner loop needs no bounds check.  */
+static void
+unguarded_insertion_sort (const struct sort_param *p, char *begin,
+			  char *end)
+{
+  const size_t s = p->s;
+
+  if (begin == end)
+    return;
+
+  for (char *cur = begin + s; cur < end; cur += s)
+    for (char *sift = cur; less (p, sift, sift - s); sift -= s)
+      do_swap (p, sift, sift - s);
+}
+
+/* Try to sort [BEGIN, END) with insertion sort, giving up once more
+   than PARTIAL_INSERTION_SORT_LIMIT moves were needed.  Return true
+   if the range is now sorted.  */
+static bool
+partial_insertion_sort (const struct sort_param *p, char *begin, char *end)
+{
+  const size_t s = p->s;
+  size_t limit = 0;
+
+  if (begin == end)
+    return true;
+
+  for (char *cur = begin + s; cur < end; cur += s)
+    {
+      if (limit > PARTIAL_INSERTION_SORT_LIMIT)
+	return false;
+
+      char *sift = cur;
+      for (; sift > begin && less (p, sift, sift - s); sift -= s)
+	do_swap (p, sift, sift - s);
+      limit += (cur - sift) / s;
+    }
+
+  return true;
+}
+
+/* Order the elements at A, B and C.  */
+static inline void
+sort3 (const struct sort_param *p, char *a, char *b, char *c)
+{
+  if (less (p, b, a))
+    do_swap (p, a, b);
+  if (less (p, c, b))
     {
-      char *lo = base_ptr;
-      char *hi = &lo[size * (total_elems - 1)];
-      stack_node stack[STACK_SIZE];
-      stack_node *top = stack;
-
-      PUSH (NULL, NULL);
-
-      while (STACK_NOT_EMPTY)
-        {
-          char *left_ptr;
-          char *right_ptr;
-
-	  /* Select median value from among LO, MID, and HI. Rearrange
-	     LO and HI so the three values are sorted. This lowers the
-	     probability of picking a pathological pivot value and
-	     skips a comparison for both the LEFT_PTR and RIGHT_PTR in
-	     the while loops. */
-
-	  char *mid = lo + size * ((hi - lo) / size >> 1);
-
-	  if ((*cmp) ((void *) mid, (void *) lo, arg) < 0)
-	    SWAP (mid, lo, size);
-	  if ((*cmp) ((void *) hi, (void *) mid, arg) < 0)
-	    SWAP (mid, hi, size);
+      do_swap (p, b, c);
+      if (less (p, b, a))
+	do_swap (p, a, b);
+    }
+}
+
+/* Partition [BEGIN, END) around the pivot at BEGIN, putting elements
+   equal to the pivot in the right part.  Store in *ALREADY_PARTITIONED
+   whether no element had to be moved, and return the final position
+   of the pivot.
+
+   The median-of-three pivot selection guarantees an element not less
+   than the pivot after it, so the first scan needs no bounds check.
+   After the first exchange the scanned part is classified a block at a
+   time: the offsets of the misplaced elements are recorded without
+   branching on the result of the comparison, and are swapped in pairs
+   afterwards.  */
+static char *
+partition_right (const struct sort_param *p, char *begin, char *end,
+		 bool *already_partitioned)
+{
+  const size_t s = p->s;
+  char *const pivot = begin;
+  char *first = begin;
+  char *last = end;
+
+  /* Find the first element not less than the pivot.  */
+  do
+    first += s;
+  while (less (p, first, pivot));
+
+  /* Find the last element less than the pivot.  Guard the search if
+     nothing before FIRST was less than the pivot.  */
+  if (first - s == begin)
+    while (first < last && ! less (p, last -= s, pivot))
+      ;
+  else
+    while (! less (p, last -= s, pivot))
+      ;
+
+  *already_partitioned = first >= last;
+  if (! *already_partitioned)
+    {
+      unsigned char offsets_l[BLOCK_SIZE];
+      unsigned char offsets_r[BLOCK_SIZE];
+      size_t num_l = 0, num_r = 0, start_l = 0, start_r = 0;
+      char *offsets_l_base, *offsets_r_base;
+
+      do_swap (p, first, last);
+      first += s;
+
+      /* [FIRST, LAST) are the elements still to be classified.  */
+      offsets_l_base = first;
+      offsets_r_base = last;
+      while (first < last)
+	{
+	  size_t num_unknown = (last - first) / s;
+	  size_t left_split, right_split, num, i;
+
+	  /* Only refill a block once all its offsets were used up.  */
+	  left_split = (num_l == 0
+			? (num_r == 0 ? num_unknown / 2 : num_unknown) : 0);
+	  right_split = num_r == 0 ? num_unknown - left_split : 0;
+	  if (left_split > BLOCK_SIZE)
+	    left_split = BLOCK_SIZE;
+	  if (right_split > BLOCK_SIZE)
+	    right_split = BLOCK_SIZE;
+
+	  for (i = 0; i < left_split; i++)
+	    {
+	      offsets_l[num_l] = i;
+	      num_l += ! less (p, first, pivot);
+	      first += s;
+	    }
+	  for (i = 0; i < right_split; )
+	    {
+	      offsets_r[num_r] = ++i;
+	      last -= s;
+	      num_r += less (p, last, pivot);
+	    }
+
+	  /* Swap the misplaced elements in pairs.  */
+	  num = num_l < num_r ? num_l : num_r;
+	  for (i = 0; i < num; i++)
+	    do_swap (p, offsets_l_base + offsets_l[start_l + i] * s,
+		     offsets_r_base - offsets_r[start_r + i] * s);
+	  num_l -= num;
+	  num_r -= num;
+	  start_l += num;
+	  start_r += num;
+
+	  if (num_l == 0)
+	    {
+	      start_l = 0;
+	      offsets_l_base = first;
+	    }
+	  if (num_r == 0)
+	    {
+	      start_r = 0;
+	      offsets_r_base = last;
+	    }
+	}
+
+      /* All of [FIRST, LAST) is classified, but one block may still
+	 have misplaced elements.  Move them to the boundary.  */
+      if (num_l > 0)
+	{
+	  while (num_l-- > 0)
+	    {
+	      last -= s;
+	      do_swap (p, offsets_l_base + offsets_l[start_l + num_l] * s,
+		       last);
+	    }
+	  first = last;
+	}
+      if (num_r > 0)
+	{
+	  while (num_r-- > 0)
+	    {
+	      do_swap (p, offsets_r_base - offsets_r[start_r + num_r] * s,
+		       first);
+	      first += s;
+	    }
+	  last = first;
+	}
+    }
+
+  /* Put the pivot in its place.  */
+  char *pivot_pos = first - s;
+  if (pivot_pos != begin)
+    do_swap (p, begin, pivot_pos);
+  return pivot_pos;
+}
+
+/* Partition [BEGIN, END) around the pivot at BEGIN, putting elements
+   equal to the pivot in the left part, and return the final position
+   of the pivot.  This is used when the pivot equals the element before
+   BEGIN, in which case the whole left part equals the pivot and needs
+   no further sorting.  */
+static char *
+partition_left (const struct sort_param *p, char *begin, char *end)
+{
+  const size_t s = p->s;
+  char *const pivot = begin;
+  char *first = begin;
+  char *last = end;
+
+  do
+    last -= s;
+  while (less (p, pivot, last));
+
+  if (last + s == end)
+    while (first < last && ! less (p, pivot, first += s))
+      ;
+  else
+    while (! less (p, pivot, first += s))
+      ;
+
+  while (first < last)
+    {
+      do_swap (p, first, last);
+      do
+	last -= s;
+      while (less (p, pivot, last));
+      while (! less (p, pivot, first += s))
+	;
+    }
+
+  if (last != begin)
+    do_swap (p, begin, last);
+  return last;
+}
+
+static void
+sift_down (const struct sort_param *p, char *base, size_t k, size_t n)
+{
+  const size_t s = p->s;
+  size_t j;
+
+  while ((j = 2 * k + 1) < n)
+    {
+      if (j + 1 < n && less (p, base + j * s, base + (j + 1) * s))
+	++j;
+      if (! less (p, base + k * s, base + j * s))
+	break;
+      do_swap (p, base + k * s, base + j * s);
+      k = j;
+    }
+}
+
+/* Sort [BEGIN, END) with heapsort.  Used when too many partitions
+   came out badly unbalanced, to keep the worst case at O(n log n).  */
+static void
+heap_sort (const struct sort_param *p, char *begin, char *end)
+{
+  const size_t s = p->s;
+  size_t n = (end - begin) / s;
+
+  for (size_t k = n / 2; k-- > 0; )
+    sift_down (p, begin, k, n);
+  while (n > 1)
+    {
+      --n;
+      do_swap (p, begin, begin + n * s);
+      sift_down (p, begin, 0, n);
+    }
+}
+
+/* Shuffle a few elements of the partition [BEGIN, BEGIN + N * S) that
+   came out badly unbalanced, so that the next pivots are drawn from
+   different positions and input patterns cannot keep defeating the
+   pivot selection.  */
+static void
+break_patterns (const struct sort_param *p, char *begin, size_t n)
+{
+  const size_t s = p->s;
+  char *end = begin + n * s;
+  size_t q = n / 4;
+
+  if (n < INSERTION_SORT_THRESH)
+    return;
+
+  do_swap (p, begin, begin + q * s);
+  do_swap (p, end - s, end - q * s);
+  if (n > NINTHER_THRESH)
+    {
+      do_swap (p, begin + s, begin + (q + 1) * s);
+      do_swap (p, begin + 2 * s, begin + (q + 2) * s);
+      do_swap (p, end - 2 * s, end - (q + 1) * s);
+      do_swap (p, end - 3 * s, end - (q + 2) * s);
+    }
+}
+
+/* Sort [BEGIN, END).  LEFTMOST is false if the element before BEGIN is
+   part of the array and not greater than any element in the range.
+   BAD_ALLOWED is the number of unbalanced partitions still tolerated
+   before switching to heapsort.  Recursion is only on the smaller part
+   of each partition, so the depth is at most log2 of the length.  */
+static void
+pdqsort_loop (const struct sort_param *p, char *begin, char *end,
+	      int bad_allowed, bool leftmost)
+{
+  const size_t s = p->s;
+
+  while (1)
+    {
+      size_t n = (end - begin) / s;
+
+      if (n < INSERTION_SORT_THRESH)
+	{
+	  if (leftmost)
+	    insertion_sort (p, begin, end);
 	  else
-	    goto jump_over;
-	  if ((*cmp) ((void *) mid, (void *) lo, arg) < 0)
-	    SWAP (mid, lo, size);
-	jump_over:;
-
-	  left_ptr  = lo + size;
-	  right_ptr = hi - size;
-
-	  /* Here's the famous ``collapse the walls'' section of quicksort.
-	     Gotta like those tight inner loops!  They are the main reason
-	     that this algorithm runs much faster than others. */
-	  do
+	    unguarded_insertion_sort (p, begin, end);
+	  return;
+	}
+
+      /* Move the pivot to BEGIN.  */
+      size_t half = n / 2;
+      if (n > NINTHER_THRESH)
+	{
+	  sort3 (p, begin, begin + half * s, end - s);
+	  sort3 (p, begin + s, begin + (half - 1) * s, end - 2 * s);
+	  sort3 (p, begin + 2 * s, begin + (half + 1) * s, end - 3 * s);
+	  sort3 (p, begin + (half - 1) * s, begin + half * s,
+		 begin + (half + 1) * s);
+	  do_swap (p, begin, begin + half * s);
+	}
+      else
+	sort3 (p, begin + half * s, begin, end - s);
+
+      /* If the pivot equals the element before the range, everything
+	 equal to it is already in its final place: put it on the left
+	 and only continue with the rest.  This makes inputs with many
+	 duplicates sort in linear time.  */
+      if (! leftmost && ! less (p, begin - s, begin))
+	{
+	  begin = partition_left (p, begin, end) + s;
+	  continue;
+	}
+
+      bool already_partitioned;
+      char *pivot_pos = partition_right (p, begin, end,
+					 &already_partitioned);
+      size_t l_n = (pivot_pos - begin) / s;
+      size_t r_n = n - l_n - 1;
+
+      if (l_n < n / 8 || r_n < n / 8)
+	{
+	  if (--bad_allowed == 0)
 	    {
-	      while ((*cmp) ((void *) left_ptr, (void *) mid, arg) < 0)
-		left_ptr += size;
-
-	      while ((*cmp) ((void *) mid, (void *) right_ptr, arg) < 0)
-		right_ptr -= size;
-
-	      if (left_ptr < right_ptr)
-		{
-		  SWAP (left_ptr, right_ptr, size);
-		  if (mid == left_ptr)
-		    mid = right_ptr;
-		  else if (mid == right_ptr)
-		    mid = left_ptr;
-		  left_ptr += size;
-		  right_ptr -= size;
-		}
-	      else if (left_ptr == right_ptr)
-		{
-		  left_ptr += size;
-		  right_ptr -= size;
-		  break;
-		}
+	      heap_sort (p, begin, end);
+	      return;
 	    }
-	  while (left_ptr <= right_ptr);
-
-          /* Set up pointers for next iteration.  First determine whether
-             left and right partitions are below the threshold size.  If so,
-             ignore one or both.  Otherwise, push the larger partition's
-             bounds on the stack and continue sorting the smaller one. */
-
-          if ((size_t) (right_ptr - lo) <= max_thresh)
-            {
-              if ((size_t) (hi - left_ptr) <= max_thresh)
-		/* Ignore both small partitions. */
-                POP (lo, hi);
-              else
-		/* Ignore small left partition. */
-                lo = left_ptr;
-            }
-          else if ((size_t) (hi - left_ptr) <= max_thresh)
-	    /* Ignore small right partition. */
-            hi = right_ptr;
-          else if ((right_ptr - lo) > (hi - left_ptr))
-            {
-	      /* Push larger left partition indices. */
-              PUSH (lo, right_ptr);
-              lo = left_ptr;
-            }
-          else
-            {
-	      /* Push larger right partition indices. */
-              PUSH (left_ptr, hi);
-              hi = right_ptr;
-            }
-        }
+	  break_patterns (p, begin, l_n);
+	  break_patterns (p, pivot_pos + s, r_n);
+	}
+      else if (already_partitioned
+	       && partial_insertion_sort (p, begin, pivot_pos)
+	       && partial_insertion_sort (p, pivot_pos + s, end))
+	/* The input was (nearly) sorted already.  */
+	return;
+
+      if (l_n < r_n)
+	{
+	  pdqsort_loop (p, begin, pivot_pos, bad_allowed, leftmost);
+	  begin = pivot_pos + s;
+	  leftmost = false;
+	}
+      else
+	{
+	  pdqsort_loop (p, pivot_pos + s, end, bad_allowed, false);
+	  end = pivot_pos;
+	}
     }
+}
 
-  /* Once the BASE_PTR array is partially sorted by quicksort the rest
-     is completely sorted using insertion sort, since this is efficient
-     for partitions below MAX_THRESH size. BASE_PTR points to the beginning
-     of the array to sort, and END_PTR points at the very last element in
-     the array (*not* one beyond it!). */
+/* Order the TOTAL_ELEMS elements of SIZE bytes at PBASE in place.  This
+   is what qsort falls back to when it cannot get memory for merging,
+   so it must not allocate.  It is a pattern-defeating quicksort:
 
-#define min(x, y) ((x) < (y) ? (x) : (y))
+   1. Partitions below INSERTION_SORT_THRESH elements are finished with
+      insertion sort.
 
-  {
-    char *const end_ptr = &base_ptr[size * (total_elems - 1)];
-    char *tmp_ptr = base_ptr;
-    char *thresh = min(end_ptr, base_ptr + max_thresh);
-    char *run_ptr;
+   2. The pivot is the median of three, or the pseudo-median of nine
+      for large partitions.
 
-    /* Find smallest element in first threshold and place it at the
-       array's beginning.  This is the smallest array element,
-       and the operation speeds up insertion sort's inner loop. */
+   3. Partitioning classifies blocks of elements before moving them, so
+      the outcome of the comparisons does not drive the branches.
 
-    for (run_ptr = tmp_ptr + size; run_ptr <= thresh; run_ptr += size)
-      if ((*cmp) ((void *) run_ptr, (void *) tmp_ptr, arg) < 0)
-        tmp_ptr = run_ptr;
+   4. A partition that needed no exchanges is taken as a hint that the
+      input is sorted, and insertion sort is tried on both parts; this
+      makes sorted and nearly sorted input linear.
 
-    if (tmp_ptr != base_ptr)
-      SWAP (tmp_ptr, base_ptr, size);
+   5. A pivot equal to its predecessor makes the elements equal to it
+      be split off at once, so many duplicates are handled in linear
+      time.
 
-    /* Insertion sort, running from left-hand-side up to right-hand-side.  */
+   6. Badly unbalanced partitions shuffle a few elements, and after
+      log2 (TOTAL_ELEMS) of them the partition is sorted with heapsort,
+      which bounds the worst case at O(n log n).
 
-    run_ptr = base_ptr + size;
-    while ((run_ptr += size) <= end_ptr)
-      {
-	tmp_ptr = run_ptr - size;
-	while ((*cmp) ((void *) run_ptr, (void *) tmp_ptr, arg) < 0)
-	  tmp_ptr -= size;
-
-	tmp_ptr += size;
-        if (tmp_ptr != run_ptr)
-          {
-            char *trav;
-
-	    trav = run_ptr + size;
-	    while (--trav >= run_ptr)
-              {
-                char c = *trav;
-                char *hi, *lo;
-
-                for (hi = lo = trav; (lo -= size) >= tmp_ptr; hi = lo)
-                  *hi = *lo;
-                *hi = c;
-              }
-          }
-      }
-  }
+   Recursion always goes to the smaller part, so at most
+   log2 (TOTAL_ELEMS) frames are used.  */
+
+void
+_quicksort (void *const pbase, size_t total_elems, size_t size,
+	    __compar_d_fn_t cmp, void *arg)
+{
+  char *base = (char *) pbase;
+  struct sort_param p;
+  int bad_allowed = 0;
+
+  if (total_elems <= 1)
+    return;
+
+  p.s = size;
+  p.cmp = cmp;
+  p.arg = arg;
+  p.var = SWAP_BYTES;
+  if ((size & (sizeof (uint32_t) - 1)) == 0
+      && ((char *) pbase - (char *) 0) % __alignof__ (uint32_t) == 0)
+    {
+      if (size == sizeof (uint32_t))
+	p.var = SWAP_WORDS_32;
+      else if ((size == sizeof (uint64_t) || size == 2 * sizeof (uint64_t))
+	       && ((char *) pbase - (char *) 0) % __alignof__ (uint64_t) == 0)
+	p.var = size == sizeof (uint64_t) ? SWAP_WORDS_64 : SWAP_WORDS_128;
+      else if ((size & (sizeof (unsigned long) - 1)) == 0
+	       && ((char *) pbase - (char *) 0)
+		  % __alignof__ (unsigned long) == 0)
+	p.var = SWAP_LONGS;
+    }
+
+  for (size_t n = total_elems; n > 0; n >>= 1)
+    ++bad_allowed;
+
+  pdqsort_loop (&p, base, base + total_elems * size, bad_allowed, true);
 }
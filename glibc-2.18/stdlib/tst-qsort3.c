@@ -0,0 +1,269 @@
+/* Test qsort with various element sizes and input patterns, both with
+   and without memory for a temporary array.
+   Copyright (C) 2013 Free Software Foundation, Inc.
+   This file is part of the GNU C Library.
+
+   The GNU C Library is free software; you can redistribute it and/or
+   modify it under the terms of the GNU Lesser General Public
+   License as published by the Free Software Foundation; either
+   version 2.1 of the License, or (at your option) any later version.
+
+   The GNU C Library is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+   Lesser General Public License for more details.
+
+   You should have received a copy of the GNU Lesser General Public
+   License along with the GNU C Library; if not, see
+   <http://www.gnu.org/licenses/>.  */
+
+#include <malloc.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+/* Each element starts with a key, followed by the index it had before
+   sorting, so that lost or duplicated elements can be detected.  The
+   rest of the element is filled with a byte derived from the index.
+   Elements smaller than struct head use struct small_head, which
+   limits the keys and the number of elements to 16 bits.  */
+struct head
+{
+  uint32_t key;
+  uint32_t index;
+};
+
+struct small_head
+{
+  uint16_t key;
+  uint16_t index;
+};
+
+enum pattern
+  {
+    RANDOM,
+    SORTED,
+    REVERSED,
+    ORGAN_PIPE,
+    FEW_VALUES,
+    ALL_EQUAL,
+    NEARLY_SORTED,
+    NPATTERNS
+  };
+
+static const char *const pattern_names[NPATTERNS] =
+  {
+    "random", "sorted", "reversed", "organ pipe", "few values",
+    "all equal", "nearly sorted"
+  };
+
+static char *array;
+static char *array_end;
+static size_t ncompares;
+static int small_elements;
+
+static int
+compare (const void *a, const void *b)
+{
+  uint32_t ka, kb;
+
+  if ((const char *) a < array || (const char *) a >= array_end
+      || (const char *) b < array || (const char *) b >= array_end)
+    {
+      puts ("compare arguments not inside of the array");
+      exit (EXIT_FAILURE);
+    }
+  ++ncompares;
+  /* The elements need not be aligned.  */
+  if (small_elements)
+    {
+      uint16_t ska, skb;
+      memcpy (&ska, a, sizeof (ska));
+      memcpy (&skb, b, sizeof (skb));
+      ka = ska;
+      kb = skb;
+    }
+  else
+    {
+      memcpy (&ka, a, sizeof (ka));
+      memcpy (&kb, b, sizeof (kb));
+    }
+  return ka < kb ? -1 : ka > kb;
+}
+
+static void *(*old_malloc_hook) (size_t, const void *);
+
+static void *
+failing_malloc (size_t size, const void *caller)
+{
+  return NULL;
+}
+
+static uint32_t
+make_key (enum pattern pat, size_t i, size_t n)
+{
+  switch (pat)
+    {
+    case RANDOM:
+      return random ();
+    case SORTED:
+      return i;
+    case REVERSED:
+      return n - i;
+    case ORGAN_PIPE:
+      return i < n / 2 ? i : n - i;
+    case FEW_VALUES:
+      return random () % 4;
+    case ALL_EQUAL:
+      return 42;
+    case NEARLY_SORTED:
+      return i % 64 == 0 ? (uint32_t) random () : i;
+    default:
+      abort ();
+    }
+}
+
+static void
+set_head (char *p, uint32_t key, size_t index)
+{
+  if (small_elements)
+    {
+      struct small_head h = { key, index };
+      memcpy (p, &h, sizeof (h));
+    }
+  else
+    {
+      struct head h = { key, index };
+      memcpy (p, &h, sizeof (h));
+    }
+}
+
+static size_t
+get_index (const char *p)
+{
+  if (small_elements)
+    {
+      struct small_head h;
+      memcpy (&h, p, sizeof (h));
+      return h.index;
+    }
+  else
+    {
+      struct head h;
+      memcpy (&h, p, sizeof (h));
+      return h.index;
+    }
+}
+
+static int
+check (enum pattern pat, size_t n, size_t size, int no_memory)
+{
+  unsigned char *seen;
+  size_t i, used, log2n, head_size;
+  char *p;
+  int ret = 0;
+
+  small_elements = size < sizeof (struct head);
+  head_size = small_elements ? sizeof (struct small_head)
+			     : sizeof (struct head);
+
+  /* Start the array at an odd address for odd sizes, so that the
+     byte-wise paths are used with unaligned elements.  */
+  char *block = malloc (n * size + 1);
+  seen = calloc (n + 1, 1);
+  if (block == NULL || seen == NULL)
+    {
+      puts ("out of memory");
+      exit (EXIT_FAILURE);
+    }
+  array = block + (size & 1);
+  array_end = array + n * size;
+
+  for (i = 0, p = array; i < n; i++, p += size)
+    {
+      memset (p, (int) i, size);
+      set_head (p, make_key (pat, i, n), i);
+    }
+
+  ncompares = 0;
+  if (no_memory)
+    {
+      old_malloc_hook = __malloc_hook;
+      __malloc_hook = failing_malloc;
+    }
+  qsort (array, n, size, compare);
+  if (no_memory)
+    __malloc_hook = old_malloc_hook;
+  used = ncompares;
+
+  for (i = 0, p = array; i < n; i++, p += size)
+    {
+      size_t index = get_index (p);
+      size_t j;
+
+      if (index >= n || seen[index])
+	{
+	  printf ("%s %zd x %zd%s: element %zd lost or duplicated\n",
+		  pattern_names[pat], n, size,
+		  no_memory ? " (no memory)" : "", i);
+	  ret = 1;
+	  break;
+	}
+      seen[index] = 1;
+      for (j = head_size; j < size; j++)
+	if (p[j] != (char) index)
+	  {
+	    printf ("%s %zd x %zd%s: element %zd corrupted\n",
+		    pattern_names[pat], n, size,
+		    no_memory ? " (no memory)" : "", i);
+	    ret = 1;
+	    break;
+	  }
+      if (i > 0 && compare (p - size, p) > 0)
+	{
+	  printf ("%s %zd x %zd%s: not sorted at %zd\n",
+		  pattern_names[pat], n, size,
+		  no_memory ? " (no memory)" : "", i);
+	  ret = 1;
+	  break;
+	}
+    }
+
+  /* Neither algorithm should get anywhere near quadratic behaviour on
+     these inputs.  */
+  for (log2n = 1; ((size_t) 1 << log2n) < n; log2n++)
+    ;
+  if (used > 3 * n * log2n + 3 * n)
+    {
+      printf ("%s %zd x %zd%s: %zd comparisons\n", pattern_names[pat], n,
+	      size, no_memory ? " (no memory)" : "", used);
+      ret = 1;
+    }
+
+  free (seen);
+  free (block);
+  return ret;
+}
+
+static int
+do_test (void)
+{
+  static const size_t sizes[] = { 4, 6, 8, 9, 12, 16, 24, 31, 32, 40, 64 };
+  static const size_t counts[] =
+    { 0, 1, 2, 3, 23, 24, 25, 129, 1000, 50000 };
+  int ret = 0;
+
+  for (size_t s = 0; s < sizeof (sizes) / sizeof (sizes[0]); s++)
+    for (size_t c = 0; c < sizeof (counts) / sizeof (counts[0]); c++)
+      for (int pat = 0; pat < NPATTERNS; pat++)
+	{
+	  ret |= check (pat, counts[c], sizes[s], 0);
+	  ret |= check (pat, counts[c], sizes[s], 1);
+	}
+
+  return ret;
+}
+
+#define TEST_FUNCTION do_test ()
+#include "../test-skeleton.c"
@@ -26,3 +26,16 @@ check_may_shrink_heap (void)
 {
   return __libc_enable_secure;
 }
+
+/* NUMA node of the calling thread, or -1 if unknown.  */
+static inline int
+malloc_getnode (void)
+{
+  return -1;
+}
+
+/* Prefer NUMA node NODE for the pages at ADDR.  */
+static inline void
+malloc_bind_node (void *addr, size_t size, int node)
+{
+}
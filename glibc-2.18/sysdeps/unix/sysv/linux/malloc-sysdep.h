@@ -18,6 +18,7 @@
 
 #include <fcntl.h>
 #include <not-cancel.h>
+#include <sysdep.h>
 
 /* The Linux kernel overcommits address space by default and if there is not
    enough memory available, it uses various parameters to decide the process to
@@ -56,4 +57,43 @@ check_may_shrink_heap (void)
   return may_shrink_heap;
 }
 
+/* Return the NUMA node of the CPU the calling thread runs on, or -1 if
+   it cannot be determined.  */
+static inline int
+malloc_getnode (void)
+{
+#ifdef __NR_getcpu
+  unsigned int cpu, node;
+  INTERNAL_SYSCALL_DECL (err);
+  int r = INTERNAL_SYSCALL (getcpu, err, 3, &cpu, &node, NULL);
+  if (!INTERNAL_SYSCALL_ERROR_P (r, err))
+    return node;
+#endif
+  return -1;
+}
+
+/* Ask the kernel to place the pages in the SIZE bytes at ADDR on NUMA
+   node NODE.  This is only a preference; if it fails or the node has
+   no free memory the pages come from wherever the default policy puts
+   them.  */
+static inline void
+malloc_bind_node (void *addr, size_t size, int node)
+{
+#ifdef __NR_mbind
+# define MALLOC_MPOL_PREFERRED	1
+# define MALLOC_MAX_NODES	1024
+# define MALLOC_NODE_BITS	(8 * sizeof (unsigned long int))
+  unsigned long int mask[MALLOC_MAX_NODES / MALLOC_NODE_BITS] = { 0 };
+
+  if (node >= MALLOC_MAX_NODES)
+    return;
+  mask[node / MALLOC_NODE_BITS] = 1UL << (node % MALLOC_NODE_BITS);
+
+  INTERNAL_SYSCALL_DECL (err);
+  /* The kernel ignores the last bit of the mask.  */
+  (void) INTERNAL_SYSCALL (mbind, err, 6, addr, size, MALLOC_MPOL_PREFERRED,
+			   mask, MALLOC_MAX_NODES + 1, 0);
+#endif
+}
+
 #define HAVE_MREMAP 1
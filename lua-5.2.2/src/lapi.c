@@ -118,6 +118,8 @@ LUA_API void lua_xmove (lua_State *from, lua_State *to, int n) {
   api_check(from, to->ci->top - to->top >= n, "not enough elements to move");
   from->top -= n;
   for (i = 0; i < n; i++) {
+    if (iscollectable(from->top + i) && isregion(gcvalue(from->top + i)))
+      G(to)->regionescaped = 1;  /* other stacks are not tracked */
     setobj2s(to, to->top++, from->top + i);
   }
   lua_unlock(to);
@@ -267,7 +269,11 @@ LUA_API int lua_iscfunction (lua_State *L, int idx) {
 LUA_API int lua_isnumber (lua_State *L, int idx) {
   TValue n;
   const TValue *o = index2addr(L, idx);
-  return tonumber(o, &n);
+  int res;
+  lua_lock(L);  /* a rope may have to be built */
+  res = tonumber(o, &n);
+  lua_unlock(L);
+  return res;
 }
 
 
@@ -335,7 +341,11 @@ LUA_API int lua_compare (lua_State *L, int index1, int index2, int op) {
 LUA_API lua_Number lua_tonumberx (lua_State *L, int idx, int *isnum) {
   TValue n;
   const TValue *o = index2addr(L, idx);
-  if (tonumber(o, &n)) {
+  int ok;
+  lua_lock(L);  /* a rope may have to be built */
+  ok = tonumber(o, &n);
+  lua_unlock(L);
+  if (ok) {
     if (isnum) *isnum = 1;
     return nvalue(o);
   }
@@ -349,7 +359,11 @@ LUA_API lua_Number lua_tonumberx (lua_State *L, int idx, int *isnum) {
 LUA_API lua_Integer lua_tointegerx (lua_State *L, int idx, int *isnum) {
   TValue n;
   const TValue *o = index2addr(L, idx);
-  if (tonumber(o, &n)) {
+  int ok;
+  lua_lock(L);  /* a rope may have to be built */
+  ok = tonumber(o, &n);
+  lua_unlock(L);
+  if (ok) {
     lua_Integer res;
     lua_Number num = nvalue(o);
     lua_number2integer(res, num);
@@ -366,7 +380,11 @@ LUA_API lua_Integer lua_tointegerx (lua_State *L, int idx, int *isnum) {
 LUA_API lua_Unsigned lua_tounsignedx (lua_State *L, int idx, int *isnum) {
   TValue n;
   const TValue *o = index2addr(L, idx);
-  if (tonumber(o, &n)) {
+  int ok;
+  lua_lock(L);  /* a rope may have to be built */
+  ok = tonumber(o, &n);
+  lua_unlock(L);
+  if (ok) {
     lua_Unsigned res;
     lua_Number num = nvalue(o);
     lua_number2unsigned(res, num);
@@ -399,6 +417,14 @@ LUA_API const char *lua_tolstring (lua_State *L, int idx, size_t *len) {
     o = index2addr(L, idx);  /* previous call may reallocate the stack */
     lua_unlock(L);
   }
+  if (ttisrope(o)) {
+    TString *ts;
+    lua_lock(L);  /* `luaS_flatten' may create a new string */
+    ts = luaS_flatten(L, rawtsvalue(o));
+    lua_unlock(L);
+    if (len != NULL) *len = ts->tsv.len;
+    return getstr(ts);
+  }
   if (len != NULL) *len = tsvalue(o)->len;
   return svalue(o);
 }
@@ -670,6 +696,62 @@ LUA_API void lua_rawgetp (lua_State *L, int idx, const void *p) {
 }
 
 
+/* element 'i' (1-based) of table 'h' */
+#define arrayelem(h,i)  \
+	((i) <= (h)->sizearray ? &(h)->array[(i) - 1] : luaH_getint(h, i))
+
+
+LUA_API int lua_rawgetnumbers (lua_State *L, int idx, lua_Number *v, int n) {
+  StkId t;
+  Table *h;
+  int i;
+  int res = 0;
+  lua_lock(L);
+  t = index2addr(L, idx);
+  api_check(L, ttistable(t), "table expected");
+  h = hvalue(t);
+  for (i = 1; i <= n; i++) {
+    const TValue *o = arrayelem(h, i);
+    if (ttisnumber(o)) {  /* no string conversion: the access is raw */
+      v[i - 1] = nvalue(o);
+      res++;
+    }
+    else
+      v[i - 1] = 0;
+  }
+  lua_unlock(L);
+  return res;
+}
+
+
+LUA_API int lua_rawgetstrings (lua_State *L, int idx, const char **s,
+                               size_t *len, int n) {
+  StkId t;
+  Table *h;
+  int i;
+  int res = 0;
+  lua_lock(L);
+  t = index2addr(L, idx);
+  api_check(L, ttistable(t), "table expected");
+  h = hvalue(t);
+  for (i = 1; i <= n; i++) {
+    const TValue *o = arrayelem(h, i);
+    if (ttisstring(o)) {
+      TString *ts = luaS_plain(L, rawtsvalue(o));
+      s[i - 1] = getstr(ts);
+      if (len != NULL) len[i - 1] = ts->tsv.len;
+      res++;
+    }
+    else {
+      s[i - 1] = NULL;
+      if (len != NULL) len[i - 1] = 0;
+    }
+  }
+  lua_unlock(L);
+  return res;
+}
+
+
 LUA_API void lua_createtable (lua_State *L, int narray, int nrec) {
   Table *t;
   lua_lock(L);
@@ -809,6 +891,54 @@ LUA_API void lua_rawsetp (lua_State *L, int idx, const void *p) {
 }
 
 
+/*
+** get table at 'idx' for a bulk assignment to its elements 1..n, with
+** all of them in its array part
+*/
+static Table *bulktable (lua_State *L, int idx, int n) {
+  StkId t = index2addr(L, idx);
+  Table *h;
+  api_check(L, ttistable(t), "table expected");
+  h = hvalue(t);
+  if (h->sizearray < n)
+    luaH_resizearray(L, h, n);
+  return h;
+}
+
+
+LUA_API void lua_rawsetnumbers (lua_State *L, int idx, const lua_Number *v,
+                                int n) {
+  Table *h;
+  int i;
+  lua_lock(L);
+  h = bulktable(L, idx, n);
+  for (i = 0; i < n; i++)
+    setnvalue(&h->array[i], v[i]);  /* numbers need no barrier */
+  lua_unlock(L);
+}
+
+
+LUA_API void lua_rawsetstrings (lua_State *L, int idx, const char *const *s,
+                                const size_t *len, int n) {
+  Table *h;
+  int i;
+  lua_lock(L);
+  h = bulktable(L, idx, n);
+  for (i = 0; i < n; i++) {
+    TValue *o = &h->array[i];
+    if (s[i] == NULL)
+      setnilvalue(o);
+    else {
+      size_t l = (len != NULL) ? len[i] : strlen(s[i]);
+      setsvalue(L, o, luaS_newlstr(L, s[i], l));
+      luaC_barrierback(L, obj2gco(h), o);
+    }
+  }
+  luaC_checkGC(L);
+  lua_unlock(L);
+}
+
+
 LUA_API int lua_setmetatable (lua_State *L, int objindex) {
   TValue *obj;
   Table *mt;
@@ -839,6 +969,8 @@ LUA_API int lua_setmetatable (lua_State *L, int objindex) {
       break;
     }
     default: {
+      if (mt != NULL && isregion(obj2gco(mt)))
+        G(L)->regionescaped = 1;
       G(L)->mt[ttypenv(obj)] = mt;
       break;
     }
@@ -1096,6 +1228,43 @@ LUA_API int lua_gc (lua_State *L, int what, int data) {
 }
 
 
+LUA_API void lua_pushregion (lua_State *L) {
+  lua_lock(L);
+  luaC_pushregion(L);
+  lua_unlock(L);
+}
+
+
+LUA_API int lua_popregion (lua_State *L) {
+  int res;
+  lua_lock(L);
+  api_check(L, G(L)->regiondepth > 0, "no open region");
+  res = luaC_popregion(L);
+  lua_unlock(L);
+  return res;
+}
+
+
+LUA_API size_t lua_gcobjects (lua_State *L, int tp, size_t *count) {
+  size_t bytes;
+  lua_lock(L);
+  api_check(L, 0 <= tp && tp <= LUA_NUMTAGS + 1, "invalid type");
+  if (count != NULL) *count = cast(size_t, G(L)->objcount[tp]);
+  bytes = cast(size_t, G(L)->objbytes[tp]);
+  lua_unlock(L);
+  return bytes;
+}
+
+
+LUA_API int lua_heapsnapshot (lua_State *L, lua_Writer writer, void *data) {
+  int status;
+  lua_lock(L);
+  status = luaC_heapsnapshot(L, writer, data);
+  lua_unlock(L);
+  return status;
+}
+
+
 
 /*
 ** miscellaneous functions
@@ -1282,3 +1451,40 @@ LUA_API void lua_upvaluejoin (lua_State *L, int fidx1, int n1,
   luaC_objbarrier(L, f1, *up2);
 }
 
+
+LUA_API int lua_swapcode (lua_State *L, int fidx) {
+  StkId fi;
+  int n;
+  lua_lock(L);
+  fi = index2addr(L, fidx);
+  api_check(L, ttisLclosure(fi), "Lua function expected");
+  n = luaF_swapcode(L, clLvalue(fi)->p);
+  lua_unlock(L);
+  return n;
+}
+
+
+/*
+** marks are counted, so that a function stays marked while any filter
+** (of any thread) still includes it
+*/
+static void hookfilter (Proto *p, int on) {
+  int i;
+  if (on) {
+    if (p->hooked < USHRT_MAX) p->hooked++;
+  }
+  else if (p->hooked > 0) p->hooked--;
+  for (i = 0; i < p->sizep; i++)
+    hookfilter(p->p[i], on);
+}
+
+
+LUA_API void lua_hookfilter (lua_State *L, int fidx, int on) {
+  StkId fi;
+  lua_lock(L);
+  fi = index2addr(L, fidx);
+  api_check(L, ttisLclosure(fi), "Lua function expected");
+  hookfilter(clLvalue(fi)->p, on);
+  lua_unlock(L);
+}
+
@@ -213,12 +213,12 @@ static int luaK_code (FuncState *fs, Instruction i) {
   Proto *f = fs->f;
   dischargejpc(fs);  /* `pc' will change */
   /* put new instruction in code array */
-  luaM_growvector(fs->ls->L, f->code, fs->pc, f->sizecode, Instruction,
-                  MAX_INT, "opcodes");
+  luaM_growvectort(fs->ls->L, f->code, fs->pc, f->sizecode, Instruction,
+                   MAX_INT, "opcodes", LUA_TPROTO);
   f->code[fs->pc] = i;
   /* save corresponding line information */
-  luaM_growvector(fs->ls->L, f->lineinfo, fs->pc, f->sizelineinfo, int,
-                  MAX_INT, "opcodes");
+  luaM_growvectort(fs->ls->L, f->lineinfo, fs->pc, f->sizelineinfo, int,
+                   MAX_INT, "opcodes", LUA_TPROTO);
   f->lineinfo[fs->pc] = fs->ls->lastline;
   return fs->pc++;
 }
@@ -307,7 +307,8 @@ static int addk (FuncState *fs, TValue *key, TValue *v) {
   /* numerical value does not need GC barrier;
      table has no metatable, so it does not need to invalidate cache */
   setnvalue(idx, cast_num(k));
-  luaM_growvector(L, f->k, k, f->sizek, TValue, MAXARG_Ax, "constants");
+  luaM_growvectort(L, f->k, k, f->sizek, TValue, MAXARG_Ax, "constants",
+                   LUA_TPROTO);
   while (oldsize < f->sizek) setnilvalue(&f->k[oldsize++]);
   setobj(L, &f->k[k], v);
   fs->nk++;
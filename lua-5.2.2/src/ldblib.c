@@ -19,6 +19,7 @@
 
 
 #define HOOKKEY		"_HKEY"
+#define HOOKFILTER	"_HFILTER"
 
 
 
@@ -253,6 +254,14 @@ static int db_upvaluejoin (lua_State *L) {
 }
 
 
+static int db_swapcode (lua_State *L) {
+  luaL_checktype(L, 1, LUA_TFUNCTION);
+  luaL_argcheck(L, !lua_iscfunction(L, 1), 1, "Lua function expected");
+  lua_pushinteger(L, lua_swapcode(L, 1));
+  return 1;
+}
+
+
 #define gethooktable(L)	luaL_getsubtable(L, LUA_REGISTRYINDEX, HOOKKEY)
 
 
@@ -293,6 +302,53 @@ static char *unmakemask (int mask, char *smask) {
 }
 
 
+/*
+** a hook filter is a Lua function or a list of Lua functions; hooks
+** only fire inside them (and inside the functions nested in them)
+*/
+static void checkfilter (lua_State *L, int arg) {
+  int i, n;
+  if (lua_isfunction(L, arg)) {
+    luaL_argcheck(L, !lua_iscfunction(L, arg), arg, "Lua function expected");
+    return;
+  }
+  luaL_checktype(L, arg, LUA_TTABLE);
+  n = luaL_len(L, arg);
+  for (i = 1; i <= n; i++) {
+    lua_rawgeti(L, arg, i);
+    luaL_argcheck(L, lua_isfunction(L, -1) && !lua_iscfunction(L, -1), arg,
+                     "list of Lua functions expected");
+    lua_pop(L, 1);
+  }
+}
+
+
+static void markfilter (lua_State *L, int idx, int on) {
+  idx = lua_absindex(L, idx);
+  if (lua_isfunction(L, idx))
+    lua_hookfilter(L, idx, on);
+  else if (lua_istable(L, idx)) {
+    int i, n = luaL_len(L, idx);
+    for (i = 1; i <= n; i++) {
+      lua_rawgeti(L, idx, i);
+      if (lua_isfunction(L, -1) && !lua_iscfunction(L, -1))
+        lua_hookfilter(L, -1, on);
+      lua_pop(L, 1);
+    }
+  }
+}
+
+
+static void getweaktable (lua_State *L, const char *key) {
+  if (luaL_getsubtable(L, LUA_REGISTRYINDEX, key) == 0) {  /* creating? */
+    lua_pushstring(L, "k");
+    lua_setfield(L, -2, "__mode");  /** table.__mode = "k" */
+    lua_pushvalue(L, -1);
+    lua_setmetatable(L, -2);  /* setmetatable(table) = table */
+  }
+}
+
+
 static int db_sethook (lua_State *L) {
   int arg, mask, count;
   lua_Hook func;
@@ -306,13 +362,22 @@ static int db_sethook (lua_State *L) {
     luaL_checktype(L, arg+1, LUA_TFUNCTION);
     count = luaL_optint(L, arg+3, 0);
     func = hookf; mask = makemask(smask, count);
+    if (!lua_isnoneornil(L, arg+4)) {
+      checkfilter(L, arg+4);
+      mask |= LUA_MASKFILTER;
+    }
   }
-  if (gethooktable(L) == 0) {  /* creating hook table? */
-    lua_pushstring(L, "k");
-    lua_setfield(L, -2, "__mode");  /** hooktable.__mode = "k" */
-    lua_pushvalue(L, -1);
-    lua_setmetatable(L, -2);  /* setmetatable(hooktable) = hooktable */
-  }
+  lua_settop(L, arg+4);
+  getweaktable(L, HOOKFILTER);
+  lua_pushthread(L1); lua_xmove(L1, L, 1);
+  lua_rawget(L, -2);
+  markfilter(L, -1, 0);  /* drop previous filter of this thread */
+  lua_pop(L, 1);
+  lua_pushthread(L1); lua_xmove(L1, L, 1);
+  lua_pushvalue(L, arg+4);
+  lua_rawset(L, -3);  /* keep new filter */
+  markfilter(L, arg+4, 1);
+  getweaktable(L, HOOKKEY);
   lua_pushthread(L1); lua_xmove(L1, L, 1);
   lua_pushvalue(L, arg+1);
   lua_rawset(L, -3);  /* set new hook */
@@ -370,6 +435,40 @@ static int db_traceback (lua_State *L) {
 }
 
 
+static int db_memstats (lua_State *L) {
+  int tp;
+  lua_newtable(L);
+  for (tp = 0; tp <= LUA_NUMTAGS + 1; tp++) {
+    size_t count;
+    size_t bytes = lua_gcobjects(L, tp, &count);
+    if (count == 0) continue;  /* not a collectable type, or no objects */
+    lua_createtable(L, 0, 2);
+    lua_pushnumber(L, (lua_Number)count);
+    lua_setfield(L, -2, "count");
+    lua_pushnumber(L, (lua_Number)bytes);
+    lua_setfield(L, -2, "bytes");
+    lua_setfield(L, -2, lua_typename(L, tp));
+  }
+  return 1;
+}
+
+
+static int writer (lua_State *L, const void* b, size_t size, void* B) {
+  (void)L;
+  luaL_addlstring((luaL_Buffer*) B, (const char *)b, size);
+  return 0;
+}
+
+
+static int db_heapsnapshot (lua_State *L) {
+  luaL_Buffer b;
+  luaL_buffinit(L, &b);
+  lua_heapsnapshot(L, writer, &b);
+  luaL_pushresult(&b);
+  return 1;
+}
+
+
 static const luaL_Reg dblib[] = {
   {"debug", db_debug},
   {"getuservalue", db_getuservalue},
@@ -377,8 +476,10 @@ static const luaL_Reg dblib[] = {
   {"getinfo", db_getinfo},
   {"getlocal", db_getlocal},
   {"getregistry", db_getregistry},
+  {"heapsnapshot", db_heapsnapshot},
   {"getmetatable", db_getmetatable},
   {"getupvalue", db_getupvalue},
+  {"memstats", db_memstats},
   {"upvaluejoin", db_upvaluejoin},
   {"upvalueid", db_upvalueid},
   {"setuservalue", db_setuservalue},
@@ -386,6 +487,7 @@ static const luaL_Reg dblib[] = {
   {"setlocal", db_setlocal},
   {"setmetatable", db_setmetatable},
   {"setupvalue", db_setupvalue},
+  {"swapcode", db_swapcode},
   {"traceback", db_traceback},
   {NULL, NULL}
 };
@@ -51,7 +51,7 @@ static int currentline (CallInfo *ci) {
 ** this function can be called asynchronous (e.g. during a signal)
 */
 LUA_API int lua_sethook (lua_State *L, lua_Hook func, int mask, int count) {
-  if (func == NULL || mask == 0) {  /* turn off hooks? */
+  if (func == NULL || (mask & ~LUA_MASKFILTER) == 0) {  /* turn off hooks? */
     mask = 0;
     func = NULL;
   }
@@ -525,7 +525,7 @@ l_noret luaG_concaterror (lua_State *L, StkId p1, StkId p2) {
 
 l_noret luaG_aritherror (lua_State *L, const TValue *p1, const TValue *p2) {
   TValue temp;
-  if (luaV_tonumber(p1, &temp) == NULL)
+  if (luaV_tonumber(L, p1, &temp) == NULL)
     p2 = p1;  /* first operand is wrong */
   luaG_typeerror(L, p2, "perform arithmetic on");
 }
@@ -20,6 +20,14 @@
 /* Active Lua function (given call info) */
 #define ci_func(ci)		(clLvalue((ci)->func))
 
+/* true if hooks apply to Lua function prototype 'p' */
+#define hookedproto(L,p)	(!((L)->hookmask & LUA_MASKFILTER) || (p)->hooked)
+
+/* true if hooks apply to the function running in 'ci' */
+#define hookedci(L,ci)  \
+	(!((L)->hookmask & LUA_MASKFILTER) || \
+	 (isLua(ci) && ci_func(ci)->p->hooked))
+
 
 LUAI_FUNC l_noret luaG_typeerror (lua_State *L, const TValue *o,
                                                 const char *opname);
@@ -163,7 +163,7 @@ void luaD_reallocstack (lua_State *L, int newsize) {
   int lim = L->stacksize;
   lua_assert(newsize <= LUAI_MAXSTACK || newsize == ERRORSTACKSIZE);
   lua_assert(L->stack_last - L->stack == L->stacksize - EXTRA_STACK);
-  luaM_reallocvector(L, L->stack, L->stacksize, newsize, TValue);
+  luaM_reallocvectort(L, L->stack, L->stacksize, newsize, TValue, LUA_TTHREAD);
   for (; lim < newsize; lim++)
     setnilvalue(L->stack + lim); /* erase new segment */
   L->stacksize = newsize;
@@ -312,7 +312,7 @@ int luaD_precall (lua_State *L, StkId func, int nresults) {
       lua_assert(ci->top <= L->stack_last);
       ci->callstatus = 0;
       luaC_checkGC(L);  /* stack grow uses memory */
-      if (L->hookmask & LUA_MASKCALL)
+      if ((L->hookmask & LUA_MASKCALL) && hookedci(L, ci))
         luaD_hook(L, LUA_HOOKCALL, -1);
       lua_unlock(L);
       n = (*f)(L);  /* do the actual call */
@@ -340,7 +340,7 @@ int luaD_precall (lua_State *L, StkId func, int nresults) {
       ci->callstatus = CIST_LUA;
       L->top = ci->top;
       luaC_checkGC(L);  /* stack grow uses memory */
-      if (L->hookmask & LUA_MASKCALL)
+      if ((L->hookmask & LUA_MASKCALL) && hookedproto(L, p))
         callhook(L, ci);
       return 0;
     }
@@ -357,7 +357,7 @@ int luaD_poscall (lua_State *L, StkId firstResult) {
   int wanted, i;
   CallInfo *ci = L->ci;
   if (L->hookmask & (LUA_MASKRET | LUA_MASKLINE)) {
-    if (L->hookmask & LUA_MASKRET) {
+    if ((L->hookmask & LUA_MASKRET) && hookedci(L, ci)) {
       ptrdiff_t fr = savestack(L, firstResult);  /* hook may change stack */
       luaD_hook(L, LUA_HOOKRET, -1);
       firstResult = restorestack(L, fr);
@@ -531,6 +531,8 @@ LUA_API int lua_resume (lua_State *L, lua_State *from, int nargs) {
   luai_userstateresume(L, nargs);
   L->nCcalls = (from) ? from->nCcalls + 1 : 1;
   L->nny = 0;  /* allow yields */
+  if (G(L)->regionL != NULL && G(L)->regionL != L)
+    G(L)->regionescaped = 1;  /* coroutine stacks are not tracked */
   api_checknelems(L, (L->status == LUA_OK) ? nargs + 1 : nargs);
   status = luaD_rawrunprotected(L, resume, L->top - nargs);
   if (status == -1)  /* error calling 'lua_resume'? */
@@ -12,11 +12,14 @@
 
 #include "lua.h"
 
+#include "ldo.h"
 #include "lfunc.h"
 #include "lgc.h"
 #include "lmem.h"
 #include "lobject.h"
 #include "lstate.h"
+#include "lstring.h"
+#include "ltable.h"
 
 
 
@@ -93,12 +96,16 @@ void luaF_close (lua_State *L, StkId level) {
     GCObject *o = obj2gco(uv);
     lua_assert(!isblack(o) && uv->v != &uv->u.value);
     L->openupval = uv->next;  /* remove from `open' list */
-    if (isdead(g, o))
+    if (isdead(g, o)) {
+      if (isregion(o)) g->regioncount--;
       luaF_freeupval(L, uv);  /* free upvalue */
+    }
     else {
       unlinkupval(uv);  /* remove upvalue from 'uvhead' list */
       setobj(L, &uv->u.value, uv->v);  /* move value to upvalue slot */
       uv->v = &uv->u.value;  /* now current value lives here */
+      if (iscollectable(uv->v))  /* value was stored without a barrier */
+        luaC_regionbarrier(L, o, gcvalue(uv->v));
       gch(o)->next = g->allgc;  /* link upvalue into 'allgc' list */
       g->allgc = o;
       luaC_checkupvalcolor(g, uv);
@@ -123,6 +130,7 @@ Proto *luaF_newproto (lua_State *L) {
   f->numparams = 0;
   f->is_vararg = 0;
   f->maxstacksize = 0;
+  f->hooked = 0;
   f->locvars = NULL;
   f->sizelocvars = 0;
   f->linedefined = 0;
@@ -133,12 +141,12 @@ Proto *luaF_newproto (lua_State *L) {
 
 
 void luaF_freeproto (lua_State *L, Proto *f) {
-  luaM_freearray(L, f->code, f->sizecode);
-  luaM_freearray(L, f->p, f->sizep);
-  luaM_freearray(L, f->k, f->sizek);
-  luaM_freearray(L, f->lineinfo, f->sizelineinfo);
-  luaM_freearray(L, f->locvars, f->sizelocvars);
-  luaM_freearray(L, f->upvalues, f->sizeupvalues);
+  luaM_freearrayt(L, f->code, f->sizecode, LUA_TPROTO);
+  luaM_freearrayt(L, f->p, f->sizep, LUA_TPROTO);
+  luaM_freearrayt(L, f->k, f->sizek, LUA_TPROTO);
+  luaM_freearrayt(L, f->lineinfo, f->sizelineinfo, LUA_TPROTO);
+  luaM_freearrayt(L, f->locvars, f->sizelocvars, LUA_TPROTO);
+  luaM_freearrayt(L, f->upvalues, f->sizeupvalues, LUA_TPROTO);
   luaM_free(L, f);
 }
 
@@ -159,3 +167,124 @@ const char *luaF_getlocalname (const Proto *f, int local_number, int pc) {
   return NULL;  /* not found */
 }
 
+
+
+/*
+** {======================================================
+** Code replacement
+** =======================================================
+*/
+
+
+/*
+** find in prototype tree 'p' a function defined at line 'line'; '*n'
+** counts how many there are
+*/
+static Proto *findproto (Proto *p, int line, int *n) {
+  Proto *found = NULL;
+  int i;
+  if (p->linedefined == line) {
+    found = p;
+    (*n)++;
+  }
+  for (i = 0; i < p->sizep; i++) {
+    Proto *f = findproto(p->p[i], line, n);
+    if (f != NULL) found = f;
+  }
+  return found;
+}
+
+
+/*
+** check whether a closure of 'p' can run 'f' with its current upvalues
+*/
+static int sameupvalues (const Proto *p, const Proto *f) {
+  int i;
+  if (p->sizeupvalues != f->sizeupvalues) return 0;
+  for (i = 0; i < p->sizeupvalues; i++) {
+    const Upvaldesc *a = &p->upvalues[i];
+    const Upvaldesc *b = &f->upvalues[i];
+    if (a->instack != b->instack || a->idx != b->idx ||
+        (a->name != NULL && b->name != NULL && !luaS_eqstr(a->name, b->name)))
+      return 0;
+  }
+  return 1;
+}
+
+
+#define samesource(p,s)	((p)->source != NULL && luaS_eqstr((p)->source, s))
+
+
+typedef struct ActiveSet {
+  Table *t;  /* closures of 'source' with active calls */
+  TString *source;
+} ActiveSet;
+
+
+static void addactive (lua_State *L, ActiveSet *as, lua_State *th) {
+  CallInfo *ci;
+  for (ci = th->ci; ci != &th->base_ci; ci = ci->previous) {
+    if (isLua(ci) && samesource(clLvalue(ci->func)->p, as->source)) {
+      TValue key;
+      setclLvalue(L, &key, clLvalue(ci->func));
+      setbvalue(luaH_set(L, as->t, &key), 1);
+    }
+  }
+}
+
+
+static void f_addactive (lua_State *L, void *ud) {
+  ActiveSet *as = cast(ActiveSet *, ud);
+  GCObject *o;
+  addactive(L, as, G(L)->mainthread);
+  for (o = G(L)->allgc; o != NULL; o = gch(o)->next) {
+    if (gch(o)->tt == LUA_TTHREAD)
+      addactive(L, as, gco2th(o));
+  }
+}
+
+
+/*
+** Make every closure of a function from the same chunk as 'np' (same
+** source and line where it was defined) run the corresponding function
+** in the tree of 'np', provided that their upvalues match. Closures
+** with active calls keep their code, as their saved program counters
+** point into it. Returns the number of closures changed.
+*/
+int luaF_swapcode (lua_State *L, Proto *np) {
+  global_State *g = G(L);
+  ActiveSet as;
+  GCObject *o;
+  int running = g->gcrunning;
+  int status;
+  int n = 0;
+  if (np->source == NULL) return 0;  /* stripped: nothing to match */
+  as.source = np->source;
+  as.t = luaH_new(L);
+  sethvalue(L, L->top, as.t);  /* anchor it */
+  incr_top(L);
+  g->gcrunning = 0;  /* no object may be freed while traversing lists */
+  status = luaD_rawrunprotected(L, f_addactive, &as);
+  g->gcrunning = running;
+  if (status != LUA_OK)  /* memory error? */
+    luaD_throw(L, status);
+  for (o = g->allgc; o != NULL; o = gch(o)->next) {
+    if (gch(o)->tt == LUA_TLCL && samesource(gco2lcl(o)->p, np->source)) {
+      LClosure *cl = gco2lcl(o);
+      int count = 0;
+      Proto *f = findproto(np, cl->p->linedefined, &count);
+      TValue key;
+      setclLvalue(L, &key, cl);
+      if (count == 1 && f != cl->p && sameupvalues(cl->p, f) &&
+          ttisnil(luaH_get(as.t, &key))) {
+        cl->p = f;
+        luaC_objbarrier(L, cl, f);
+        n++;
+      }
+    }
+  }
+  L->top--;  /* remove set */
+  return n;
+}
+
+/* }====================================================== */
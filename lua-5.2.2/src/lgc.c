@@ -4,6 +4,7 @@
 ** See Copyright Notice in lua.h
 */
 
+#include <stdio.h>
 #include <string.h>
 
 #define lgc_c
@@ -214,12 +215,22 @@ GCObject *luaC_newobj (lua_State *L, int tt, size_t sz, GCObject **list,
   global_State *g = G(L);
   char *raw = cast(char *, luaM_newobject(L, novariant(tt), sz));
   GCObject *o = obj2gco(raw + offset);
+  g->objcount[novariant(tt)]++;
+  g->objbytes[novariant(tt)] += sz - offset;
   if (list == NULL)
     list = &g->allgc;  /* standard list for collectable objects */
   gch(o)->marked = luaC_white(g);
   gch(o)->tt = tt;
   gch(o)->next = *list;
   *list = o;
+  if (g->regionL != NULL) {  /* inside a tracked allocation region? */
+    if (tt == LUA_TTHREAD)  /* stacks are written without barriers */
+      g->regionescaped = 1;
+    else if (tt != LUA_TSHRSTR) {  /* interned strings are shared */
+      l_setbit(gch(o)->marked, REGIONBIT);
+      g->regioncount++;
+    }
+  }
   return o;
 }
 
@@ -249,6 +260,22 @@ static void reallymarkobject (global_State *g, GCObject *o) {
       size = sizestring(gco2ts(o));
       break;  /* nothing else to mark; make it black */
     }
+    case LUA_TROPE: {  /* mark chain of prefixes without recursion */
+      Rope *r = gco2rope(o);
+      for (;;) {
+        markobject(g, r->right);
+        if (r->left->tsv.tt != LUA_TROPE || !iswhite(obj2gco(r->left)))
+          break;
+        gray2black(obj2gco(r));
+        g->GCmemtrav += sizeof(Rope);
+        r = ts2rope(r->left);
+        white2gray(obj2gco(r));
+      }
+      markobject(g, r->left);
+      o = obj2gco(r);
+      size = sizeof(Rope);
+      break;
+    }
     case LUA_TUSERDATA: {
       Table *mt = gco2u(o)->metatable;
       markobject(g, mt);
@@ -431,13 +458,26 @@ static void traversestrongtable (global_State *g, Table *h) {
 }
 
 
+/*
+** check whether weak mode 'mode' (a string or a rope) has option 'c'
+*/
+static int hasmode (TString *mode, int c) {
+  while (mode != NULL) {
+    TString *piece = luaS_prevpiece(&mode);  /* not inside 'getstr' */
+    if (strchr(getstr(piece), c) != NULL)
+      return 1;
+  }
+  return 0;
+}
+
+
 static lu_mem traversetable (global_State *g, Table *h) {
-  const char *weakkey, *weakvalue;
+  int weakkey, weakvalue;
   const TValue *mode = gfasttm(g, h->metatable, TM_MODE);
   markobject(g, h->metatable);
   if (mode && ttisstring(mode) &&  /* is there a weak mode? */
-      ((weakkey = strchr(svalue(mode), 'k')),
-       (weakvalue = strchr(svalue(mode), 'v')),
+      ((weakkey = hasmode(rawtsvalue(mode), 'k')),
+       (weakvalue = hasmode(rawtsvalue(mode), 'v')),
        (weakkey || weakvalue))) {  /* is really weak? */
     black2gray(obj2gco(h));  /* keep table gray */
     if (!weakkey)  /* strong keys? */
@@ -653,7 +693,31 @@ static void clearvalues (global_State *g, GCObject *l, GCObject *f) {
 }
 
 
+/*
+** size of the block of an object, not counting the parts it owns
+** (e.g., the arrays of a table)
+*/
+static lu_mem blocksize (GCObject *o) {
+  switch (gch(o)->tt) {
+    case LUA_TPROTO: return sizeof(Proto);
+    case LUA_TLCL: return sizeLclosure(gco2lcl(o)->nupvalues);
+    case LUA_TCCL: return sizeCclosure(gco2ccl(o)->nupvalues);
+    case LUA_TUPVAL: return sizeof(UpVal);
+    case LUA_TTABLE: return sizeof(Table);
+    case LUA_TTHREAD: return sizeof(lua_State);
+    case LUA_TUSERDATA: return sizeudata(gco2u(o));
+    case LUA_TSHRSTR: case LUA_TLNGSTR: return sizestring(gco2ts(o));
+    case LUA_TROPE: return sizeof(Rope);
+    default: lua_assert(0); return 0;
+  }
+}
+
+
 static void freeobj (lua_State *L, GCObject *o) {
+  global_State *g = G(L);
+  if (isregion(o)) g->regioncount--;
+  g->objcount[novariant(gch(o)->tt)]--;
+  g->objbytes[novariant(gch(o)->tt)] -= blocksize(o);
   switch (gch(o)->tt) {
     case LUA_TPROTO: luaF_freeproto(L, gco2p(o)); break;
     case LUA_TLCL: {
@@ -675,6 +739,7 @@ static void freeobj (lua_State *L, GCObject *o) {
       luaM_freemem(L, o, sizestring(gco2ts(o)));
       break;
     }
+    case LUA_TROPE: luaM_freemem(L, o, sizeof(Rope)); break;
     default: lua_assert(0);
   }
 }
@@ -819,9 +884,11 @@ static void GCTM (lua_State *L, int propagateerrors) {
     g->gcrunning = running;  /* restore state */
     if (status != LUA_OK && propagateerrors) {  /* error while running __gc? */
       if (status == LUA_ERRRUN) {  /* is there an error object? */
-        const char *msg = (ttisstring(L->top - 1))
-                            ? svalue(L->top - 1)
-                            : "no message";
+        const char *msg = "no message";
+        if (ttisstring(L->top - 1)) {
+          TString *ts = luaS_plain(L, rawtsvalue(L->top - 1));
+          msg = getstr(ts);
+        }
         luaO_pushfstring(L, "error in __gc metamethod (%s)", msg);
         status = LUA_ERRGCMM;  /* error in __gc metamethod */
       }
@@ -882,6 +949,11 @@ void luaC_checkfinalizer (lua_State *L, GCObject *o, Table *mt) {
     ho->next = g->finobj;  /* link it in list 'finobj' */
     g->finobj = o;
     l_setbit(ho->marked, SEPARATED);  /* mark it as such */
+    if (isregion(o)) {  /* finalizers may resurrect it; keep it */
+      resetbit(ho->marked, REGIONBIT);
+      g->regioncount--;
+      g->regionescaped = 1;
+    }
     if (!keepinvariantout(g))  /* not keeping invariant? */
       makewhite(g, o);  /* "sweep" object */
     else
@@ -1164,12 +1236,22 @@ void luaC_forcestep (lua_State *L) {
 }
 
 
+/*
+** while a region is being tracked, a new cycle (which would keep the
+** region from being freed at once) is postponed until memory reaches
+** twice the threshold set by the pause
+*/
+#define deferredbyregion(g)  \
+	((g)->regionL != NULL && (g)->gcstate == GCSpause &&  \
+	 gettotalbytes(g) / 2 < ((g)->GCestimate / 100) * (g)->gcpause)
+
+
 /*
 ** performs a basic GC step only if collector is running
 */
 void luaC_step (lua_State *L) {
   global_State *g = G(L);
-  if (g->gcrunning) luaC_forcestep(L);
+  if (g->gcrunning && !deferredbyregion(g)) luaC_forcestep(L);
   else luaE_setdebt(g, -GCSTEPSIZE);  /* avoid being called too often */
 }
 
@@ -1211,3 +1293,281 @@ void luaC_fullgc (lua_State *L, int isemergency) {
 /* }====================================================== */
 
 
+
+
+/*
+** {======================================================
+** Allocation regions
+** =======================================================
+*/
+
+/*
+** Objects created while a region is open are tagged with REGIONBIT and
+** stay at the front of 'allgc'. The region is only tracked when it is
+** opened with the collector paused; nested regions join the outer one.
+*/
+void luaC_pushregion (lua_State *L) {
+  global_State *g = G(L);
+  if (g->regiondepth++ == 0 && g->gcstate == GCSpause) {
+    g->regionL = L;
+    g->regioncount = 0;
+    g->regionescaped = 0;
+  }
+}
+
+
+/*
+** Closes the outermost region. If no region object escaped (no barrier
+** saw one stored into an older object and none is left in the stack of
+** the thread that opened the region) and the collector is still paused,
+** all region objects are freed at once, without a collection cycle;
+** otherwise they become ordinary objects. Returns 1 in the first case.
+*/
+int luaC_popregion (lua_State *L) {
+  global_State *g = G(L);
+  lua_State *L1 = g->regionL;
+  GCObject **p;
+  UpVal *uv;
+  int tofree;
+  lua_assert(g->regiondepth > 0);
+  if (--g->regiondepth > 0 || L1 == NULL)
+    return 0;  /* region still open or not tracked */
+  g->regionL = NULL;
+  tofree = (L1 == L && !g->regionescaped && g->gcstate == GCSpause);
+  if (tofree) {
+    StkId o;
+    for (o = L->stack; o < L->top; o++) {
+      if (iscollectable(o) && isregion(gcvalue(o))) {
+        tofree = 0;  /* still in use by the caller */
+        break;
+      }
+    }
+  }
+  /* upvalues still open are not in 'allgc'; keep them */
+  for (uv = g->uvhead.u.l.next; uv != &g->uvhead; uv = uv->u.l.next) {
+    if (isregion(obj2gco(uv))) {
+      resetbit(uv->marked, REGIONBIT);
+      g->regioncount--;
+    }
+  }
+  p = &g->allgc;
+  while (g->regioncount > 0) {  /* region objects are at the list front */
+    GCObject *curr = *p;
+    lua_assert(curr != NULL);
+    if (!isregion(curr))
+      p = &gch(curr)->next;
+    else if (tofree) {
+      *p = gch(curr)->next;  /* remove 'curr' from list */
+      freeobj(L, curr);  /* also decrements 'regioncount' */
+    }
+    else {
+      resetbit(gch(curr)->marked, REGIONBIT);
+      g->regioncount--;
+      p = &gch(curr)->next;
+    }
+  }
+  return tofree;
+}
+
+/* }====================================================== */
+
+
+
+/*
+** {======================================================
+** Heap snapshot: one line per object with its address, type, size
+** (including the parts it owns), and the addresses of the objects it
+** refers to
+** =======================================================
+*/
+
+typedef struct SnapState {
+  lua_Writer writer;
+  void *data;
+  int status;  /* result of last call to 'writer' */
+  size_t n;  /* number of bytes in 'buff' */
+  char buff[512];
+} SnapState;
+
+
+static void snapflush (lua_State *L, SnapState *ss) {
+  if (ss->status == 0 && ss->n > 0)
+    ss->status = (*ss->writer)(L, ss->buff, ss->n, ss->data);
+  ss->n = 0;
+}
+
+
+static void snapadd (lua_State *L, SnapState *ss, const char *s, size_t l) {
+  if (ss->n + l > sizeof(ss->buff))
+    snapflush(L, ss);
+  memcpy(ss->buff + ss->n, s, l);
+  ss->n += l;
+}
+
+
+static void snapref (lua_State *L, SnapState *ss, void *o) {
+  if (o != NULL) {
+    char s[40];
+    snapadd(L, ss, s, sprintf(s, " %p", o));
+  }
+}
+
+
+#define snapvalue(L,ss,v)  \
+  { if (iscollectable(v)) snapref(L, ss, gcvalue(v)); }
+
+
+/*
+** size of an object plus the parts it owns
+*/
+static lu_mem fullsize (GCObject *o) {
+  lu_mem size = blocksize(o);
+  switch (gch(o)->tt) {
+    case LUA_TTABLE: {
+      Table *h = gco2t(o);  /* (counts dummy node, as 'traversetable') */
+      return size + sizeof(Node) * cast(size_t, sizenode(h)) +
+                    sizeof(TValue) * h->sizearray;
+    }
+    case LUA_TTHREAD: {
+      lua_State *th = gco2th(o);
+      CallInfo *ci;
+      for (ci = th->base_ci.next; ci != NULL; ci = ci->next)
+        size += sizeof(CallInfo);
+      return size + sizeof(TValue) * th->stacksize;
+    }
+    case LUA_TPROTO: {
+      Proto *f = gco2p(o);
+      return size + sizeof(Instruction) * f->sizecode +
+                    sizeof(Proto *) * f->sizep +
+                    sizeof(TValue) * f->sizek +
+                    sizeof(int) * f->sizelineinfo +
+                    sizeof(LocVar) * f->sizelocvars +
+                    sizeof(Upvaldesc) * f->sizeupvalues;
+    }
+    default: return size;
+  }
+}
+
+
+static void snapobject (lua_State *L, SnapState *ss, GCObject *o) {
+  char s[80];
+  int i;
+  snapadd(L, ss, s, sprintf(s, "%p %s %lu", (void *)o,
+                     ttypename(novariant(gch(o)->tt)),
+                     (unsigned long)fullsize(o)));
+  switch (gch(o)->tt) {
+    case LUA_TROPE: {
+      snapref(L, ss, gco2rope(o)->left);
+      snapref(L, ss, gco2rope(o)->right);
+      break;
+    }
+    case LUA_TUSERDATA: {
+      snapref(L, ss, gco2u(o)->metatable);
+      snapref(L, ss, gco2u(o)->env);
+      break;
+    }
+    case LUA_TUPVAL: {
+      snapvalue(L, ss, gco2uv(o)->v);
+      break;
+    }
+    case LUA_TLCL: {
+      LClosure *cl = gco2lcl(o);
+      snapref(L, ss, cl->p);
+      for (i = 0; i < cl->nupvalues; i++)
+        snapref(L, ss, cl->upvals[i]);
+      break;
+    }
+    case LUA_TCCL: {
+      CClosure *cl = gco2ccl(o);
+      for (i = 0; i < cl->nupvalues; i++)
+        snapvalue(L, ss, &cl->upvalue[i]);
+      break;
+    }
+    case LUA_TTABLE: {
+      Table *h = gco2t(o);
+      Node *n, *limit = gnodelast(h);
+      snapref(L, ss, h->metatable);
+      for (i = 0; i < h->sizearray; i++)
+        snapvalue(L, ss, &h->array[i]);
+      for (n = gnode(h, 0); n < limit; n++) {
+        if (!ttisnil(gval(n))) {
+          snapvalue(L, ss, gkey(n));
+          snapvalue(L, ss, gval(n));
+        }
+      }
+      break;
+    }
+    case LUA_TTHREAD: {
+      lua_State *th = gco2th(o);
+      StkId v;
+      for (v = th->stack; v < th->top; v++)
+        snapvalue(L, ss, v);
+      break;
+    }
+    case LUA_TPROTO: {
+      Proto *f = gco2p(o);
+      snapref(L, ss, f->source);
+      snapref(L, ss, f->cache);
+      for (i = 0; i < f->sizek; i++)
+        snapvalue(L, ss, &f->k[i]);
+      for (i = 0; i < f->sizep; i++)
+        snapref(L, ss, f->p[i]);
+      for (i = 0; i < f->sizeupvalues; i++)
+        snapref(L, ss, f->upvalues[i].name);
+      for (i = 0; i < f->sizelocvars; i++)
+        snapref(L, ss, f->locvars[i].varname);
+      break;
+    }
+    default: break;  /* strings refer to nothing */
+  }
+  snapadd(L, ss, "\n", 1);
+}
+
+
+static void snaplist (lua_State *L, SnapState *ss, GCObject *o) {
+  for (; o != NULL && ss->status == 0; o = gch(o)->next)
+    snapobject(L, ss, o);
+}
+
+
+static void dosnapshot (lua_State *L, void *ud) {
+  SnapState *ss = cast(SnapState *, ud);
+  global_State *g = G(L);
+  UpVal *uv;
+  int i;
+  snapobject(L, ss, obj2gco(g->mainthread));
+  snaplist(L, ss, g->allgc);
+  snaplist(L, ss, g->finobj);
+  snaplist(L, ss, g->tobefnz);
+  for (uv = g->uvhead.u.l.next; uv != &g->uvhead && ss->status == 0;
+       uv = uv->u.l.next)
+    snapobject(L, ss, obj2gco(uv));
+  for (i = 0; i < g->strt.size; i++)
+    snaplist(L, ss, g->strt.hash[i]);
+  snapflush(L, ss);
+}
+
+
+/*
+** write a snapshot of all objects through 'writer'. The collector is
+** stopped meanwhile, so that no object is freed during the walk;
+** objects created by 'writer' may or may not appear in the snapshot.
+*/
+int luaC_heapsnapshot (lua_State *L, lua_Writer writer, void *data) {
+  global_State *g = G(L);
+  SnapState ss;
+  int running = g->gcrunning;
+  int status;
+  ss.writer = writer;
+  ss.data = data;
+  ss.status = 0;
+  ss.n = 0;
+  g->gcrunning = 0;
+  status = luaD_rawrunprotected(L, dosnapshot, &ss);
+  g->gcrunning = running;
+  if (status != LUA_OK)  /* error inside 'writer'? */
+    luaD_throw(L, status);  /* propagate it */
+  return ss.status;
+}
+
+/* }====================================================== */
@@ -91,7 +91,8 @@
 #define SEPARATED	4  /* object is in 'finobj' list or in 'tobefnz' */
 #define FIXEDBIT	5  /* object is fixed (should not be collected) */
 #define OLDBIT		6  /* object is old (only in generational mode) */
-/* bit 7 is currently used by tests (luaL_checkmemory) */
+#define REGIONBIT	7  /* object was created inside an allocation region */
+/* bit 7 is also used by tests (luaL_checkmemory), which must not use regions */
 
 #define WHITEBITS	bit2mask(WHITE0BIT, WHITE1BIT)
 
@@ -103,6 +104,8 @@
 
 #define isold(x)	testbit((x)->gch.marked, OLDBIT)
 
+#define isregion(x)	testbit((x)->gch.marked, REGIONBIT)
+
 /* MOVE OLD rule: whenever an object is moved to the beginning of
    a GC list, its old bit must be cleared */
 #define resetoldbit(o)	resetbit((o)->gch.marked, OLDBIT)
@@ -124,23 +127,38 @@
 #define luaC_checkGC(L)		luaC_condGC(L, luaC_step(L);)
 
 
-#define luaC_barrier(L,p,v) { if (valiswhite(v) && isblack(obj2gco(p)))  \
+/*
+** an object created inside an allocation region escapes it when it is
+** stored into an object created outside the region
+*/
+#define luaC_regionbarrier(L,p,o)  \
+   { if (isregion(obj2gco(o)) && !isregion(obj2gco(p)))  \
+	G(L)->regionescaped = 1; }
+
+#define luaC_barrier(L,p,v) { if (iscollectable(v))  \
+	luaC_regionbarrier(L,p,gcvalue(v));  \
+	if (valiswhite(v) && isblack(obj2gco(p)))  \
 	luaC_barrier_(L,obj2gco(p),gcvalue(v)); }
 
-#define luaC_barrierback(L,p,v) { if (valiswhite(v) && isblack(obj2gco(p)))  \
+#define luaC_barrierback(L,p,v) { if (iscollectable(v))  \
+	luaC_regionbarrier(L,p,gcvalue(v));  \
+	if (valiswhite(v) && isblack(obj2gco(p)))  \
 	luaC_barrierback_(L,p); }
 
 #define luaC_objbarrier(L,p,o)  \
-	{ if (iswhite(obj2gco(o)) && isblack(obj2gco(p))) \
+	{ luaC_regionbarrier(L,p,o); \
+	  if (iswhite(obj2gco(o)) && isblack(obj2gco(p))) \
 		luaC_barrier_(L,obj2gco(p),obj2gco(o)); }
 
 #define luaC_objbarrierback(L,p,o)  \
-   { if (iswhite(obj2gco(o)) && isblack(obj2gco(p))) luaC_barrierback_(L,p); }
+   { luaC_regionbarrier(L,p,o); \
+     if (iswhite(obj2gco(o)) && isblack(obj2gco(p))) luaC_barrierback_(L,p); }
 
 #define luaC_barrierproto(L,p,c) \
    { if (isblack(obj2gco(p))) luaC_barrierproto_(L,p,c); }
 
 LUAI_FUNC void luaC_freeallobjects (lua_State *L);
+LUAI_FUNC int luaC_heapsnapshot (lua_State *L, lua_Writer writer, void *data);
 LUAI_FUNC void luaC_step (lua_State *L);
 LUAI_FUNC void luaC_forcestep (lua_State *L);
 LUAI_FUNC void luaC_runtilstate (lua_State *L, int statesmask);
@@ -153,5 +171,7 @@ LUAI_FUNC void luaC_barrierproto_ (lua_State *L, Proto *p, Closure *c);
 LUAI_FUNC void luaC_checkfinalizer (lua_State *L, GCObject *o, Table *mt);
 LUAI_FUNC void luaC_checkupvalcolor (global_State *g, UpVal *uv);
 LUAI_FUNC void luaC_changemode (lua_State *L, int mode);
+LUAI_FUNC void luaC_pushregion (lua_State *L);
+LUAI_FUNC int luaC_popregion (lua_State *L);
 
 #endif
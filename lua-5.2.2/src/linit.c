@@ -45,6 +45,9 @@ static const luaL_Reg loadedlibs[] = {
 ** these libs are preloaded and must be required before used
 */
 static const luaL_Reg preloadedlibs[] = {
+#if defined(LUA_USE_SCHED)
+  {LUA_SCHEDLIBNAME, luaopen_sched},
+#endif
   {NULL, NULL}
 };
 
@@ -195,41 +195,148 @@ static int math_max (lua_State *L) {
 }
 
 
-static int math_random (lua_State *L) {
-  /* the `%' avoids the (rare) case of r==1, and is needed also because on
-     some systems (SunOS!) `rand()' may return a value larger than RAND_MAX */
-  lua_Number r = (lua_Number)(rand()%RAND_MAX) / (lua_Number)RAND_MAX;
-  switch (lua_gettop(L)) {  /* check number of arguments */
-    case 0: {  /* no arguments */
-      lua_pushnumber(L, r);  /* Number between 0 and 1 */
-      break;
-    }
+/*
+** {==================================================================
+** Pseudo-random number generator: xoshiro128** (by David Blackman and
+** Sebastiano Vigna). Each state has its own generator, kept in a
+** userdata shared as an upvalue by the functions that use it.
+** ===================================================================
+*/
+
+typedef unsigned LUA_INT32 Rand32;
+
+#define trim32(x)	((x) & 0xffffffffu)
+
+/* rotate left 'x' by 'n' bits */
+#define rotl(x,n)	(trim32((x) << (n)) | (trim32(x) >> (32 - (n))))
+
+typedef struct RanState {
+  Rand32 s[4];
+} RanState;
+
+
+static Rand32 nextrand (Rand32 *s) {
+  Rand32 res = trim32(rotl(trim32(s[1] * 5), 7) * 9);
+  Rand32 t = trim32(s[1] << 9);
+  s[2] ^= s[0];
+  s[3] ^= s[1];
+  s[1] ^= s[2];
+  s[0] ^= s[3];
+  s[2] ^= t;
+  s[3] = rotl(s[3], 11);
+  return res;
+}
+
+
+/* uniform number in [0, 1) with 53 random bits */
+static lua_Number randfloat (Rand32 *s) {
+  Rand32 hi = nextrand(s) >> 5;  /* 27 bits */
+  Rand32 lo = nextrand(s) >> 6;  /* 26 bits */
+  return ((lua_Number)hi * (lua_Number)67108864.0 + (lua_Number)lo) *
+         ((lua_Number)0.5 / (lua_Number)4503599627370496.0);  /* 2^-53 */
+}
+
+
+static void setseed (Rand32 *s, lua_Unsigned n) {
+  int i;
+  s[0] = trim32((Rand32)n);
+  s[1] = 0xff;  /* avoid a zero state */
+  s[2] = 0;
+  s[3] = 0;
+  for (i = 0; i < 16; i++)
+    (void)nextrand(s);  /* discard initial values to "spread" seed */
+}
+
+
+/*
+** reads the optional interval arguments starting at 'arg' (see
+** 'math.random') into 'lo' and 'up'; returns 0 when there are none
+*/
+static int getinterval (lua_State *L, int arg, lua_Number *lo,
+                                               lua_Number *up) {
+  switch (lua_gettop(L) - arg + 1) {  /* check number of arguments */
+    case 0: return 0;  /* no arguments: numbers between 0 and 1 */
     case 1: {  /* only upper limit */
-      lua_Number u = luaL_checknumber(L, 1);
-      luaL_argcheck(L, (lua_Number)1.0 <= u, 1, "interval is empty");
-      lua_pushnumber(L, l_mathop(floor)(r*u) + (lua_Number)(1.0));  /* [1, u] */
-      break;
+      *lo = 1;
+      *up = luaL_checknumber(L, arg);
+      luaL_argcheck(L, (lua_Number)1.0 <= *up, arg, "interval is empty");
+      return 1;
     }
     case 2: {  /* lower and upper limits */
-      lua_Number l = luaL_checknumber(L, 1);
-      lua_Number u = luaL_checknumber(L, 2);
-      luaL_argcheck(L, l <= u, 2, "interval is empty");
-      lua_pushnumber(L, l_mathop(floor)(r*(u-l+1)) + l);  /* [l, u] */
-      break;
+      *lo = luaL_checknumber(L, arg);
+      *up = luaL_checknumber(L, arg + 1);
+      luaL_argcheck(L, *lo <= *up, arg + 1, "interval is empty");
+      return 1;
     }
     default: return luaL_error(L, "wrong number of arguments");
   }
+}
+
+
+#define inrange(r,lo,up)	(l_mathop(floor)((r)*((up)-(lo)+1)) + (lo))
+
+
+static int math_random (lua_State *L) {
+  RanState *g = (RanState *)lua_touserdata(L, lua_upvalueindex(1));
+  lua_Number r = randfloat(g->s);
+  lua_Number lo, up;
+  if (getinterval(L, 1, &lo, &up))
+    r = inrange(r, lo, up);  /* [lo, up] */
+  lua_pushnumber(L, r);
   return 1;
 }
 
 
+static int math_randomfill (lua_State *L) {
+  RanState *g = (RanState *)lua_touserdata(L, lua_upvalueindex(1));
+  int n = luaL_checkint(L, 2);
+  int i;
+  lua_Number lo, up;
+  luaL_checktype(L, 1, LUA_TTABLE);
+  if (getinterval(L, 3, &lo, &up)) {
+    for (i = 1; i <= n; i++) {
+      lua_pushnumber(L, inrange(randfloat(g->s), lo, up));
+      lua_rawseti(L, 1, i);
+    }
+  }
+  else {
+    for (i = 1; i <= n; i++) {
+      lua_pushnumber(L, randfloat(g->s));
+      lua_rawseti(L, 1, i);
+    }
+  }
+  lua_settop(L, 1);
+  return 1;  /* return the table */
+}
+
+
 static int math_randomseed (lua_State *L) {
-  srand(luaL_checkunsigned(L, 1));
-  (void)rand(); /* discard first value to avoid undesirable correlations */
+  RanState *g = (RanState *)lua_touserdata(L, lua_upvalueindex(1));
+  setseed(g->s, luaL_checkunsigned(L, 1));
   return 0;
 }
 
 
+static const luaL_Reg randfuncs[] = {
+  {"random",     math_random},
+  {"randomfill", math_randomfill},
+  {"randomseed", math_randomseed},
+  {NULL, NULL}
+};
+
+
+/*
+** register random functions with their (new) generator as upvalue
+*/
+static void setrandfuncs (lua_State *L) {
+  RanState *g = (RanState *)lua_newuserdata(L, sizeof(RanState));
+  setseed(g->s, 0);
+  luaL_setfuncs(L, randfuncs, 1);
+}
+
+/* }================================================================== */
+
+
 static const luaL_Reg mathlib[] = {
   {"abs",   math_abs},
   {"acos",  math_acos},
@@ -254,8 +361,6 @@ static const luaL_Reg mathlib[] = {
   {"modf",   math_modf},
   {"pow",   math_pow},
   {"rad",   math_rad},
-  {"random",     math_random},
-  {"randomseed", math_randomseed},
   {"sinh",   math_sinh},
   {"sin",   math_sin},
   {"sqrt",  math_sqrt},
@@ -270,6 +375,7 @@ static const luaL_Reg mathlib[] = {
 */
 LUAMOD_API int luaopen_math (lua_State *L) {
   luaL_newlib(L, mathlib);
+  setrandfuncs(L);
   lua_pushnumber(L, PI);
   lua_setfield(L, -2, "pi");
   lua_pushnumber(L, HUGE_VAL);
@@ -44,7 +44,7 @@
 
 
 void *luaM_growaux_ (lua_State *L, void *block, int *size, size_t size_elems,
-                     int limit, const char *what) {
+                     int limit, const char *what, int tt) {
   void *newblock;
   int newsize;
   if (*size >= limit/2) {  /* cannot double it? */
@@ -57,7 +57,10 @@ void *luaM_growaux_ (lua_State *L, void *block, int *size, size_t size_elems,
     if (newsize < MINSIZEARRAY)
       newsize = MINSIZEARRAY;  /* minimum size */
   }
-  newblock = luaM_reallocv(L, block, *size, newsize, size_elems);
+  if (tt < 0)
+    newblock = luaM_reallocv(L, block, *size, newsize, size_elems);
+  else
+    newblock = luaM_reallocvt(L, block, *size, newsize, size_elems, tt);
   *size = newsize;  /* update only when everything else is OK */
   return newblock;
 }
@@ -97,3 +100,17 @@ void *luaM_realloc_ (lua_State *L, void *block, size_t osize, size_t nsize) {
   return newblock;
 }
 
+
+/*
+** allocation routine for a part owned by an object of type 'tt'
+** (a type tag without variant bits)
+*/
+void *luaM_reallocowned_ (lua_State *L, void *block, size_t osize,
+                                        size_t nsize, int tt) {
+  global_State *g = G(L);
+  size_t realosize = (block) ? osize : 0;
+  void *newblock = luaM_realloc_(L, block, osize, nsize);
+  g->objbytes[tt] = (g->objbytes[tt] + nsize) - realosize;
+  return newblock;
+}
+
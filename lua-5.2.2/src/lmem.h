@@ -39,19 +39,49 @@
 
 #define luaM_growvector(L,v,nelems,size,t,limit,e) \
           if ((nelems)+1 > (size)) \
-            ((v)=cast(t *, luaM_growaux_(L,v,&(size),sizeof(t),limit,e)))
+            ((v)=cast(t *, luaM_growaux_(L,v,&(size),sizeof(t),limit,e,-1)))
 
 #define luaM_reallocvector(L, v,oldn,n,t) \
    ((v)=cast(t *, luaM_reallocv(L, v, oldn, n, sizeof(t))))
 
+
+/*
+** Variants for the parts owned by an object of type 'tt' (such as the
+** arrays of a table), which charge them to that type in the counters
+** of 'lua_gcobjects'. Such a part must be allocated and freed by these
+** macros only.
+*/
+#define luaM_reallocvt(L,b,on,n,e,tt) \
+  (cast(void, \
+     (cast(size_t, (n)+1) > MAX_SIZET/(e)) ? (luaM_toobig(L), 0) : 0), \
+   luaM_reallocowned_(L, (b), (on)*(e), (n)*(e), tt))
+
+#define luaM_newt(L,t,tt) \
+		cast(t *, luaM_reallocowned_(L, NULL, 0, sizeof(t), tt))
+#define luaM_freet(L,b,tt) \
+		luaM_reallocowned_(L, (b), sizeof(*(b)), 0, tt)
+#define luaM_newvectort(L,n,t,tt) \
+		cast(t *, luaM_reallocvt(L, NULL, 0, n, sizeof(t), tt))
+#define luaM_freearrayt(L,b,n,tt) \
+		luaM_reallocvt(L, (b), n, 0, sizeof((b)[0]), tt)
+
+#define luaM_growvectort(L,v,nelems,size,t,limit,e,tt) \
+          if ((nelems)+1 > (size)) \
+            ((v)=cast(t *, luaM_growaux_(L,v,&(size),sizeof(t),limit,e,tt)))
+
+#define luaM_reallocvectort(L,v,oldn,n,t,tt) \
+   ((v)=cast(t *, luaM_reallocvt(L, v, oldn, n, sizeof(t), tt)))
+
 LUAI_FUNC l_noret luaM_toobig (lua_State *L);
 
 /* not to be called directly */
 LUAI_FUNC void *luaM_realloc_ (lua_State *L, void *block, size_t oldsize,
                                                           size_t size);
+LUAI_FUNC void *luaM_reallocowned_ (lua_State *L, void *block,
+                                    size_t oldsize, size_t size, int tt);
 LUAI_FUNC void *luaM_growaux_ (lua_State *L, void *block, int *size,
                                size_t size_elem, int limit,
-                               const char *what);
+                               const char *what, int tt);
 
 #endif
 
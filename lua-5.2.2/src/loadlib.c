@@ -327,6 +327,126 @@ static int ll_loadlib (lua_State *L) {
 */
 
 
+#if defined(LUA_USE_DIRCACHE)
+/*
+** {======================================================
+** Cache of directory listings: each directory in a path is listed
+** once, and a candidate file is looked up in the listing instead of
+** being opened. The listing is checked against the directory
+** modification time on every lookup, so it is never out of date and a
+** name that is not listed does not exist. With LUA_DIRCACHE_FOLDCASE,
+** for file systems that ignore case, names are compared case-folded.
+** =======================================================
+*/
+
+#include <ctype.h>
+#include <dirent.h>
+#include <sys/stat.h>
+#include <time.h>
+
+/* table (in the registry) with the cached listings, indexed by directory */
+#define DIRCACHE	"_DIRCACHE"
+
+
+/*
+** push file name 'name' as it is kept in the listings
+*/
+#if defined(LUA_DIRCACHE_FOLDCASE)
+static void pushname (lua_State *L, const char *name) {
+  luaL_Buffer b;
+  luaL_buffinit(L, &b);
+  for (; *name; name++)
+    luaL_addchar(&b, tolower((unsigned char)*name));
+  luaL_pushresult(&b);
+}
+#else
+#define pushname(L,name)	lua_pushstring(L, name)
+#endif
+
+
+/*
+** fill table on top of the stack with the names in directory 'dir'
+*/
+static void listdir (lua_State *L, const char *dir) {
+  DIR *d = opendir(dir);
+  struct dirent *e;
+  if (d == NULL) return;  /* unreadable directory: empty listing */
+  while ((e = readdir(d)) != NULL) {
+    pushname(L, e->d_name);
+    lua_pushboolean(L, 1);
+    lua_rawset(L, -3);
+  }
+  closedir(d);
+}
+
+
+/*
+** push the listing of directory 'dir', (re)building it if it is not
+** cached or if the directory was changed since it was built. Push
+** nothing and return 0 if the directory does not exist.
+*/
+static int pushlisting (lua_State *L, const char *dir) {
+  struct stat st;
+  lua_Number mtime;
+  if (stat(dir, &st) != 0)
+    return 0;
+  mtime = (lua_Number)st.st_mtime;
+  luaL_getsubtable(L, LUA_REGISTRYINDEX, DIRCACHE);
+  lua_getfield(L, -1, dir);
+  if (!lua_istable(L, -1)) {  /* create entry */
+    lua_pop(L, 1);
+    lua_createtable(L, 0, 3);
+    lua_pushvalue(L, -1);
+    lua_setfield(L, -3, dir);
+  }
+  lua_getfield(L, -1, "mtime");
+  lua_getfield(L, -2, "scanned");
+  /* a listing made in the same second as a change may have missed it */
+  if (lua_isnil(L, -1) || lua_tonumber(L, -2) != mtime ||
+      lua_tonumber(L, -1) <= mtime) {
+    lua_pop(L, 2);
+    lua_newtable(L);
+    listdir(L, dir);
+    lua_setfield(L, -2, "files");
+    lua_pushnumber(L, mtime);
+    lua_setfield(L, -2, "mtime");
+    lua_pushnumber(L, (lua_Number)time(NULL));
+    lua_setfield(L, -2, "scanned");
+  }
+  else lua_pop(L, 2);
+  lua_getfield(L, -1, "files");
+  lua_replace(L, -3);  /* listing replaces cache table */
+  lua_pop(L, 1);  /* remove entry */
+  return 1;
+}
+
+
+static int cachedreadable (lua_State *L, const char *filename) {
+  const char *base = strrchr(filename, *LUA_DIRSEP);
+  int listed;
+  if (base == NULL) {  /* file in current directory? */
+    lua_pushliteral(L, ".");
+    base = filename;
+  }
+  else
+    lua_pushlstring(L, filename, ++base - filename);  /* keep separator */
+  if (!pushlisting(L, lua_tostring(L, -1))) {
+    lua_pop(L, 1);  /* remove directory */
+    return 0;  /* no such directory */
+  }
+  pushname(L, base);
+  lua_rawget(L, -2);
+  listed = lua_toboolean(L, -1);
+  lua_pop(L, 3);  /* remove directory, listing, and result */
+  return listed;  /* the listing is up to date: not listed means absent */
+}
+
+#define readable(L,f)	cachedreadable(L,f)
+
+/* }====================================================== */
+
+#else
+
 static int readable (const char *filename) {
   FILE *f = fopen(filename, "r");  /* try to open file */
   if (f == NULL) return 0;  /* open failed */
@@ -334,6 +454,10 @@ static int readable (const char *filename) {
   return 1;
 }
 
+#define readable(L,f)	readable(f)
+
+#endif
+
 
 static const char *pushnexttemplate (lua_State *L, const char *path) {
   const char *l;
@@ -358,7 +482,7 @@ static const char *searchpath (lua_State *L, const char *name,
     const char *filename = luaL_gsub(L, lua_tostring(L, -1),
                                      LUA_PATH_MARK, name);
     lua_remove(L, -2);  /* remove path template */
-    if (readable(filename))  /* does file exist and is readable? */
+    if (readable(L, filename))  /* does file exist and is readable? */
       return filename;  /* return that file name */
     lua_pushfstring(L, "\n\tno file " LUA_QS, filename);
     lua_remove(L, -2);  /* remove file name */
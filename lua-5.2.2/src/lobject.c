@@ -155,8 +155,359 @@ static lua_Number lua_strx2number (const char *s, char **endptr) {
 #endif
 
 
+#if defined(LUA_FASTNUMCONV)	/* { */
+
+/*
+** {======================================================
+** Fast number conversions
+** =======================================================
+*/
+
+/* largest number of significant digits read exactly into a double */
+#define MAXSIGDIGITS	15
+
+/* powers of 10 that are exact doubles */
+static const lua_Number exactpow10[] = {
+  1e0, 1e1, 1e2, 1e3, 1e4, 1e5, 1e6, 1e7, 1e8, 1e9, 1e10, 1e11,
+  1e12, 1e13, 1e14, 1e15, 1e16, 1e17, 1e18, 1e19, 1e20, 1e21, 1e22
+};
+
+
+/*
+** read a decimal numeral with at most MAXSIGDIGITS significant digits
+** and a small exponent; such numerals are converted exactly with a
+** single multiplication or division. Returns 0 for any other string,
+** which then goes to 'lua_str2number'.
+*/
+static int fastdecimal (const char *s, size_t len, lua_Number *result) {
+  const char *end = s + len;
+  lua_Number m = 0;
+  int neg = 0, nd = 0, e = 0, anydigit = 0;
+  while (lisspace(cast_uchar(*s))) s++;  /* skip initial spaces */
+  if (*s == '-') { s++; neg = 1; }
+  else if (*s == '+') s++;
+  for (; lisdigit(cast_uchar(*s)); s++) {  /* integer part */
+    anydigit = 1;
+    if (nd == 0 && *s == '0') continue;  /* skip leading zeros */
+    if (++nd > MAXSIGDIGITS) return 0;
+    m = m * 10 + (*s - '0');
+  }
+  if (*s == '.') {
+    for (s++; lisdigit(cast_uchar(*s)); s++) {  /* fractional part */
+      anydigit = 1;
+      e--;
+      if (nd == 0 && *s == '0') continue;  /* skip leading zeros */
+      if (++nd > MAXSIGDIGITS) return 0;
+      m = m * 10 + (*s - '0');
+    }
+  }
+  if (!anydigit) return 0;
+  if (*s == 'e' || *s == 'E') {  /* exponent part? */
+    int exp1 = 0, neg1 = 0;
+    s++;
+    if (*s == '-') { s++; neg1 = 1; }
+    else if (*s == '+') s++;
+    if (!lisdigit(cast_uchar(*s))) return 0;
+    for (; lisdigit(cast_uchar(*s)); s++)
+      if (exp1 < 1000) exp1 = exp1 * 10 + (*s - '0');
+    e += (neg1) ? -exp1 : exp1;
+  }
+  while (lisspace(cast_uchar(*s))) s++;  /* skip trailing spaces */
+  if (s != end) return 0;  /* invalid trailing characters */
+  if (m == 0) e = 0;  /* zero has no magnitude */
+  if (e < -22 || e > 22) return 0;
+  m = (e < 0) ? m / exactpow10[-e] : m * exactpow10[e];
+  *result = (neg) ? -m : m;
+  return 1;
+}
+
+
+/* write unsigned 'u' in decimal at 'buff'; returns number of chars */
+static int writeuint (char *buff, unsigned long long u) {
+  char aux[24];
+  int n = 0, i;
+  do {
+    aux[n++] = cast(char, '0' + cast_int(u % 10));
+    u /= 10;
+  } while (u != 0);
+  for (i = 0; i < n; i++) buff[i] = aux[n - 1 - i];
+  return n;
+}
+
+
+#if defined(LUA_NUMBER_SHORTEST)	/* { */
+
+/*
+** Grisu2 (Florian Loitsch, "Printing Floating-Point Numbers Quickly and
+** Accurately with Integers", 2010): generates a short sequence of
+** digits that reads back as the same double.
+*/
+
+typedef unsigned long long l_u64;
+
+typedef struct DiyFp {
+  l_u64 f;
+  int e;
+} DiyFp;
+
+#define DP_SIGNIFICAND	52
+#define DP_HIDDENBIT	((l_u64)1 << DP_SIGNIFICAND)
+#define DP_EXPBIAS	(0x3FF + DP_SIGNIFICAND)
+
+/* normalized 64-bit approximations of 10^(-348 + 8*i) */
+static const l_u64 cachedpow_f[] = {
+  0xfa8fd5a0081c0288ULL, 0xbaaee17fa23ebf76ULL, 0x8b16fb203055ac76ULL,
+  0xcf42894a5dce35eaULL, 0x9a6bb0aa55653b2dULL, 0xe61acf033d1a45dfULL,
+  0xab70fe17c79ac6caULL, 0xff77b1fcbebcdc4fULL, 0xbe5691ef416bd60cULL,
+  0x8dd01fad907ffc3cULL, 0xd3515c2831559a83ULL, 0x9d71ac8fada6c9b5ULL,
+  0xea9c227723ee8bcbULL, 0xaecc49914078536dULL, 0x823c12795db6ce57ULL,
+  0xc21094364dfb5637ULL, 0x9096ea6f3848984fULL, 0xd77485cb25823ac7ULL,
+  0xa086cfcd97bf97f4ULL, 0xef340a98172aace5ULL, 0xb23867fb2a35b28eULL,
+  0x84c8d4dfd2c63f3bULL, 0xc5dd44271ad3cdbaULL, 0x936b9fcebb25c996ULL,
+  0xdbac6c247d62a584ULL, 0xa3ab66580d5fdaf6ULL, 0xf3e2f893dec3f126ULL,
+  0xb5b5ada8aaff80b8ULL, 0x87625f056c7c4a8bULL, 0xc9bcff6034c13053ULL,
+  0x964e858c91ba2655ULL, 0xdff9772470297ebdULL, 0xa6dfbd9fb8e5b88fULL,
+  0xf8a95fcf88747d94ULL, 0xb94470938fa89bcfULL, 0x8a08f0f8bf0f156bULL,
+  0xcdb02555653131b6ULL, 0x993fe2c6d07b7facULL, 0xe45c10c42a2b3b06ULL,
+  0xaa242499697392d3ULL, 0xfd87b5f28300ca0eULL, 0xbce5086492111aebULL,
+  0x8cbccc096f5088ccULL, 0xd1b71758e219652cULL, 0x9c40000000000000ULL,
+  0xe8d4a51000000000ULL, 0xad78ebc5ac620000ULL, 0x813f3978f8940984ULL,
+  0xc097ce7bc90715b3ULL, 0x8f7e32ce7bea5c70ULL, 0xd5d238a4abe98068ULL,
+  0x9f4f2726179a2245ULL, 0xed63a231d4c4fb27ULL, 0xb0de65388cc8ada8ULL,
+  0x83c7088e1aab65dbULL, 0xc45d1df942711d9aULL, 0x924d692ca61be758ULL,
+  0xda01ee641a708deaULL, 0xa26da3999aef774aULL, 0xf209787bb47d6b85ULL,
+  0xb454e4a179dd1877ULL, 0x865b86925b9bc5c2ULL, 0xc83553c5c8965d3dULL,
+  0x952ab45cfa97a0b3ULL, 0xde469fbd99a05fe3ULL, 0xa59bc234db398c25ULL,
+  0xf6c69a72a3989f5cULL, 0xb7dcbf5354e9beceULL, 0x88fcf317f22241e2ULL,
+  0xcc20ce9bd35c78a5ULL, 0x98165af37b2153dfULL, 0xe2a0b5dc971f303aULL,
+  0xa8d9d1535ce3b396ULL, 0xfb9b7cd9a4a7443cULL, 0xbb764c4ca7a44410ULL,
+  0x8bab8eefb6409c1aULL, 0xd01fef10a657842cULL, 0x9b10a4e5e9913129ULL,
+  0xe7109bfba19c0c9dULL, 0xac2820d9623bf429ULL, 0x80444b5e7aa7cf85ULL,
+  0xbf21e44003acdd2dULL, 0x8e679c2f5e44ff8fULL, 0xd433179d9c8cb841ULL,
+  0x9e19db92b4e31ba9ULL, 0xeb96bf6ebadf77d9ULL, 0xaf87023b9bf0ee6bULL
+};
+
+static const short cachedpow_e[] = {
+  -1220, -1193, -1166, -1140, -1113, -1087, -1060, -1034, -1007, -980,
+  -954, -927, -901, -874, -847, -821, -794, -768, -741, -715,
+  -688, -661, -635, -608, -582, -555, -529, -502, -475, -449,
+  -422, -396, -369, -343, -316, -289, -263, -236, -210, -183,
+  -157, -130, -103, -77, -50, -24, 3, 30, 56, 83,
+  109, 136, 162, 189, 216, 242, 269, 295, 322, 348,
+  375, 402, 428, 455, 481, 508, 534, 561, 588, 614,
+  641, 667, 694, 720, 747, 774, 800, 827, 853, 880,
+  907, 933, 960, 986, 1013, 1039, 1066
+};
+
+static const unsigned int pow10u[] = {
+  1, 10, 100, 1000, 10000, 100000, 1000000, 10000000, 100000000,
+  1000000000
+};
+
+
+static DiyFp diyfp (l_u64 f, int e) {
+  DiyFp r;
+  r.f = f; r.e = e;
+  return r;
+}
+
+
+static DiyFp diyfp_mul (DiyFp x, DiyFp y) {
+  const l_u64 m32 = 0xFFFFFFFFu;
+  l_u64 a = x.f >> 32, b = x.f & m32, c = y.f >> 32, d = y.f & m32;
+  l_u64 ac = a * c, bc = b * c, ad = a * d, bd = b * d;
+  l_u64 tmp = (bd >> 32) + (ad & m32) + (bc & m32);
+  tmp += (l_u64)1 << 31;  /* round */
+  return diyfp(ac + (ad >> 32) + (bc >> 32) + (tmp >> 32), x.e + y.e + 64);
+}
+
+
+static DiyFp diyfp_normalize (DiyFp x) {
+  while (!(x.f & ((l_u64)1 << 63))) { x.f <<= 1; x.e--; }
+  return x;
+}
+
+
+static void grisuround (char *buff, int len, l_u64 delta, l_u64 rest,
+                        l_u64 tenkappa, l_u64 wpw) {
+  while (rest < wpw && delta - rest >= tenkappa &&
+         (rest + tenkappa < wpw || wpw - rest > rest + tenkappa - wpw)) {
+    buff[len - 1]--;
+    rest += tenkappa;
+  }
+}
+
+
+static int countdigits (unsigned int n) {
+  int k = 1;
+  while (k < 10 && n >= pow10u[k]) k++;
+  return k;
+}
+
+
+static int digitgen (DiyFp w, DiyFp mp, l_u64 delta, char *buff, int *k) {
+  DiyFp one = diyfp((l_u64)1 << -mp.e, mp.e);
+  l_u64 wpw = mp.f - w.f;
+  unsigned int p1 = cast(unsigned int, mp.f >> -one.e);
+  l_u64 p2 = mp.f & (one.f - 1);
+  int kappa = countdigits(p1);
+  int len = 0;
+  while (kappa > 0) {
+    l_u64 tmp;
+    unsigned int d = p1 / pow10u[kappa - 1];
+    p1 %= pow10u[kappa - 1];
+    if (d || len) buff[len++] = cast(char, '0' + d);
+    kappa--;
+    tmp = ((l_u64)p1 << -one.e) + p2;
+    if (tmp <= delta) {
+      *k += kappa;
+      grisuround(buff, len, delta, tmp, (l_u64)pow10u[kappa] << -one.e, wpw);
+      return len;
+    }
+  }
+  for (;;) {  /* kappa <= 0 */
+    unsigned int d;
+    p2 *= 10;
+    delta *= 10;
+    d = cast(unsigned int, p2 >> -one.e);
+    if (d || len) buff[len++] = cast(char, '0' + d);
+    p2 &= one.f - 1;
+    kappa--;
+    if (p2 < delta) {
+      *k += kappa;
+      grisuround(buff, len, delta, p2, one.f,
+                 (-kappa < 10) ? wpw * pow10u[-kappa] : 0);
+      return len;
+    }
+  }
+}
+
+
+/*
+** digits of 'v' (finite and positive) go to 'buff'; its value is
+** digits * 10^k. Returns the number of digits.
+*/
+static int grisu2 (double v, char *buff, int *k) {
+  union { double d; l_u64 u; } u;
+  DiyFp w, wp, wm, c;
+  int biased, idx;
+  double dk;
+  u.d = v;
+  biased = cast_int((u.u >> DP_SIGNIFICAND) & 0x7FF);
+  w.f = u.u & (DP_HIDDENBIT - 1);
+  if (biased != 0) { w.f += DP_HIDDENBIT; w.e = biased - DP_EXPBIAS; }
+  else w.e = 1 - DP_EXPBIAS;
+  /* boundaries m+ and m- of 'v', with the same exponent */
+  wp = diyfp((w.f << 1) + 1, w.e - 1);
+  while (!(wp.f & (DP_HIDDENBIT << 1))) { wp.f <<= 1; wp.e--; }
+  wp.f <<= 64 - DP_SIGNIFICAND - 2;
+  wp.e -= 64 - DP_SIGNIFICAND - 2;
+  wm = (w.f == DP_HIDDENBIT) ? diyfp((w.f << 2) - 1, w.e - 2)
+                             : diyfp((w.f << 1) - 1, w.e - 1);
+  wm.f <<= wm.e - wp.e;
+  wm.e = wp.e;
+  /* cached power c = 10^-k such that the product exponent is small */
+  dk = (-61 - wp.e) * 0.30102999566398114 + 347;
+  idx = cast_int(dk);
+  if (dk - idx > 0.0) idx++;
+  idx = (idx >> 3) + 1;
+  *k = -(-348 + idx * 8);
+  c = diyfp(cachedpow_f[idx], cachedpow_e[idx]);
+  w = diyfp_mul(diyfp_normalize(w), c);
+  wp = diyfp_mul(wp, c);
+  wm = diyfp_mul(wm, c);
+  wm.f++;
+  wp.f--;
+  return digitgen(w, wp, wp.f - wm.f, buff, k);
+}
+
+
+/* write exponent in the style of '%g' (sign and at least 2 digits) */
+static int writeexp (char *buff, int e) {
+  int n = 0;
+  buff[n++] = 'e';
+  buff[n++] = (e < 0) ? '-' : '+';
+  if (e < 0) e = -e;
+  if (e < 10) buff[n++] = '0';
+  return n + writeuint(buff + n, cast(unsigned int, e));
+}
+
+
+/*
+** shortest round-trip representation of a finite, non-zero 'n', laid
+** out as '%.17g' would (exponent notation for exponents < -4 or >= 17)
+*/
+static int shortest (char *buff, lua_Number n) {
+  char digits[20];
+  int k, nd, x, n0 = 0, i;
+  if (n < 0) { buff[n0++] = '-'; n = -n; }
+  nd = grisu2(n, digits, &k);
+  x = nd + k - 1;  /* exponent of first digit */
+  if (x < -4 || x >= 17) {  /* exponent notation */
+    buff[n0++] = digits[0];
+    if (nd > 1) {
+      buff[n0++] = '.';
+      for (i = 1; i < nd; i++) buff[n0++] = digits[i];
+    }
+    return n0 + writeexp(buff + n0, x);
+  }
+  else if (x < 0) {  /* 0.000ddd */
+    buff[n0++] = '0';
+    buff[n0++] = '.';
+    for (i = x + 1; i < 0; i++) buff[n0++] = '0';
+    for (i = 0; i < nd; i++) buff[n0++] = digits[i];
+  }
+  else {  /* ddd[.ddd] or ddd000 */
+    for (i = 0; i < nd || i <= x; i++) {
+      if (i == x + 1) buff[n0++] = '.';
+      buff[n0++] = (i < nd) ? digits[i] : '0';
+    }
+  }
+  return n0;
+}
+
+#endif				/* } */
+
+
+/*
+** integral values with at most 14 digits (which '%.14g' prints exactly)
+** are written directly; with LUA_NUMBER_SHORTEST, other finite values
+** are written with their shortest round-trip representation
+*/
+int luaO_num2str (char *buff, lua_Number n) {
+  lua_Number a = (n < 0) ? -n : n;
+  if (a < 1e14 && (n != 0 || 1 / n > 0)) {  /* (not -0) */
+    unsigned long long u = cast(unsigned long long, a);
+    if (cast_num(u) == a) {  /* integral value? */
+      int l = 0;
+      if (n < 0) buff[l++] = '-';
+      return l + writeuint(buff + l, u);
+    }
+  }
+#if defined(LUA_NUMBER_SHORTEST)
+  if (n != 0 && luai_numeq(n - n, 0))  /* finite and non-zero? */
+    return shortest(buff, n);
+#endif
+  return lua_number2str(buff, n);
+}
+
+/* }====================================================== */
+
+#else				/* }{ */
+
+int luaO_num2str (char *buff, lua_Number n) {
+  return lua_number2str(buff, n);
+}
+
+#endif				/* } */
+
+
 int luaO_str2d (const char *s, size_t len, lua_Number *result) {
   char *endptr;
+#if defined(LUA_FASTNUMCONV)
+  if (fastdecimal(s, len, result))
+    return 1;
+#endif
   if (strpbrk(s, "nN"))  /* reject 'inf' and 'nan' */
     return 0;
   else if (strpbrk(s, "xX"))  /* hexa? */
@@ -225,7 +576,11 @@ const char *luaO_pushvfstring (lua_State *L, const char *fmt, va_list argp) {
   }
   luaD_checkstack(L, 1);
   pushstr(L, fmt, strlen(fmt));
-  if (n > 0) luaV_concat(L, n + 1);
+  if (n > 0) {
+    luaV_concat(L, n + 1);
+    /* the result may be a rope; callers want its contents */
+    setsvalue2s(L, L->top - 1, luaS_plain(L, rawtsvalue(L->top - 1)));
+  }
   return svalue(L->top - 1);
 }
 
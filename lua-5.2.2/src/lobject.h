@@ -55,6 +55,7 @@
 /* Variant tags for strings */
 #define LUA_TSHRSTR	(LUA_TSTRING | (0 << 4))  /* short strings */
 #define LUA_TLNGSTR	(LUA_TSTRING | (1 << 4))  /* long strings */
+#define LUA_TROPE	(LUA_TSTRING | (2 << 4))  /* pending concatenations */
 
 
 /* Bit mark for collectable types */
@@ -137,6 +138,7 @@ typedef struct lua_TValue TValue;
 #define ttisstring(o)		checktype((o), LUA_TSTRING)
 #define ttisshrstring(o)	checktag((o), ctb(LUA_TSHRSTR))
 #define ttislngstring(o)	checktag((o), ctb(LUA_TLNGSTR))
+#define ttisrope(o)		checktag((o), ctb(LUA_TROPE))
 #define ttistable(o)		checktag((o), ctb(LUA_TTABLE))
 #define ttisfunction(o)		checktype(o, LUA_TFUNCTION)
 #define ttisclosure(o)		((rttype(o) & 0x1F) == LUA_TFUNCTION)
@@ -419,12 +421,26 @@ typedef union TString {
 
 
 /* get the actual string (array of bytes) from a TString */
-#define getstr(ts)	cast(const char *, (ts) + 1)
+#define getstr(ts)  \
+	check_exp((ts)->tsv.tt != LUA_TROPE, cast(const char *, (ts) + 1))
 
 /* get the actual string (array of bytes) from a Lua value */
 #define svalue(o)       getstr(rawtsvalue(o))
 
 
+/*
+** Rope: a long string produced by a concatenation whose contents are
+** only built when needed. 'left' is the prefix (a string or another
+** rope) and 'right' the suffix (always a plain string). Once built,
+** 'left' is the resulting plain string and 'right' is NULL.
+*/
+typedef struct Rope {
+  TString ts;  /* header; 'extra' and 'hash' work as in long strings */
+  TString *left;
+  TString *right;
+} Rope;
+
+
 /*
 ** Header for userdata; memory area follows the end of this structure
 */
@@ -486,6 +502,7 @@ typedef struct Proto {
   lu_byte numparams;  /* number of fixed parameters */
   lu_byte is_vararg;
   lu_byte maxstacksize;  /* maximum stack used by this function */
+  unsigned short hooked;  /* number of hook filters that include it */
 } Proto;
 
 
@@ -561,6 +578,7 @@ typedef struct Table {
   CommonHeader;
   lu_byte flags;  /* 1<<p means tagmethod(p) is not present */
   lu_byte lsizenode;  /* log2 of size of `node' array */
+  int lastnext;  /* node of last key returned by `next' (a hint) */
   struct Table *metatable;
   TValue *array;  /* array part */
   Node *node;
@@ -596,6 +614,7 @@ LUAI_FUNC int luaO_fb2int (int x);
 LUAI_FUNC int luaO_ceillog2 (unsigned int x);
 LUAI_FUNC lua_Number luaO_arith (int op, lua_Number v1, lua_Number v2);
 LUAI_FUNC int luaO_str2d (const char *s, size_t len, lua_Number *result);
+LUAI_FUNC int luaO_num2str (char *buff, lua_Number n);
 LUAI_FUNC int luaO_hexavalue (int c);
 LUAI_FUNC const char *luaO_pushvfstring (lua_State *L, const char *fmt,
                                                        va_list argp);
@@ -166,8 +166,8 @@ static int registerlocalvar (LexState *ls, TString *varname) {
   FuncState *fs = ls->fs;
   Proto *f = fs->f;
   int oldsize = f->sizelocvars;
-  luaM_growvector(ls->L, f->locvars, fs->nlocvars, f->sizelocvars,
-                  LocVar, SHRT_MAX, "local variables");
+  luaM_growvectort(ls->L, f->locvars, fs->nlocvars, f->sizelocvars,
+                   LocVar, SHRT_MAX, "local variables", LUA_TPROTO);
   while (oldsize < f->sizelocvars) f->locvars[oldsize++].varname = NULL;
   f->locvars[fs->nlocvars].varname = varname;
   luaC_objbarrier(ls->L, f, varname);
@@ -232,8 +232,8 @@ static int newupvalue (FuncState *fs, TString *name, expdesc *v) {
   Proto *f = fs->f;
   int oldsize = f->sizeupvalues;
   checklimit(fs, fs->nups + 1, MAXUPVAL, "upvalues");
-  luaM_growvector(fs->ls->L, f->upvalues, fs->nups, f->sizeupvalues,
-                  Upvaldesc, MAXUPVAL, "upvalues");
+  luaM_growvectort(fs->ls->L, f->upvalues, fs->nups, f->sizeupvalues,
+                   Upvaldesc, MAXUPVAL, "upvalues", LUA_TPROTO);
   while (oldsize < f->sizeupvalues) f->upvalues[oldsize++].name = NULL;
   f->upvalues[fs->nups].instack = (v->k == VLOCAL);
   f->upvalues[fs->nups].idx = cast_byte(v->u.info);
@@ -502,7 +502,8 @@ static Proto *addprototype (LexState *ls) {
   Proto *f = fs->f;  /* prototype of current function */
   if (fs->np >= f->sizep) {
     int oldsize = f->sizep;
-    luaM_growvector(L, f->p, fs->np, f->sizep, Proto *, MAXARG_Bx, "functions");
+    luaM_growvectort(L, f->p, fs->np, f->sizep, Proto *, MAXARG_Bx,
+                     "functions", LUA_TPROTO);
     while (oldsize < f->sizep) f->p[oldsize++] = NULL;
   }
   f->p[fs->np++] = clp = luaF_newproto(L);
@@ -558,17 +559,19 @@ static void close_func (LexState *ls) {
   Proto *f = fs->f;
   luaK_ret(fs, 0, 0);  /* final return */
   leaveblock(fs);
-  luaM_reallocvector(L, f->code, f->sizecode, fs->pc, Instruction);
+  luaM_reallocvectort(L, f->code, f->sizecode, fs->pc, Instruction, LUA_TPROTO);
   f->sizecode = fs->pc;
-  luaM_reallocvector(L, f->lineinfo, f->sizelineinfo, fs->pc, int);
+  luaM_reallocvectort(L, f->lineinfo, f->sizelineinfo, fs->pc, int, LUA_TPROTO);
   f->sizelineinfo = fs->pc;
-  luaM_reallocvector(L, f->k, f->sizek, fs->nk, TValue);
+  luaM_reallocvectort(L, f->k, f->sizek, fs->nk, TValue, LUA_TPROTO);
   f->sizek = fs->nk;
-  luaM_reallocvector(L, f->p, f->sizep, fs->np, Proto *);
+  luaM_reallocvectort(L, f->p, f->sizep, fs->np, Proto *, LUA_TPROTO);
   f->sizep = fs->np;
-  luaM_reallocvector(L, f->locvars, f->sizelocvars, fs->nlocvars, LocVar);
+  luaM_reallocvectort(L, f->locvars, f->sizelocvars, fs->nlocvars, LocVar,
+                      LUA_TPROTO);
   f->sizelocvars = fs->nlocvars;
-  luaM_reallocvector(L, f->upvalues, f->sizeupvalues, fs->nups, Upvaldesc);
+  luaM_reallocvectort(L, f->upvalues, f->sizeupvalues, fs->nups, Upvaldesc,
+                      LUA_TPROTO);
   f->sizeupvalues = fs->nups;
   lua_assert(fs->bl == NULL);
   ls->fs = fs->prev;
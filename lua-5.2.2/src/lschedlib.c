@@ -0,0 +1,1034 @@
+/*
+** $Id: lschedlib.c $
+** Task scheduler and message channels
+** See Copyright Notice in lua.h
+*/
+
+/*
+** This library runs tasks (coroutines) over a pool of OS threads.
+** Each worker thread owns a separate lua_State, so states share
+** nothing: values go from one state to another only through
+** channels, which copy them into a flat message. A channel is a
+** lock-free multiple-producer/single-consumer queue; a receiver that
+** finds it empty parks its task (or, outside the workers, blocks its
+** OS thread) until a sender wakes it up.
+*/
+
+
+#include <stddef.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define lschedlib_c
+#define LUA_LIB
+
+#include "lua.h"
+
+#include "lauxlib.h"
+#include "lualib.h"
+
+
+#if defined(LUA_USE_SCHED)
+/*
+** {========================================================================
+** This is an implementation of the scheduler using Posix threads and
+** the gcc atomic builtins.
+** =========================================================================
+*/
+
+#include <pthread.h>
+#include <unistd.h>
+
+
+#define CHANNEL		"sched.channel"
+#define SCHEDULER	"sched.scheduler"
+#define LOCALKEY	"_SCHEDLOCAL"
+#define SCHEDKEY	"_SCHED"
+
+
+/* maximum nesting of tables inside a message */
+#define MAXDEPTH	100
+
+
+#define a_load(p)	__atomic_load_n(p, __ATOMIC_SEQ_CST)
+#define a_store(p,v)	__atomic_store_n(p, v, __ATOMIC_SEQ_CST)
+#define a_xchg(p,v)	__atomic_exchange_n(p, v, __ATOMIC_SEQ_CST)
+#define a_add(p,v)	__atomic_add_fetch(p, v, __ATOMIC_SEQ_CST)
+#define a_cas(p,e,v)	__atomic_compare_exchange_n(p, e, v, 0, \
+				__ATOMIC_SEQ_CST, __ATOMIC_SEQ_CST)
+
+
+/* tags of the values in a message */
+enum { M_NIL, M_FALSE, M_TRUE, M_NUMBER, M_STRING, M_TABLE, M_END,
+       M_CHANNEL };
+
+
+typedef struct Msg {
+  struct Msg *next;
+  size_t size;  /* size of 'data' */
+  int nrefs;  /* number of channels in 'data' */
+  char data[1];  /* the encoded values */
+} Msg;
+
+
+struct Waiter;
+struct Worker;
+
+
+typedef struct Channel {
+  Msg *head;  /* last message pushed (producers' end) */
+  Msg *tail;  /* next message to pop (consumer's end) */
+  Msg stub;
+  struct Waiter *waiter;  /* receiver sleeping on this channel */
+  int poplock;  /* held by the receiver popping a message */
+  int refs;  /* number of handles and messages referring to it */
+} Channel;
+
+
+/*
+** control messages sent to a worker
+*/
+typedef struct Ctl {
+  struct Ctl *next;
+  struct Waiter *wt;  /* task to wake up */
+  Msg *m;  /* code and arguments of a new task (if not NULL) */
+} Ctl;
+
+
+/*
+** a receiver waiting on a channel: a task, or a whole state
+*/
+typedef struct Waiter {
+  struct Worker *w;  /* worker that runs it */
+  lua_State *co;  /* task thread (NULL for a blocked state) */
+  Channel *ch;  /* channel it waits on, or NULL */
+  Msg *held;  /* message popped while a wake-up was already on its way */
+  struct Waiter *prev, *next;  /* list of tasks of 'w' */
+  Ctl wake;  /* wake-up message (at most one is ever pending) */
+} Waiter;
+
+
+typedef struct Worker {
+  pthread_mutex_t lock;
+  pthread_cond_t cond;
+  Ctl *first, *last;  /* pending control messages */
+  struct Sched *s;
+  lua_State *L;  /* state owned by this worker */
+  pthread_t thread;
+  Waiter *cur;  /* task being run */
+  Waiter *tasks;  /* all tasks of this worker */
+  Waiter self;  /* used by receivers blocking the whole state */
+  int runhead, runtail;  /* limits of the run queue */
+} Worker;
+
+
+typedef struct Sched {
+  int nworkers;
+  unsigned int next;  /* round-robin counter for new tasks */
+  int stop;  /* true when workers must finish */
+  struct Local *owner;  /* per-state data of the state owning 's' */
+  Worker main;  /* the state that started the scheduler */
+  Worker *w;
+} Sched;
+
+
+/*
+** per-state data (kept as an upvalue of all library functions)
+*/
+typedef struct Local {
+  char *buff;  /* buffer to encode messages */
+  size_t n;  /* bytes used in 'buff' */
+  size_t size;  /* size of 'buff' */
+  int nrefs;  /* channels encoded in 'buff' */
+  Msg *pending;  /* message being decoded */
+  Worker *w;  /* worker of this state (NULL if no scheduler yet) */
+  int closed;  /* true after the scheduler was shut down */
+} Local;
+
+
+#define tolocal(L)	((Local *)lua_touserdata(L, lua_upvalueindex(1)))
+
+#define tochannel(L)	(*(Channel **)luaL_checkudata(L, 1, CHANNEL))
+
+#define ismain(w)	((w) == &(w)->s->main)
+
+
+
+/*
+** {======================================================
+** Lock-free queue (intrusive MPSC queue with a stub node)
+** =======================================================
+*/
+
+static void qinit (Channel *c) {
+  c->stub.next = NULL;
+  c->head = c->tail = &c->stub;
+}
+
+
+static void qpush (Channel *c, Msg *m) {
+  Msg *prev;
+  m->next = NULL;
+  prev = a_xchg(&c->head, m);
+  a_store(&prev->next, m);  /* link it; consumers see it from now on */
+}
+
+
+/*
+** returns NULL both when the queue is empty and when the next message
+** is still being linked by its producer (which will then wake up any
+** waiter)
+*/
+static Msg *qpop (Channel *c) {
+  Msg *tail = c->tail;
+  Msg *next = a_load(&tail->next);
+  if (tail == &c->stub) {
+    if (next == NULL) return NULL;
+    c->tail = tail = next;
+    next = a_load(&next->next);
+  }
+  if (next != NULL) {
+    c->tail = next;
+    return tail;
+  }
+  if (tail != a_load(&c->head))
+    return NULL;  /* a push is in progress */
+  qpush(c, &c->stub);
+  next = a_load(&tail->next);
+  if (next != NULL) {
+    c->tail = next;
+    return tail;
+  }
+  return NULL;
+}
+
+
+static Msg *trypop (Channel *c) {
+  Msg *m;
+  while (a_xchg(&c->poplock, 1))
+    ;  /* other receivers hold the lock only for a few instructions */
+  m = qpop(c);
+  a_store(&c->poplock, 0);
+  return m;
+}
+
+/* }====================================================== */
+
+
+
+/*
+** {======================================================
+** Messages
+** =======================================================
+*/
+
+static void releasechannel (Channel *c);
+
+
+static void adjustrefs (Msg *m, int delta) {
+  const char *p = m->data;
+  const char *end = p + m->size;
+  while (p < end) {
+    switch (*p++) {
+      case M_NUMBER: p += sizeof(lua_Number); break;
+      case M_STRING: {
+        size_t l;
+        memcpy(&l, p, sizeof(l));
+        p += sizeof(l) + l;
+        break;
+      }
+      case M_CHANNEL: {
+        Channel *c;
+        memcpy(&c, p, sizeof(c));
+        p += sizeof(c);
+        if (delta > 0) a_add(&c->refs, 1);
+        else releasechannel(c);
+        break;
+      }
+      default: break;  /* tags without payload */
+    }
+  }
+}
+
+
+static void freemsg (Msg *m) {
+  if (m->nrefs > 0)
+    adjustrefs(m, -1);
+  free(m);
+}
+
+
+static int growbuff (Local *l, size_t size) {
+  if (l->size - l->n < size) {
+    size_t newsize = l->size * 2;
+    char *newbuff;
+    if (newsize < l->n + size) newsize = l->n + size;
+    if (newsize < 128) newsize = 128;
+    newbuff = (char *)realloc(l->buff, newsize);
+    if (newbuff == NULL) return 0;
+    l->buff = newbuff;
+    l->size = newsize;
+  }
+  return 1;
+}
+
+
+static void addbytes (lua_State *L, Local *l, const void *s, size_t size) {
+  if (!growbuff(l, size))
+    luaL_error(L, "not enough memory");
+  memcpy(l->buff + l->n, s, size);
+  l->n += size;
+}
+
+
+static void addtag (lua_State *L, Local *l, int tag) {
+  char t = (char)tag;
+  addbytes(L, l, &t, 1);
+}
+
+
+static void encode (lua_State *L, Local *l, int idx, int depth) {
+  switch (lua_type(L, idx)) {
+    case LUA_TNIL: addtag(L, l, M_NIL); break;
+    case LUA_TBOOLEAN:
+      addtag(L, l, lua_toboolean(L, idx) ? M_TRUE : M_FALSE);
+      break;
+    case LUA_TNUMBER: {
+      lua_Number n = lua_tonumber(L, idx);
+      addtag(L, l, M_NUMBER);
+      addbytes(L, l, &n, sizeof(n));
+      break;
+    }
+    case LUA_TSTRING: {
+      size_t len;
+      const char *s = lua_tolstring(L, idx, &len);
+      addtag(L, l, M_STRING);
+      addbytes(L, l, &len, sizeof(len));
+      addbytes(L, l, s, len);
+      break;
+    }
+    case LUA_TTABLE: {
+      if (depth >= MAXDEPTH)
+        luaL_error(L, "table too deep (or cyclic) to be sent");
+      luaL_checkstack(L, 3, "table too deep");
+      addtag(L, l, M_TABLE);
+      lua_pushnil(L);
+      while (lua_next(L, idx)) {
+        int top = lua_gettop(L);
+        encode(L, l, top - 1, depth + 1);  /* key */
+        encode(L, l, top, depth + 1);  /* value */
+        lua_pop(L, 1);
+      }
+      addtag(L, l, M_END);
+      break;
+    }
+    default: {
+      Channel **c = (Channel **)luaL_testudata(L, idx, CHANNEL);
+      if (c == NULL)
+        luaL_error(L, "cannot send a %s value", luaL_typename(L, idx));
+      addtag(L, l, M_CHANNEL);
+      addbytes(L, l, c, sizeof(Channel *));
+      l->nrefs++;
+      break;
+    }
+  }
+}
+
+
+/* turn the contents of the buffer into a message */
+static Msg *newmsg (lua_State *L, Local *l) {
+  Msg *m = (Msg *)malloc(offsetof(Msg, data) + l->n);
+  if (m == NULL)
+    luaL_error(L, "not enough memory");
+  memcpy(m->data, l->buff, l->n);
+  m->size = l->n;
+  m->nrefs = l->nrefs;
+  if (m->nrefs > 0)
+    adjustrefs(m, 1);  /* the message keeps its channels alive */
+  return m;
+}
+
+
+static void pushchannel (lua_State *L, Channel *c) {
+  Channel **box = (Channel **)lua_newuserdata(L, sizeof(Channel *));
+  *box = NULL;
+  luaL_setmetatable(L, CHANNEL);
+  a_add(&c->refs, 1);
+  *box = c;
+}
+
+
+static const char *decode (lua_State *L, const char *p) {
+  switch (*p++) {
+    case M_NIL: lua_pushnil(L); break;
+    case M_FALSE: lua_pushboolean(L, 0); break;
+    case M_TRUE: lua_pushboolean(L, 1); break;
+    case M_NUMBER: {
+      lua_Number n;
+      memcpy(&n, p, sizeof(n));
+      p += sizeof(n);
+      lua_pushnumber(L, n);
+      break;
+    }
+    case M_STRING: {
+      size_t len;
+      memcpy(&len, p, sizeof(len));
+      p += sizeof(len);
+      lua_pushlstring(L, p, len);
+      p += len;
+      break;
+    }
+    case M_TABLE: {
+      luaL_checkstack(L, 3, "message too deep");
+      lua_newtable(L);
+      while (*p != M_END) {
+        p = decode(L, p);  /* key */
+        p = decode(L, p);  /* value */
+        lua_rawset(L, -3);
+      }
+      p++;  /* skip M_END */
+      break;
+    }
+    case M_CHANNEL: {
+      Channel *c;
+      memcpy(&c, p, sizeof(c));
+      p += sizeof(c);
+      pushchannel(L, c);
+      break;
+    }
+  }
+  return p;
+}
+
+
+/*
+** push all values in message 'm' and free it; while decoding, 'm' is
+** kept in 'l->pending' so that it is not lost if an error occurs
+*/
+static int pushmsg (lua_State *L, Local *l, Msg *m) {
+  const char *p = m->data;
+  const char *end = p + m->size;
+  int n = 0;
+  if (l->pending != NULL) {  /* left by an error? */
+    freemsg(l->pending);
+    l->pending = NULL;
+  }
+  l->pending = m;
+  while (p < end) {
+    luaL_checkstack(L, 1, "too many values in message");
+    p = decode(L, p);
+    n++;
+  }
+  l->pending = NULL;
+  freemsg(m);
+  return n;
+}
+
+/* }====================================================== */
+
+
+
+/*
+** {======================================================
+** Workers
+** =======================================================
+*/
+
+static void initworker (Sched *s, Worker *w) {
+  pthread_mutex_init(&w->lock, NULL);
+  pthread_cond_init(&w->cond, NULL);
+  w->first = w->last = NULL;
+  w->s = s;
+  w->L = NULL;
+  w->cur = NULL;
+  w->tasks = NULL;
+  w->self.w = w;
+  w->self.co = NULL;
+  w->self.ch = NULL;
+  w->self.held = NULL;
+  w->self.wake.wt = &w->self;
+  w->self.wake.m = NULL;
+  w->runhead = w->runtail = 0;
+}
+
+
+static void postctl (Worker *w, Ctl *c) {
+  c->next = NULL;
+  pthread_mutex_lock(&w->lock);
+  if (w->last) w->last->next = c;
+  else w->first = c;
+  w->last = c;
+  pthread_cond_signal(&w->cond);
+  pthread_mutex_unlock(&w->lock);
+}
+
+
+/*
+** take all pending control messages; if 'wait', sleep until there is
+** at least one of them or the scheduler is stopping
+*/
+static Ctl *takectl (Worker *w, int wait) {
+  Ctl *c;
+  pthread_mutex_lock(&w->lock);
+  while (wait && w->first == NULL && !a_load(&w->s->stop))
+    pthread_cond_wait(&w->cond, &w->lock);
+  c = w->first;
+  w->first = w->last = NULL;
+  pthread_mutex_unlock(&w->lock);
+  return c;
+}
+
+
+static void sendmsg (Channel *c, Msg *m) {
+  qpush(c, m);
+  if (a_load(&c->waiter) != NULL) {
+    Waiter *wt = a_xchg(&c->waiter, (Waiter *)NULL);
+    if (wt != NULL)
+      postctl(wt->w, &wt->wake);
+  }
+}
+
+
+/*
+** register 'wt' as the receiver of 'c' and check the queue once more
+** (a sender may have pushed a message before seeing the waiter).
+** Returns a message if it could leave the channel with it; otherwise
+** the waiter must sleep until its wake-up arrives.
+*/
+static Msg *waiton (lua_State *L, Channel *c, Waiter *wt) {
+  Waiter *none = NULL;
+  Msg *m;
+  if (!a_cas(&c->waiter, &none, wt))
+    luaL_error(L, "channel already has a waiting receiver");
+  wt->ch = c;
+  m = trypop(c);
+  if (m != NULL) {
+    Waiter *me = wt;
+    if (a_cas(&c->waiter, &me, (Waiter *)NULL)) {
+      wt->ch = NULL;
+      return m;
+    }
+    wt->held = m;  /* a sender already took 'wt': wait for its wake-up */
+  }
+  return NULL;
+}
+
+
+static void enqueue (lua_State *L, Worker *w, Waiter *wt) {
+  wt->ch = NULL;
+  lua_pushlightuserdata(L, wt);
+  lua_rawseti(L, 2, ++w->runtail);
+}
+
+
+static void newtask (lua_State *L, Worker *w, Msg *m) {
+  Waiter *wt;
+  lua_State *co;
+  size_t len;
+  const char *code;
+  int n = pushmsg(L, tolocal(L), m);  /* code and arguments */
+  int base = lua_gettop(L) - n + 1;
+  code = lua_tolstring(L, base, &len);
+  if (luaL_loadbuffer(L, code, len,
+        (*code == LUA_SIGNATURE[0]) ? "=(task)" : code) != LUA_OK) {
+    luai_writestringerror("sched: %s\n", lua_tostring(L, -1));
+    lua_settop(L, base - 1);
+    return;
+  }
+  lua_replace(L, base);
+  co = lua_newthread(L);
+  lua_pushvalue(L, -1);
+  lua_pushboolean(L, 1);
+  lua_rawset(L, 1);  /* tasks[co] = true */
+  /* allocate the waiter last, so that no error can leak it */
+  wt = (Waiter *)malloc(sizeof(Waiter));
+  if (wt == NULL) {
+    lua_pushnil(L);
+    lua_rawset(L, 1);  /* tasks[co] = nil */
+    luaL_error(L, "not enough memory");
+  }
+  lua_pop(L, 1);
+  lua_xmove(L, co, n);
+  wt->w = w;
+  wt->co = co;
+  wt->ch = NULL;
+  wt->held = NULL;
+  wt->wake.wt = wt;
+  wt->wake.m = NULL;
+  wt->prev = NULL;
+  wt->next = w->tasks;
+  if (w->tasks) w->tasks->prev = wt;
+  w->tasks = wt;
+  enqueue(L, w, wt);
+}
+
+
+static void endtask (lua_State *L, Worker *w, Waiter *wt) {
+  lua_pushthread(wt->co);
+  lua_xmove(wt->co, L, 1);
+  lua_pushnil(L);
+  lua_rawset(L, 1);  /* tasks[co] = nil */
+  if (wt->prev) wt->prev->next = wt->next;
+  else w->tasks = wt->next;
+  if (wt->next) wt->next->prev = wt->prev;
+  free(wt);
+}
+
+
+static void runtask (lua_State *L, Worker *w) {
+  Waiter *wt;
+  lua_State *co;
+  int status, nargs;
+  lua_rawgeti(L, 2, ++w->runhead);
+  wt = (Waiter *)lua_touserdata(L, -1);
+  lua_pop(L, 1);
+  lua_pushnil(L);
+  lua_rawseti(L, 2, w->runhead);
+  co = wt->co;
+  nargs = (lua_status(co) == LUA_OK) ? lua_gettop(co) - 1 : 0;
+  w->cur = wt;
+  status = lua_resume(co, L, nargs);
+  w->cur = NULL;
+  if (status == LUA_YIELD) {
+    lua_settop(co, 0);
+    if (wt->ch == NULL)  /* plain yield? */
+      enqueue(L, w, wt);  /* give other tasks a chance and resume later */
+  }
+  else {
+    if (status != LUA_OK) {
+      const char *msg = lua_tostring(co, -1);
+      luaL_traceback(L, co, msg ? msg : "(error object is not a string)", 0);
+      luai_writestringerror("sched: %s\n", lua_tostring(L, -1));
+      lua_pop(L, 1);
+    }
+    endtask(L, w, wt);
+  }
+}
+
+
+static void freectl (Ctl *c) {
+  while (c != NULL) {
+    Ctl *next = c->next;
+    if (c->m != NULL) {  /* a task never started? */
+      freemsg(c->m);
+      free(c);
+    }  /* (wake-ups live inside their waiters) */
+    c = next;
+  }
+}
+
+
+static int workerloop (lua_State *L) {
+  Worker *w = (Worker *)lua_touserdata(L, 1);
+  lua_settop(L, 0);
+  lua_newtable(L);  /* 1: tasks (anchors task threads) */
+  lua_newtable(L);  /* 2: run queue */
+  for (;;) {
+    Ctl *c = takectl(w, w->runhead == w->runtail);
+    if (a_load(&w->s->stop)) {
+      freectl(c);
+      break;
+    }
+    while (c != NULL) {
+      Ctl *next = c->next;
+      if (c->m != NULL) {
+        Msg *m = c->m;
+        free(c);
+        newtask(L, w, m);
+      }
+      else enqueue(L, w, c->wt);
+      c = next;
+    }
+    if (w->runhead != w->runtail)
+      runtask(L, w);
+  }
+  return 0;
+}
+
+
+static void *workermain (void *ud) {
+  Worker *w = (Worker *)ud;
+  lua_State *L = w->L;
+  lua_getfield(L, LUA_REGISTRYINDEX, LOCALKEY);
+  lua_pushcclosure(L, workerloop, 1);
+  lua_pushlightuserdata(L, w);
+  if (lua_pcall(L, 1, 0, 0) != LUA_OK)
+    luai_writestringerror("sched: worker stopped: %s\n", lua_tostring(L, -1));
+  return NULL;
+}
+
+
+static void startworker (lua_State *L, Sched *s, Worker *w) {
+  Local *l;
+  initworker(s, w);
+  w->L = luaL_newstate();
+  if (w->L == NULL)
+    luaL_error(L, "cannot create state: not enough memory");
+  luaL_openlibs(w->L);
+  luaL_requiref(w->L, LUA_SCHEDLIBNAME, luaopen_sched, 0);
+  lua_getfield(w->L, LUA_REGISTRYINDEX, LOCALKEY);
+  l = (Local *)lua_touserdata(w->L, -1);
+  l->w = w;
+  lua_settop(w->L, 0);
+  if (pthread_create(&w->thread, NULL, workermain, w) != 0) {
+    lua_close(w->L);
+    luaL_error(L, "cannot create thread");
+  }
+  s->nworkers++;
+}
+
+
+static int sched_gc (lua_State *L) {
+  Sched *s = *(Sched **)luaL_checkudata(L, 1, SCHEDULER);
+  int i;
+  if (s == NULL) return 0;
+  a_store(&s->stop, 1);
+  for (i = 0; i < s->nworkers; i++) {
+    Worker *w = &s->w[i];
+    pthread_mutex_lock(&w->lock);
+    pthread_cond_signal(&w->cond);
+    pthread_mutex_unlock(&w->lock);
+  }
+  for (i = 0; i < s->nworkers; i++)
+    pthread_join(s->w[i].thread, NULL);
+  for (i = 0; i < s->nworkers; i++) {
+    Worker *w = &s->w[i];
+    while (w->tasks != NULL) {  /* abandon unfinished tasks */
+      Waiter *wt = w->tasks;
+      Waiter *me = wt;
+      if (wt->ch != NULL)  /* still registered in a channel? */
+        a_cas(&wt->ch->waiter, &me, (Waiter *)NULL);
+      if (wt->held != NULL) freemsg(wt->held);
+      w->tasks = wt->next;
+      free(wt);
+    }
+  }
+  for (i = 0; i < s->nworkers; i++) {
+    Worker *w = &s->w[i];
+    freectl(w->first);  /* posted after the worker stopped */
+    lua_close(w->L);
+    pthread_mutex_destroy(&w->lock);
+    pthread_cond_destroy(&w->cond);
+  }
+  pthread_mutex_destroy(&s->main.lock);
+  pthread_cond_destroy(&s->main.cond);
+  s->owner->w = NULL;
+  s->owner->closed = 1;
+  free(s);
+  *(Sched **)lua_touserdata(L, 1) = NULL;
+  return 0;
+}
+
+
+static Sched *startsched (lua_State *L, Local *l, int n) {
+  Sched **box;
+  Sched *s;
+  int i;
+  if (l->closed)
+    luaL_error(L, "scheduler is closed");
+  box = (Sched **)lua_newuserdata(L, sizeof(Sched *));
+  *box = NULL;
+  luaL_setmetatable(L, SCHEDULER);
+  lua_setfield(L, LUA_REGISTRYINDEX, SCHEDKEY);
+  s = (Sched *)malloc(sizeof(Sched) + n * sizeof(Worker));
+  if (s == NULL)
+    luaL_error(L, "not enough memory");
+  s->w = (Worker *)(s + 1);
+  s->nworkers = 0;
+  s->next = 0;
+  s->stop = 0;
+  s->owner = l;
+  initworker(s, &s->main);
+  s->main.L = L;
+  *box = s;
+  l->w = &s->main;
+  for (i = 0; i < n; i++)
+    startworker(L, s, &s->w[i]);
+  return s;
+}
+
+
+static int defaultworkers (void) {
+  long n = sysconf(_SC_NPROCESSORS_ONLN);
+  return (n < 1) ? 1 : (int)n;
+}
+
+
+static Sched *getsched (lua_State *L) {
+  Local *l = tolocal(L);
+  return (l->w != NULL) ? l->w->s : startsched(L, l, defaultworkers());
+}
+
+/* }====================================================== */
+
+
+
+/*
+** {======================================================
+** Library functions
+** =======================================================
+*/
+
+static int writer (lua_State *L, const void *b, size_t size, void *ud) {
+  Local *l = (Local *)ud;
+  (void)L;
+  if (!growbuff(l, size)) return 1;
+  memcpy(l->buff + l->n, b, size);
+  l->n += size;
+  return 0;
+}
+
+
+static int sched_spawn (lua_State *L) {
+  Local *l = tolocal(L);
+  int i, n = lua_gettop(L);
+  Sched *s;
+  Msg *m;
+  Ctl *c;
+  l->n = 0;
+  l->nrefs = 0;
+  if (lua_type(L, 1) == LUA_TFUNCTION) {  /* send the function's code */
+    size_t pos, len;
+    luaL_argcheck(L, !lua_iscfunction(L, 1), 1, "Lua function expected");
+    addtag(L, l, M_STRING);
+    pos = l->n;
+    len = 0;
+    addbytes(L, l, &len, sizeof(len));
+    lua_pushvalue(L, 1);
+    if (lua_dump(L, writer, l) != 0)
+      luaL_error(L, "unable to dump given function");
+    lua_pop(L, 1);
+    len = l->n - pos - sizeof(len);
+    memcpy(l->buff + pos, &len, sizeof(len));
+  }
+  else {
+    luaL_checkstring(L, 1);
+    encode(L, l, 1, 0);
+  }
+  for (i = 2; i <= n; i++)
+    encode(L, l, i, 0);
+  s = getsched(L);
+  m = newmsg(L, l);
+  c = (Ctl *)malloc(sizeof(Ctl));
+  if (c == NULL) {
+    freemsg(m);
+    luaL_error(L, "not enough memory");
+  }
+  c->wt = NULL;
+  c->m = m;
+  postctl(&s->w[a_add(&s->next, 1) % s->nworkers], c);
+  return 0;
+}
+
+
+static int sched_channel (lua_State *L) {
+  Channel **box = (Channel **)lua_newuserdata(L, sizeof(Channel *));
+  Channel *c;
+  *box = NULL;
+  luaL_setmetatable(L, CHANNEL);
+  c = (Channel *)malloc(sizeof(Channel));
+  if (c == NULL)
+    luaL_error(L, "not enough memory");
+  qinit(c);
+  c->waiter = NULL;
+  c->poplock = 0;
+  c->refs = 1;
+  *box = c;
+  return 1;
+}
+
+
+static int sched_workers (lua_State *L) {
+  Local *l = tolocal(L);
+  if (l->w == NULL) {
+    int n = luaL_optint(L, 1, defaultworkers());
+    luaL_argcheck(L, n > 0, 1, "number of workers must be positive");
+    startsched(L, l, n);
+  }
+  else
+    luaL_argcheck(L, lua_isnoneornil(L, 1) ||
+                     lua_tointeger(L, 1) == l->w->s->nworkers, 1,
+                     "scheduler already running");
+  lua_pushinteger(L, l->w->s->nworkers);
+  return 1;
+}
+
+
+static int ch_send (lua_State *L) {
+  Local *l = tolocal(L);
+  Channel *c = tochannel(L);
+  int i, n = lua_gettop(L);
+  l->n = 0;
+  l->nrefs = 0;
+  for (i = 2; i <= n; i++)
+    encode(L, l, i, 0);
+  sendmsg(c, newmsg(L, l));
+  return 0;
+}
+
+
+/*
+** a state that is not running a task blocks its OS thread
+*/
+static int blockrecv (lua_State *L, Local *l, Channel *c) {
+  Worker *w = l->w;
+  for (;;) {
+    Msg *m = waiton(L, c, &w->self);
+    if (m == NULL) {  /* sleep until a sender wakes us */
+      takectl(w, 1);
+      m = w->self.held;
+      w->self.held = NULL;
+      w->self.ch = NULL;
+      if (m == NULL) m = trypop(c);
+    }
+    if (m != NULL) return pushmsg(L, l, m);
+  }
+}
+
+
+/*
+** also the continuation of a task waiting for a message
+*/
+static int ch_recv (lua_State *L) {
+  Local *l = tolocal(L);
+  Channel *c = tochannel(L);
+  Waiter *wt = (l->w != NULL) ? l->w->cur : NULL;
+  Msg *m;
+  if (wt != NULL && wt->held != NULL) {  /* woken up with a message? */
+    m = wt->held;
+    wt->held = NULL;
+    return pushmsg(L, l, m);
+  }
+  m = trypop(c);
+  if (m != NULL)
+    return pushmsg(L, l, m);
+  if (l->w == NULL)
+    return luaL_error(L, "channel is empty and no task can fill it");
+  if (ismain(l->w))
+    return blockrecv(L, l, c);
+  if (wt == NULL || wt->co != L)
+    return luaL_error(L, "cannot wait for a message outside a task");
+  m = waiton(L, c, wt);
+  if (m != NULL)
+    return pushmsg(L, l, m);
+  return lua_yieldk(L, 0, 0, ch_recv);
+}
+
+
+static int ch_gc (lua_State *L) {
+  Channel **box = (Channel **)luaL_checkudata(L, 1, CHANNEL);
+  if (*box != NULL) {
+    releasechannel(*box);
+    *box = NULL;
+  }
+  return 0;
+}
+
+
+static int ch_tostring (lua_State *L) {
+  lua_pushfstring(L, "channel (%p)", (void *)tochannel(L));
+  return 1;
+}
+
+
+static int local_gc (lua_State *L) {
+  Local *l = (Local *)lua_touserdata(L, 1);
+  if (l->pending != NULL) freemsg(l->pending);
+  free(l->buff);
+  return 0;
+}
+
+
+static void releasechannel (Channel *c) {
+  if (a_add(&c->refs, -1) == 0) {
+    Msg *m;
+    while ((m = qpop(c)) != NULL)
+      freemsg(m);
+    free(c);
+  }
+}
+
+
+static const luaL_Reg sched_funcs[] = {
+  {"spawn", sched_spawn},
+  {"channel", sched_channel},
+  {"workers", sched_workers},
+  {NULL, NULL}
+};
+
+
+static const luaL_Reg ch_meth[] = {
+  {"send", ch_send},
+  {"recv", ch_recv},
+  {"__gc", ch_gc},
+  {"__tostring", ch_tostring},
+  {NULL, NULL}
+};
+
+
+LUAMOD_API int luaopen_sched (lua_State *L) {
+  Local *l = (Local *)lua_newuserdata(L, sizeof(Local));
+  l->buff = NULL;
+  l->n = l->size = 0;
+  l->nrefs = 0;
+  l->pending = NULL;
+  l->w = NULL;
+  l->closed = 0;
+  lua_createtable(L, 0, 1);
+  lua_pushcfunction(L, local_gc);
+  lua_setfield(L, -2, "__gc");
+  lua_setmetatable(L, -2);
+  lua_pushvalue(L, -1);
+  lua_setfield(L, LUA_REGISTRYINDEX, LOCALKEY);
+  luaL_newmetatable(L, SCHEDULER);
+  lua_pushcfunction(L, sched_gc);
+  lua_setfield(L, -2, "__gc");
+  lua_pop(L, 1);
+  luaL_newmetatable(L, CHANNEL);
+  lua_pushvalue(L, -1);
+  lua_setfield(L, -2, "__index");  /* metatable.__index = metatable */
+  lua_pushvalue(L, -2);
+  luaL_setfuncs(L, ch_meth, 1);
+  lua_pop(L, 1);
+  luaL_newlibtable(L, sched_funcs);
+  lua_pushvalue(L, -2);
+  luaL_setfuncs(L, sched_funcs, 1);
+  return 1;
+}
+
+/* }====================================================== */
+
+
+#else
+/*
+** {========================================================================
+** This is the fallback for systems without threads: the library loads,
+** but its functions only raise an error.
+** =========================================================================
+*/
+
+#define SCHEDMSG	"threads not enabled; check your Lua installation"
+
+
+static int sched_none (lua_State *L) {
+  return luaL_error(L, SCHEDMSG);
+}
+
+
+static const luaL_Reg sched_funcs[] = {
+  {"spawn", sched_none},
+  {"channel", sched_none},
+  {"workers", sched_none},
+  {NULL, NULL}
+};
+
+
+LUAMOD_API int luaopen_sched (lua_State *L) {
+  luaL_newlib(L, sched_funcs);
+  return 1;
+}
+
+/* }====================================================== */
+
+#endif
+
@@ -110,7 +110,7 @@ void luaE_setdebt (global_State *g, l_mem debt) {
 
 
 CallInfo *luaE_extendCI (lua_State *L) {
-  CallInfo *ci = luaM_new(L, CallInfo);
+  CallInfo *ci = luaM_newt(L, CallInfo, LUA_TTHREAD);
   lua_assert(L->ci->next == NULL);
   L->ci->next = ci;
   ci->previous = L->ci;
@@ -125,7 +125,7 @@ void luaE_freeCI (lua_State *L) {
   ci->next = NULL;
   while ((ci = next) != NULL) {
     next = ci->next;
-    luaM_free(L, ci);
+    luaM_freet(L, ci, LUA_TTHREAD);
   }
 }
 
@@ -133,7 +133,7 @@ void luaE_freeCI (lua_State *L) {
 static void stack_init (lua_State *L1, lua_State *L) {
   int i; CallInfo *ci;
   /* initialize stack array */
-  L1->stack = luaM_newvector(L, BASIC_STACK_SIZE, TValue);
+  L1->stack = luaM_newvectort(L, BASIC_STACK_SIZE, TValue, LUA_TTHREAD);
   L1->stacksize = BASIC_STACK_SIZE;
   for (i = 0; i < BASIC_STACK_SIZE; i++)
     setnilvalue(L1->stack + i);  /* erase new stack */
@@ -155,7 +155,7 @@ static void freestack (lua_State *L) {
     return;  /* stack not completely built yet */
   L->ci = &L->base_ci;  /* free the entire 'ci' list */
   luaE_freeCI(L);
-  luaM_freearray(L, L->stack, L->stacksize);  /* free stack array */
+  luaM_freearrayt(L, L->stack, L->stacksize, LUA_TTHREAD);  /* free stack */
 }
 
 
@@ -295,6 +295,13 @@ LUA_API lua_State *lua_newstate (lua_Alloc f, void *ud) {
   g->sweepgc = g->sweepfin = NULL;
   g->gray = g->grayagain = NULL;
   g->weak = g->ephemeron = g->allweak = NULL;
+  g->regionL = NULL;
+  g->regioncount = 0;
+  g->regiondepth = 0;
+  g->regionescaped = 0;
+  for (i=0; i <= LUA_TUPVAL; i++) g->objcount[i] = g->objbytes[i] = 0;
+  g->objcount[LUA_TTHREAD] = 1;  /* main thread */
+  g->objbytes[LUA_TTHREAD] = sizeof(lua_State);
   g->totalbytes = sizeof(LG);
   g->GCdebt = 0;
   g->gcpause = LUAI_GCPAUSE;
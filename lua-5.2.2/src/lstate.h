@@ -135,6 +135,12 @@ typedef struct global_State {
   GCObject *allweak;  /* list of all-weak tables */
   GCObject *tobefnz;  /* list of userdata to be GC */
   UpVal uvhead;  /* head of double-linked list of all open upvalues */
+  struct lua_State *regionL;  /* thread that opened the tracked region */
+  lu_mem regioncount;  /* number of live objects created in the region */
+  int regiondepth;  /* number of nested (open) allocation regions */
+  lu_byte regionescaped;  /* true if some region object may outlive it */
+  lu_mem objcount[LUA_TUPVAL+1];  /* number of live objects of each type */
+  lu_mem objbytes[LUA_TUPVAL+1];  /* bytes in them and the parts they own */
   Mbuffer buff;  /* temporary buffer for string concatenation */
   int gcpause;  /* size of pause between successive GCs */
   int gcmajorinc;  /* pause between major collections (only in gen. mode) */
@@ -185,6 +191,7 @@ struct lua_State {
 union GCObject {
   GCheader gch;  /* common header */
   union TString ts;
+  struct Rope rope;
   union Udata u;
   union Closure cl;
   struct Table h;
@@ -200,6 +207,7 @@ union GCObject {
 #define rawgco2ts(o)  \
 	check_exp(novariant((o)->gch.tt) == LUA_TSTRING, &((o)->ts))
 #define gco2ts(o)	(&rawgco2ts(o)->tsv)
+#define gco2rope(o)	check_exp((o)->gch.tt == LUA_TROPE, &((o)->rope))
 #define rawgco2u(o)	check_exp((o)->gch.tt == LUA_TUSERDATA, &((o)->u))
 #define gco2u(o)	(&rawgco2u(o)->uv)
 #define gco2lcl(o)	check_exp((o)->gch.tt == LUA_TLCL, &((o)->cl.l))
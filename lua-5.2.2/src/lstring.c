@@ -28,14 +28,63 @@
 
 
 /*
-** equality for long strings
+** returns the last piece of string '*rest' (a plain string) and removes
+** it from '*rest', which becomes NULL after the first piece
+*/
+TString *luaS_prevpiece (TString **rest) {
+  TString *s = *rest;
+  while (s->tsv.tt == LUA_TROPE) {
+    Rope *r = ts2rope(s);
+    if (r->right != NULL) {  /* pending concatenation? */
+      *rest = r->left;
+      return r->right;
+    }
+    s = r->left;  /* already built */
+  }
+  *rest = NULL;
+  return s;
+}
+
+
+/*
+** compare contents of strings with equal lengths, piece by piece from
+** their ends
+*/
+static int eqpieces (TString *a, TString *b) {
+  TString *pa = NULL, *pb = NULL;  /* current pieces */
+  size_t la = 0, lb = 0;  /* bytes not yet compared in current pieces */
+  for (;;) {
+    size_t n;
+    if (la == 0) {
+      if (a == NULL) return 1;  /* compared everything */
+      pa = luaS_prevpiece(&a);
+      la = pa->tsv.len;
+    }
+    else if (lb == 0) {
+      pb = luaS_prevpiece(&b);
+      lb = pb->tsv.len;
+    }
+    else {
+      n = (la < lb) ? la : lb;
+      la -= n; lb -= n;
+      if (memcmp(getstr(pa) + la, getstr(pb) + lb, n) != 0)
+        return 0;
+    }
+  }
+}
+
+
+/*
+** equality for long strings (and ropes)
 */
 int luaS_eqlngstr (TString *a, TString *b) {
   size_t len = a->tsv.len;
-  lua_assert(a->tsv.tt == LUA_TLNGSTR && b->tsv.tt == LUA_TLNGSTR);
-  return (a == b) ||  /* same instance or... */
-    ((len == b->tsv.len) &&  /* equal length and ... */
-     (memcmp(getstr(a), getstr(b), len) == 0));  /* equal contents */
+  if (a == b) return 1;  /* same instance */
+  else if (len != b->tsv.len) return 0;
+  else if (a->tsv.tt == LUA_TLNGSTR && b->tsv.tt == LUA_TLNGSTR)
+    return (memcmp(getstr(a), getstr(b), len) == 0);  /* equal contents */
+  else
+    return eqpieces(a, b);
 }
 
 
@@ -58,6 +107,27 @@ unsigned int luaS_hash (const char *str, size_t l, unsigned int seed) {
 }
 
 
+/*
+** same as 'luaS_hash' over the contents of a rope
+*/
+unsigned int luaS_hashrope (TString *s, unsigned int seed) {
+  size_t l = s->tsv.len;
+  unsigned int h = seed ^ cast(unsigned int, l);
+  size_t l1;
+  size_t step = (l >> LUAI_HASHLIMIT) + 1;
+  TString *p = NULL;  /* current piece */
+  size_t off = l;  /* position of current piece */
+  for (l1 = l; l1 >= step; l1 -= step) {
+    while (l1 - 1 < off) {  /* byte is before current piece? */
+      p = luaS_prevpiece(&s);
+      off -= p->tsv.len;
+    }
+    h = h ^ ((h<<5) + (h>>2) + cast_byte(getstr(p)[l1 - 1 - off]));
+  }
+  return h;
+}
+
+
 /*
 ** resizes the string table
 */
@@ -93,7 +163,8 @@ void luaS_resize (lua_State *L, int newsize) {
 
 
 /*
-** creates a new string object
+** creates a new string object ('str' == NULL leaves contents to be
+** filled by the caller)
 */
 static TString *createstrobj (lua_State *L, const char *str, size_t l,
                               int tag, unsigned int h, GCObject **list) {
@@ -104,7 +175,8 @@ static TString *createstrobj (lua_State *L, const char *str, size_t l,
   ts->tsv.len = l;
   ts->tsv.hash = h;
   ts->tsv.extra = 0;
-  memcpy(ts+1, str, l*sizeof(char));
+  if (str != NULL)
+    memcpy(ts+1, str, l*sizeof(char));
   ((char *)(ts+1))[l] = '\0';  /* ending 0 */
   return ts;
 }
@@ -164,6 +236,49 @@ TString *luaS_newlstr (lua_State *L, const char *str, size_t l) {
 }
 
 
+/*
+** creates a rope for the concatenation of 'left' and 'right' (which
+** must be a plain string)
+*/
+TString *luaS_newrope (lua_State *L, TString *left, TString *right) {
+  Rope *r;
+  lua_assert(right->tsv.tt != LUA_TROPE);
+  if (left->tsv.tt == LUA_TROPE && ts2rope(left)->right == NULL)
+    left = ts2rope(left)->left;  /* refer directly to built string */
+  r = &luaC_newobj(L, LUA_TROPE, sizeof(Rope), NULL, 0)->rope;
+  r->ts.tsv.len = left->tsv.len + right->tsv.len;
+  r->ts.tsv.hash = G(L)->seed;
+  r->ts.tsv.extra = 0;
+  r->left = left;
+  r->right = right;
+  return &r->ts;
+}
+
+
+/*
+** builds the contents of rope 's'; from then on the rope refers only
+** to the resulting string
+*/
+TString *luaS_flatten (lua_State *L, TString *s) {
+  Rope *r = ts2rope(s);
+  if (r->right != NULL) {  /* not built yet? */
+    size_t l = s->tsv.len;
+    TString *ts = createstrobj(L, NULL, l, LUA_TLNGSTR, G(L)->seed, NULL);
+    char *buff = cast(char *, ts + 1);
+    while (s != NULL) {  /* copy pieces from last to first */
+      TString *p = luaS_prevpiece(&s);
+      l -= p->tsv.len;
+      memcpy(buff + l, getstr(p), p->tsv.len * sizeof(char));
+    }
+    lua_assert(l == 0);
+    r->left = ts;
+    r->right = NULL;
+    luaC_objbarrier(L, r, ts);
+  }
+  return r->left;
+}
+
+
 /*
 ** new zero-terminated string
 */
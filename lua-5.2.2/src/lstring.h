@@ -14,6 +14,8 @@
 
 #define sizestring(s)	(sizeof(union TString)+((s)->len+1)*sizeof(char))
 
+#define ts2rope(s)	gco2rope(obj2gco(s))
+
 #define sizeudata(u)	(sizeof(union Udata)+(u)->len)
 
 #define luaS_newliteral(L, s)	(luaS_newlstr(L, "" s, \
@@ -34,6 +36,14 @@
 #define eqshrstr(a,b)	check_exp((a)->tsv.tt == LUA_TSHRSTR, (a) == (b))
 
 
+/*
+** plain string with the contents of string 's' (building it if 's'
+** is a rope)
+*/
+#define luaS_plain(L,s)  \
+	((s)->tsv.tt == LUA_TROPE ? luaS_flatten(L, s) : (s))
+
+
 LUAI_FUNC unsigned int luaS_hash (const char *str, size_t l, unsigned int seed);
 LUAI_FUNC int luaS_eqlngstr (TString *a, TString *b);
 LUAI_FUNC int luaS_eqstr (TString *a, TString *b);
@@ -41,6 +51,10 @@ LUAI_FUNC void luaS_resize (lua_State *L, int newsize);
 LUAI_FUNC Udata *luaS_newudata (lua_State *L, size_t s, Table *e);
 LUAI_FUNC TString *luaS_newlstr (lua_State *L, const char *str, size_t l);
 LUAI_FUNC TString *luaS_new (lua_State *L, const char *str);
+LUAI_FUNC TString *luaS_newrope (lua_State *L, TString *left, TString *right);
+LUAI_FUNC TString *luaS_flatten (lua_State *L, TString *s);
+LUAI_FUNC TString *luaS_prevpiece (TString **rest);
+LUAI_FUNC unsigned int luaS_hashrope (TString *s, unsigned int seed);
 
 
 #endif
@@ -63,6 +63,12 @@
 
 #define hashpointer(t,p)	hashmod(t, IntPoint(p))
 
+/*
+** integer-valued keys (such as sparse ids) are hashed directly;
+** a modulus by an odd number spreads them well enough
+*/
+#define hashint(t,i)		hashmod(t, cast(unsigned int, (i)))
+
 
 #define dummynode		(&dummynode_)
 
@@ -79,6 +85,9 @@ static const Node dummynode_ = {
 */
 static Node *hashnum (const Table *t, lua_Number n) {
   int i;
+  lua_number2int(i, n);
+  if (luai_numeq(cast_num(i), n))  /* integer value? (also takes -0 to 0) */
+    return hashint(t, i);
   luai_hashnum(i, n);
   if (i < 0) {
     if (cast(unsigned int, i) == 0u - i)  /* use unsigned to avoid overflows */
@@ -106,6 +115,14 @@ static Node *mainposition (const Table *t, const TValue *key) {
       }
       return hashstr(t, rawtsvalue(key));
     }
+    case LUA_TROPE: {  /* hashes as the equivalent long string */
+      TString *s = rawtsvalue(key);
+      if (s->tsv.extra == 0) {  /* no hash? */
+        s->tsv.hash = luaS_hashrope(s, s->tsv.hash);
+        s->tsv.extra = 1;  /* now it has its hash */
+      }
+      return hashstr(t, rawtsvalue(key));
+    }
     case LUA_TSHRSTR:
       return hashstr(t, rawtsvalue(key));
     case LUA_TBOOLEAN:
@@ -148,7 +165,11 @@ static int findindex (lua_State *L, Table *t, StkId key) {
   if (0 < i && i <= t->sizearray)  /* is `key' inside array part? */
     return i-1;  /* yes; that's the index (corrected to C) */
   else {
-    Node *n = mainposition(t, key);
+    Node *n;
+    if (t->lastnext < sizenode(t) &&
+        luaV_rawequalobj(gkey(gnode(t, t->lastnext)), key))
+      return t->lastnext + t->sizearray;  /* continuing a traversal */
+    n = mainposition(t, key);
     for (;;) {  /* check whether `key' is somewhere in the chain */
       /* key may be dead already, but it is ok to use it in `next' */
       if (luaV_rawequalobj(gkey(n), key) ||
@@ -179,6 +200,7 @@ int luaH_next (lua_State *L, Table *t, StkId key) {
     if (!ttisnil(gval(gnode(t, i)))) {  /* a non-nil value? */
       setobj2s(L, key, gkey(gnode(t, i)));
       setobj2s(L, key+1, gval(gnode(t, i)));
+      t->lastnext = i;  /* next call will probably continue from here */
       return 1;
     }
   }
@@ -269,7 +291,7 @@ static int numusehash (const Table *t, int *nums, int *pnasize) {
 
 static void setarrayvector (lua_State *L, Table *t, int size) {
   int i;
-  luaM_reallocvector(L, t->array, t->sizearray, size, TValue);
+  luaM_reallocvectort(L, t->array, t->sizearray, size, TValue, LUA_TTABLE);
   for (i=t->sizearray; i<size; i++)
      setnilvalue(&t->array[i]);
   t->sizearray = size;
@@ -288,7 +310,7 @@ static void setnodevector (lua_State *L, Table *t, int size) {
     if (lsize > MAXBITS)
       luaG_runerror(L, "table overflow");
     size = twoto(lsize);
-    t->node = luaM_newvector(L, size, Node);
+    t->node = luaM_newvectort(L, size, Node, LUA_TTABLE);
     for (i=0; i<size; i++) {
       Node *n = gnode(t, i);
       gnext(n) = NULL;
@@ -318,7 +340,7 @@ void luaH_resize (lua_State *L, Table *t, int nasize, int nhsize) {
         luaH_setint(L, t, i + 1, &t->array[i]);
     }
     /* shrink array */
-    luaM_reallocvector(L, t->array, oldasize, nasize, TValue);
+    luaM_reallocvectort(L, t->array, oldasize, nasize, TValue, LUA_TTABLE);
   }
   /* re-insert elements from hash part */
   for (i = twoto(oldhsize) - 1; i >= 0; i--) {
@@ -330,7 +352,7 @@ void luaH_resize (lua_State *L, Table *t, int nasize, int nhsize) {
     }
   }
   if (!isdummy(nold))
-    luaM_freearray(L, nold, cast(size_t, twoto(oldhsize))); /* free old array */
+    luaM_freearrayt(L, nold, cast(size_t, twoto(oldhsize)), LUA_TTABLE);
 }
 
 
@@ -369,6 +391,7 @@ Table *luaH_new (lua_State *L) {
   Table *t = &luaC_newobj(L, LUA_TTABLE, sizeof(Table), NULL, 0)->h;
   t->metatable = NULL;
   t->flags = cast_byte(~0);
+  t->lastnext = 0;
   t->array = NULL;
   t->sizearray = 0;
   setnodevector(L, t, 0);
@@ -378,8 +401,8 @@ Table *luaH_new (lua_State *L) {
 
 void luaH_free (lua_State *L, Table *t) {
   if (!isdummy(t->node))
-    luaM_freearray(L, t->node, cast(size_t, sizenode(t)));
-  luaM_freearray(L, t->array, t->sizearray);
+    luaM_freearrayt(L, t->node, cast(size_t, sizenode(t)), LUA_TTABLE);
+  luaM_freearrayt(L, t->array, t->sizearray, LUA_TTABLE);
   luaM_free(L, t);
 }
 
@@ -404,9 +427,14 @@ static Node *getfreepos (Table *t) {
 */
 TValue *luaH_newkey (lua_State *L, Table *t, const TValue *key) {
   Node *mp;
+  TValue aux;
   if (ttisnil(key)) luaG_runerror(L, "table index is nil");
   else if (ttisnumber(key) && luai_numisnan(L, nvalue(key)))
     luaG_runerror(L, "table index is NaN");
+  else if (ttisrope(key)) {  /* keys are always plain strings */
+    setsvalue(L, &aux, luaS_flatten(L, rawtsvalue(key)));
+    key = &aux;
+  }
   mp = mainposition(t, key);
   if (!ttisnil(gval(mp)) || isdummy(mp)) {  /* main position is taken? */
     Node *othern;
@@ -449,7 +477,7 @@ const TValue *luaH_getint (Table *t, int key) {
     return &t->array[key-1];
   else {
     lua_Number nk = cast_num(key);
-    Node *n = hashnum(t, nk);
+    Node *n = hashint(t, key);
     do {  /* check whether `key' is somewhere in the chain */
       if (ttisnumber(gkey(n)) && luai_numeq(nvalue(gkey(n)), nk))
         return gval(n);  /* that's it */
@@ -72,6 +72,13 @@ const TValue *luaT_gettmbyobj (lua_State *L, const TValue *o, TMS event) {
     default:
       mt = G(L)->mt[ttypenv(o)];
   }
-  return (mt ? luaH_getstr(mt, G(L)->tmname[event]) : luaO_nilobject);
+  if (mt == NULL)
+    return luaO_nilobject;
+  else if (event <= TM_EQ) {  /* absence of this event is cached in 'flags' */
+    const TValue *tm = fasttm(L, mt, event);
+    return (tm != NULL) ? tm : luaO_nilobject;
+  }
+  else
+    return luaH_getstr(mt, G(L)->tmname[event]);
 }
 
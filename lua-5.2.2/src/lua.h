@@ -226,6 +226,9 @@ LUA_API void  (lua_getfield) (lua_State *L, int idx, const char *k);
 LUA_API void  (lua_rawget) (lua_State *L, int idx);
 LUA_API void  (lua_rawgeti) (lua_State *L, int idx, int n);
 LUA_API void  (lua_rawgetp) (lua_State *L, int idx, const void *p);
+LUA_API int   (lua_rawgetnumbers) (lua_State *L, int idx, lua_Number *v, int n);
+LUA_API int   (lua_rawgetstrings) (lua_State *L, int idx, const char **s,
+                                   size_t *len, int n);
 LUA_API void  (lua_createtable) (lua_State *L, int narr, int nrec);
 LUA_API void *(lua_newuserdata) (lua_State *L, size_t sz);
 LUA_API int   (lua_getmetatable) (lua_State *L, int objindex);
@@ -241,6 +244,11 @@ LUA_API void  (lua_setfield) (lua_State *L, int idx, const char *k);
 LUA_API void  (lua_rawset) (lua_State *L, int idx);
 LUA_API void  (lua_rawseti) (lua_State *L, int idx, int n);
 LUA_API void  (lua_rawsetp) (lua_State *L, int idx, const void *p);
+LUA_API void  (lua_rawsetnumbers) (lua_State *L, int idx,
+                                   const lua_Number *v, int n);
+LUA_API void  (lua_rawsetstrings) (lua_State *L, int idx,
+                                   const char *const *s, const size_t *len,
+                                   int n);
 LUA_API int   (lua_setmetatable) (lua_State *L, int objindex);
 LUA_API void  (lua_setuservalue) (lua_State *L, int idx);
 
@@ -294,6 +302,23 @@ LUA_API int  (lua_status) (lua_State *L);
 LUA_API int (lua_gc) (lua_State *L, int what, int data);
 
 
+/*
+** allocation regions: objects created between a push and its matching
+** pop are freed at the pop if none of them is still reachable
+*/
+LUA_API void (lua_pushregion) (lua_State *L);
+LUA_API int  (lua_popregion) (lua_State *L);
+
+
+/*
+** memory accounting: counts and block sizes of live objects per type
+** (LUA_NUMTAGS and LUA_NUMTAGS + 1 stand for function prototypes and
+** upvalues), and a snapshot of all objects and their references
+*/
+LUA_API size_t (lua_gcobjects) (lua_State *L, int tp, size_t *count);
+LUA_API int (lua_heapsnapshot) (lua_State *L, lua_Writer writer, void *data);
+
+
 /*
 ** miscellaneous functions
 */
@@ -371,6 +396,7 @@ LUA_API void      (lua_setallocf) (lua_State *L, lua_Alloc f, void *ud);
 #define LUA_MASKRET	(1 << LUA_HOOKRET)
 #define LUA_MASKLINE	(1 << LUA_HOOKLINE)
 #define LUA_MASKCOUNT	(1 << LUA_HOOKCOUNT)
+#define LUA_MASKFILTER	(1 << 5)  /* only hook functions marked as hooked */
 
 typedef struct lua_Debug lua_Debug;  /* activation record */
 
@@ -389,11 +415,13 @@ LUA_API const char *(lua_setupvalue) (lua_State *L, int funcindex, int n);
 LUA_API void *(lua_upvalueid) (lua_State *L, int fidx, int n);
 LUA_API void  (lua_upvaluejoin) (lua_State *L, int fidx1, int n1,
                                                int fidx2, int n2);
+LUA_API int (lua_swapcode) (lua_State *L, int fidx);
 
 LUA_API int (lua_sethook) (lua_State *L, lua_Hook func, int mask, int count);
 LUA_API lua_Hook (lua_gethook) (lua_State *L);
 LUA_API int (lua_gethookmask) (lua_State *L);
 LUA_API int (lua_gethookcount) (lua_State *L);
+LUA_API void (lua_hookfilter) (lua_State *L, int fidx, int on);
 
 
 struct lua_Debug {
@@ -22,11 +22,15 @@
 static void PrintFunction(const Proto* f, int full);
 #define luaU_print	PrintFunction
 
+static void OptimizeFunction(lua_State* L, Proto* f);
+#define luaU_optimize	OptimizeFunction
+
 #define PROGNAME	"luac"		/* default program name */
 #define OUTPUT		PROGNAME ".out"	/* default output file */
 
 static int listing=0;			/* list bytecodes? */
 static int dumping=1;			/* dump bytecodes? */
+static int optimizing=0;		/* optimize bytecodes? */
 static int stripping=0;			/* strip debug information? */
 static char Output[]={ OUTPUT };	/* default output file name */
 static const char* output=Output;	/* actual output file name */
@@ -54,6 +58,7 @@ static void usage(const char* message)
   "usage: %s [options] [filenames]\n"
   "Available options are:\n"
   "  -l       list (use -l -l for full listing)\n"
+  "  -O       optimize bytecodes\n"
   "  -o name  output to file " LUA_QL("name") " (default is \"%s\")\n"
   "  -p       parse only\n"
   "  -s       strip debug information\n"
@@ -92,6 +97,8 @@ static int doargs(int argc, char* argv[])
     usage(LUA_QL("-o") " needs argument");
    if (IS("-")) output=NULL;
   }
+  else if (IS("-O"))			/* optimize */
+   optimizing=1;
   else if (IS("-p"))			/* parse only */
    dumping=0;
   else if (IS("-s"))			/* strip debug information */
@@ -171,6 +178,7 @@ static int pmain(lua_State* L)
   const char* filename=IS("-") ? NULL : argv[i];
   if (luaL_loadfile(L,filename)!=LUA_OK) fatal(lua_tostring(L,-1));
  }
+ if (optimizing) for (i=0; i<argc; i++) luaU_optimize(L,toproto(L,i-argc));
  f=combine(L,argc);
  if (listing) luaU_print(f,listing>1);
  if (dumping)
@@ -202,6 +210,220 @@ int main(int argc, char* argv[])
  return EXIT_SUCCESS;
 }
 
+/*
+** bytecode optimizer: jump threading, removal of unreachable code,
+** jumps to the next instruction, self moves and dead stores
+*/
+
+#include "lmem.h"
+#include "lopcodes.h"
+
+#define target(f,pc)	((pc)+1+GETARG_sBx((f)->code[pc]))
+
+static int isjump(OpCode o)
+{
+ return o==OP_JMP || o==OP_FORLOOP || o==OP_FORPREP || o==OP_TFORLOOP;
+}
+
+static int skipsnext(Instruction i)	/* may 'i' jump over the next one? */
+{
+ switch (GET_OPCODE(i))
+ {
+  case OP_EQ: case OP_LT: case OP_LE: case OP_TEST: case OP_TESTSET:
+	return 1;
+  case OP_LOADBOOL:
+	return GETARG_C(i)!=0;
+  default:
+	return 0;
+ }
+}
+
+static int hasextra(Instruction i)	/* is 'i' followed by an OP_EXTRAARG? */
+{
+ return GET_OPCODE(i)==OP_LOADKX || (GET_OPCODE(i)==OP_SETLIST && GETARG_C(i)==0);
+}
+
+/* mark every instruction reachable from the entry point */
+static void reach(const Proto* f, char* live, int* stack)
+{
+ int n=f->sizecode;
+ int top=0;
+#define mark(pc)	if ((pc)<n && !live[pc]) { live[pc]=1; stack[top++]=(pc); }
+ mark(0);
+ while (top>0)
+ {
+  int pc=stack[--top];
+  Instruction i=f->code[pc];
+  switch (GET_OPCODE(i))
+  {
+   case OP_RETURN:
+	break;
+   case OP_JMP: case OP_FORPREP:
+	mark(target(f,pc));
+	break;
+   case OP_FORLOOP: case OP_TFORLOOP:
+	mark(target(f,pc));
+	mark(pc+1);
+	break;
+   default:
+	if (hasextra(i))
+	{
+	 if (pc+1<n) live[pc+1]=1;
+	 mark(pc+2);
+	}
+	else if (skipsnext(i))
+	{
+	 /* a skipping LOADBOOL never runs the next instruction, but the
+	    skip counts on it being there, so keep it as if it were reached */
+	 mark(pc+1);
+	 mark(pc+2);
+	}
+	else
+	 mark(pc+1);
+  }
+ }
+#undef mark
+}
+
+/* does 'i' only set register 'r' (and nothing else) without reading it? */
+static int killsreg(Instruction i, int r)
+{
+ switch (GET_OPCODE(i))
+ {
+  case OP_MOVE:
+	return GETARG_A(i)==r && GETARG_B(i)!=r;
+  case OP_LOADK: case OP_GETUPVAL:
+	return GETARG_A(i)==r;
+  case OP_LOADBOOL:
+	return GETARG_A(i)==r && GETARG_C(i)==0;
+  case OP_LOADNIL:
+	return GETARG_A(i)<=r && r<=GETARG_A(i)+GETARG_B(i);
+  default:
+	return 0;
+ }
+}
+
+/* is 'i' a plain store into register A with no side effects? */
+static int isstore(Instruction i)
+{
+ switch (GET_OPCODE(i))
+ {
+  case OP_MOVE: case OP_LOADK: case OP_GETUPVAL:
+	return 1;
+  case OP_LOADBOOL:
+	return GETARG_C(i)==0;
+  case OP_LOADNIL:
+	return GETARG_B(i)==0;
+  default:
+	return 0;
+ }
+}
+
+/* thread jumps to unconditional jumps; returns number of changes */
+static int threadjumps(Proto* f)
+{
+ int n=f->sizecode;
+ int pc,changes=0;
+ for (pc=0; pc<n; pc++)
+ {
+  Instruction i=f->code[pc];
+  int a,t,k;
+  if (GET_OPCODE(i)!=OP_JMP) continue;
+  a=GETARG_A(i);
+  t=target(f,pc);
+  for (k=0; k<n && t!=pc && t<n && GET_OPCODE(f->code[t])==OP_JMP; k++)
+  {
+   int b=GETARG_A(f->code[t]);
+   if (b!=0) a=(a==0 || b<a) ? b : a;	/* close the lowest level of both */
+   t=target(f,t);
+  }
+  if (t!=target(f,pc))
+  {
+   SETARG_A(f->code[pc],a);
+   SETARG_sBx(f->code[pc],t-pc-1);
+   changes++;
+  }
+ }
+ return changes;
+}
+
+/* remove instructions marked in 'dead', fixing jumps and debug info */
+static void compact(lua_State* L, Proto* f, const char* dead, int* newpc)
+{
+ int n=f->sizecode;
+ int pc,m=0;
+ for (pc=0; pc<n; pc++)
+ {
+  newpc[pc]=m;
+  if (!dead[pc]) m++;
+ }
+ newpc[n]=m;
+ for (pc=0; pc<n; pc++)
+ {
+  Instruction i=f->code[pc];
+  if (dead[pc]) continue;
+  if (isjump(GET_OPCODE(i)))
+   SETARG_sBx(i,newpc[target(f,pc)]-newpc[pc]-1);
+  f->code[newpc[pc]]=i;
+  if (f->sizelineinfo==n) f->lineinfo[newpc[pc]]=f->lineinfo[pc];
+ }
+ for (pc=0; pc<f->sizelocvars; pc++)
+ {
+  f->locvars[pc].startpc=newpc[f->locvars[pc].startpc];
+  f->locvars[pc].endpc=newpc[f->locvars[pc].endpc];
+ }
+ if (f->sizelineinfo==n)
+ {
+  luaM_reallocvectort(L,f->lineinfo,n,m,int,LUA_TPROTO);
+  f->sizelineinfo=m;
+ }
+ luaM_reallocvectort(L,f->code,n,m,Instruction,LUA_TPROTO);
+ f->sizecode=m;
+}
+
+static void OptimizeFunction(lua_State* L, Proto* f)
+{
+ int n=f->sizecode;
+ char* live=malloc(n);
+ char* dead=malloc(n);
+ int* aux=malloc((n+1)*sizeof(int));
+ int pc,i;
+ if (live==NULL || dead==NULL || aux==NULL) fatal("not enough memory");
+ for (;;)
+ {
+  int changes=threadjumps(f);
+  int removed=0;
+  n=f->sizecode;
+  memset(live,0,n);
+  memset(dead,0,n);
+  reach(f,live,aux);
+  for (pc=0; pc<n; pc++)
+  {
+   Instruction i=f->code[pc];
+   int guarded=(pc>0 && skipsnext(f->code[pc-1]));
+   if (!live[pc])				/* unreachable */
+    dead[pc]=1;
+   else if (guarded)
+    continue;
+   else if (GET_OPCODE(i)==OP_JMP && GETARG_A(i)==0 && target(f,pc)==pc+1)
+    dead[pc]=1;					/* jump to next instruction */
+   else if (GET_OPCODE(i)==OP_MOVE && GETARG_A(i)==GETARG_B(i))
+    dead[pc]=1;					/* self move */
+   else if (isstore(i) && pc+1<n && killsreg(f->code[pc+1],GETARG_A(i)))
+    dead[pc]=1;					/* overwritten before use */
+   else
+    continue;
+   removed++;
+  }
+  if (removed>0) compact(L,f,dead,aux);
+  if (changes+removed==0) break;
+ }
+ free(live);
+ free(dead);
+ free(aux);
+ for (i=0; i<f->sizep; i++) OptimizeFunction(L,f->p[i]);
+}
+
 /*
 ** $Id: print.c,v 1.68 2011/09/30 10:21:20 lhf Exp $
 ** print bytecodes
@@ -75,6 +75,36 @@
 
 
 
+/*
+@@ LUA_USE_DIRCACHE makes 'package.searchpath' keep a listing of each
+@* directory in the path, so that it need not open every candidate
+@* file. It needs 'opendir' and 'stat'.
+** CHANGE it (define it) if your paths have many directories or files
+** that do not exist. Files that are listed but not readable are then
+** found by 'searchpath' and fail to load, instead of being skipped.
+@@ LUA_DIRCACHE_FOLDCASE makes that cache compare file names ignoring
+@* case, as the file system does on Mac OS X by default.
+** CHANGE it (undefine it) if your Mac OS X file system is case
+** sensitive; CHANGE it (define it) for other file systems that
+** ignore case.
+*/
+/* #define LUA_USE_DIRCACHE */
+#if defined(__APPLE__)
+#define LUA_DIRCACHE_FOLDCASE
+#endif
+
+
+/*
+@@ LUA_USE_SCHED enables the experimental 'sched' library (lschedlib.c),
+@* which runs tasks on a pool of Posix threads. It needs the gcc atomic
+@* builtins and an extra library: -lpthread. When it is defined, the
+@* library is preloaded in the standalone interpreter.
+** CHANGE it (define it) if you want to use the library, e.g. with
+** make linux MYCFLAGS=-DLUA_USE_SCHED MYLIBS=-lpthread
+*/
+/* #define LUA_USE_SCHED */
+
+
 /*
 @@ LUA_PATH_DEFAULT is the default path that Lua uses to look for
 @* Lua libraries.
@@ -232,6 +262,14 @@
 #define LUAI_MAXSHORTLEN        40
 
 
+/*
+@@ LUAI_MINROPELEN is the minimum length of a concatenation result that
+** is built lazily, as a rope that refers to its operands. (Must be
+** larger than LUAI_MAXSHORTLEN.)
+*/
+#define LUAI_MINROPELEN		128
+
+
 
 /*
 ** {==================================================================
@@ -405,6 +443,28 @@
 #define LUAI_MAXNUMBER2STR	32 /* 16 digits, sign, point, and \0 */
 
 
+/*
+@@ LUA_FASTNUMCONV enables built-in fast paths for number conversions:
+** integral numbers are written without 'lua_number2str' and short
+** decimal numerals are read without 'lua_str2number', with identical
+** results (except that the fast reader always uses '.' as the decimal
+** point). It needs IEEE doubles computed in double precision (not x87
+** extended precision) and an 'unsigned long long' type. On x86, gcc
+** computes doubles with SSE2 only with -mfpmath=sse, which it tells by
+** defining __SSE2_MATH__ (-msse2 alone defines only __SSE2__).
+@@ LUA_NUMBER_SHORTEST makes Lua write non-integral numbers with the
+** shortest string that reads back as the same number (Grisu2), instead
+** of LUA_NUMBER_FMT, which keeps only 14 digits. It needs LUA_FASTNUMCONV.
+*/
+#if !defined(LUA_ANSI) && \
+    !((defined(__i386) || defined(_M_IX86) || defined(__i386__)) && \
+      !defined(__SSE2_MATH__))
+#define LUA_FASTNUMCONV
+#endif
+
+/* #define LUA_NUMBER_SHORTEST */
+
+
 /*
 @@ l_mathop allows the addition of an 'l' or 'f' to all math operations
 */
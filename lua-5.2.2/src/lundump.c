@@ -86,7 +86,7 @@ static TString* LoadString(LoadState* S)
 static void LoadCode(LoadState* S, Proto* f)
 {
  int n=LoadInt(S);
- f->code=luaM_newvector(S->L,n,Instruction);
+ f->code=luaM_newvectort(S->L,n,Instruction,LUA_TPROTO);
  f->sizecode=n;
  LoadVector(S,f->code,n,sizeof(Instruction));
 }
@@ -97,7 +97,7 @@ static void LoadConstants(LoadState* S, Proto* f)
 {
  int i,n;
  n=LoadInt(S);
- f->k=luaM_newvector(S->L,n,TValue);
+ f->k=luaM_newvectort(S->L,n,TValue,LUA_TPROTO);
  f->sizek=n;
  for (i=0; i<n; i++) setnilvalue(&f->k[i]);
  for (i=0; i<n; i++)
@@ -122,7 +122,7 @@ static void LoadConstants(LoadState* S, Proto* f)
   }
  }
  n=LoadInt(S);
- f->p=luaM_newvector(S->L,n,Proto*);
+ f->p=luaM_newvectort(S->L,n,Proto*,LUA_TPROTO);
  f->sizep=n;
  for (i=0; i<n; i++) f->p[i]=NULL;
  for (i=0; i<n; i++)
@@ -136,7 +136,7 @@ static void LoadUpvalues(LoadState* S, Proto* f)
 {
  int i,n;
  n=LoadInt(S);
- f->upvalues=luaM_newvector(S->L,n,Upvaldesc);
+ f->upvalues=luaM_newvectort(S->L,n,Upvaldesc,LUA_TPROTO);
  f->sizeupvalues=n;
  for (i=0; i<n; i++) f->upvalues[i].name=NULL;
  for (i=0; i<n; i++)
@@ -151,11 +151,11 @@ static void LoadDebug(LoadState* S, Proto* f)
  int i,n;
  f->source=LoadString(S);
  n=LoadInt(S);
- f->lineinfo=luaM_newvector(S->L,n,int);
+ f->lineinfo=luaM_newvectort(S->L,n,int,LUA_TPROTO);
  f->sizelineinfo=n;
  LoadVector(S,f->lineinfo,n,sizeof(int));
  n=LoadInt(S);
- f->locvars=luaM_newvector(S->L,n,LocVar);
+ f->locvars=luaM_newvectort(S->L,n,LocVar,LUA_TPROTO);
  f->sizelocvars=n;
  for (i=0; i<n; i++) f->locvars[i].varname=NULL;
  for (i=0; i<n; i++)
@@ -32,10 +32,12 @@
 #define MAXTAGLOOP	100
 
 
-const TValue *luaV_tonumber (const TValue *obj, TValue *n) {
+const TValue *luaV_tonumber (lua_State *L, const TValue *obj, TValue *n) {
   lua_Number num;
+  TString *ts;
   if (ttisnumber(obj)) return obj;
-  if (ttisstring(obj) && luaO_str2d(svalue(obj), tsvalue(obj)->len, &num)) {
+  if (ttisstring(obj) && (ts = luaS_plain(L, rawtsvalue(obj)),
+                          luaO_str2d(getstr(ts), ts->tsv.len, &num))) {
     setnvalue(n, num);
     return n;
   }
@@ -50,7 +52,7 @@ int luaV_tostring (lua_State *L, StkId obj) {
   else {
     char s[LUAI_MAXNUMBER2STR];
     lua_Number n = nvalue(obj);
-    int l = lua_number2str(s, n);
+    int l = luaO_num2str(s, n);
     setsvalue2s(L, obj, luaS_newlstr(L, s, l));
     return 1;
   }
@@ -233,7 +235,8 @@ int luaV_lessthan (lua_State *L, const TValue *l, const TValue *r) {
   if (ttisnumber(l) && ttisnumber(r))
     return luai_numlt(L, nvalue(l), nvalue(r));
   else if (ttisstring(l) && ttisstring(r))
-    return l_strcmp(rawtsvalue(l), rawtsvalue(r)) < 0;
+    return l_strcmp(luaS_plain(L, rawtsvalue(l)),
+                    luaS_plain(L, rawtsvalue(r))) < 0;
   else if ((res = call_orderTM(L, l, r, TM_LT)) < 0)
     luaG_ordererror(L, l, r);
   return res;
@@ -245,7 +248,8 @@ int luaV_lessequal (lua_State *L, const TValue *l, const TValue *r) {
   if (ttisnumber(l) && ttisnumber(r))
     return luai_numle(L, nvalue(l), nvalue(r));
   else if (ttisstring(l) && ttisstring(r))
-    return l_strcmp(rawtsvalue(l), rawtsvalue(r)) <= 0;
+    return l_strcmp(luaS_plain(L, rawtsvalue(l)),
+                    luaS_plain(L, rawtsvalue(r))) <= 0;
   else if ((res = call_orderTM(L, l, r, TM_LE)) >= 0)  /* first try `le' */
     return res;
   else if ((res = call_orderTM(L, r, l, TM_LT)) < 0)  /* else try `lt' */
@@ -259,7 +263,11 @@ int luaV_lessequal (lua_State *L, const TValue *l, const TValue *r) {
 */
 int luaV_equalobj_ (lua_State *L, const TValue *t1, const TValue *t2) {
   const TValue *tm;
-  lua_assert(ttisequal(t1, t2));
+  if (!ttisequal(t1, t2)) {  /* a rope against another value? */
+    lua_assert(ttisrope(t1) || ttisrope(t2));
+    return ttisstring(t1) && ttisstring(t2) &&
+           luaS_eqlngstr(rawtsvalue(t1), rawtsvalue(t2));
+  }
   switch (ttype(t1)) {
     case LUA_TNIL: return 1;
     case LUA_TNUMBER: return luai_numeq(nvalue(t1), nvalue(t2));
@@ -267,7 +275,8 @@ int luaV_equalobj_ (lua_State *L, const TValue *t1, const TValue *t2) {
     case LUA_TLIGHTUSERDATA: return pvalue(t1) == pvalue(t2);
     case LUA_TLCF: return fvalue(t1) == fvalue(t2);
     case LUA_TSHRSTR: return eqshrstr(rawtsvalue(t1), rawtsvalue(t2));
-    case LUA_TLNGSTR: return luaS_eqlngstr(rawtsvalue(t1), rawtsvalue(t2));
+    case LUA_TLNGSTR: case LUA_TROPE:
+      return luaS_eqlngstr(rawtsvalue(t1), rawtsvalue(t2));
     case LUA_TUSERDATA: {
       if (uvalue(t1) == uvalue(t2)) return 1;
       else if (L == NULL) return 0;
@@ -290,6 +299,28 @@ int luaV_equalobj_ (lua_State *L, const TValue *t1, const TValue *t2) {
 }
 
 
+/*
+** creates a string concatenating the 'n' strings starting at 'first',
+** with total length 'tl'
+*/
+static TString *concatrange (lua_State *L, StkId first, int n, size_t tl) {
+  char *buffer;
+  int i;
+  for (i = 0; i < n; i++) {  /* build ropes before using the buffer */
+    if (ttisrope(first+i))
+      setsvalue2s(L, first+i, luaS_flatten(L, rawtsvalue(first+i)));
+  }
+  buffer = luaZ_openspace(L, &G(L)->buff, tl);
+  tl = 0;
+  for (i = 0; i < n; i++) {
+    size_t l = tsvalue(first+i)->len;
+    memcpy(buffer+tl, svalue(first+i), l * sizeof(char));
+    tl += l;
+  }
+  return luaS_newlstr(L, buffer, tl);
+}
+
+
 void luaV_concat (lua_State *L, int total) {
   lua_assert(total >= 2);
   do {
@@ -307,7 +338,6 @@ void luaV_concat (lua_State *L, int total) {
     else {
       /* at least two non-empty string values; get as many as possible */
       size_t tl = tsvalue(top-1)->len;
-      char *buffer;
       int i;
       /* collect total length */
       for (i = 1; i < total && tostring(L, top-i-1); i++) {
@@ -316,15 +346,33 @@ void luaV_concat (lua_State *L, int total) {
           luaG_runerror(L, "string length overflow");
         tl += l;
       }
-      buffer = luaZ_openspace(L, &G(L)->buff, tl);
-      tl = 0;
       n = i;
-      do {  /* concat all strings */
-        size_t l = tsvalue(top-i)->len;
-        memcpy(buffer+tl, svalue(top-i), l * sizeof(char));
-        tl += l;
-      } while (--i > 0);
-      setsvalue2s(L, top-n, luaS_newlstr(L, buffer, tl));
+      if (tl >= LUAI_MINROPELEN &&
+          tsvalue(top-n)->len >= tl - tsvalue(top-n)->len) {
+        /* long prefix: refer to it instead of copying it */
+        TString *left = rawtsvalue(top-n);
+        TString *right = (n == 2) ? luaS_plain(L, rawtsvalue(top-1))
+                       : concatrange(L, top-n+1, n-1, tl - left->tsv.len);
+        setsvalue2s(L, top-n+1, right);  /* anchor it */
+        if (left->tsv.tt == LUA_TROPE && ts2rope(left)->right != NULL &&
+            ts2rope(left)->right->tsv.len + right->tsv.len < LUAI_MINROPELEN) {
+          /* join small suffixes, so that pieces do not get too small;
+             both are anchored: the old one by 'left', the new one in
+             the stack */
+          TString *prev = ts2rope(left)->right;
+          size_t lp = prev->tsv.len;
+          size_t lr = right->tsv.len;
+          char *buffer = luaZ_openspace(L, &G(L)->buff, lp + lr);
+          memcpy(buffer, getstr(prev), lp * sizeof(char));
+          memcpy(buffer + lp, getstr(right), lr * sizeof(char));
+          right = luaS_newlstr(L, buffer, lp + lr);
+          setsvalue2s(L, top-n+1, right);  /* anchor it */
+          left = ts2rope(left)->left;  /* (still anchored by old rope) */
+        }
+        setsvalue2s(L, top-n, luaS_newrope(L, left, right));
+      }
+      else
+        setsvalue2s(L, top-n, concatrange(L, top-n, n, tl));
     }
     total -= n-1;  /* got 'n' strings to create 1 new */
     L->top -= n-1;  /* popped 'n' strings and pushed one */
@@ -361,8 +409,8 @@ void luaV_arith (lua_State *L, StkId ra, const TValue *rb,
                  const TValue *rc, TMS op) {
   TValue tempb, tempc;
   const TValue *b, *c;
-  if ((b = luaV_tonumber(rb, &tempb)) != NULL &&
-      (c = luaV_tonumber(rc, &tempc)) != NULL) {
+  if ((b = luaV_tonumber(L, rb, &tempb)) != NULL &&
+      (c = luaV_tonumber(L, rc, &tempc)) != NULL) {
     lua_Number res = luaO_arith(op - TM_ADD + LUA_OPADD, nvalue(b), nvalue(c));
     setnvalue(ra, res);
   }
@@ -412,8 +460,11 @@ static void pushclosure (lua_State *L, Proto *p, UpVal **encup, StkId base,
     else  /* get upvalue from enclosing function */
       ncl->l.upvals[i] = encup[uv[i].idx];
   }
-  luaC_barrierproto(L, p, ncl);
-  p->cache = ncl;  /* save it on cache for reuse */
+  /* a region closure cached in an older prototype would escape it */
+  if (!isregion(obj2gco(ncl)) || isregion(obj2gco(p))) {
+    luaC_barrierproto(L, p, ncl);
+    p->cache = ncl;  /* save it on cache for reuse */
+  }
 }
 
 
@@ -546,6 +597,7 @@ void luaV_execute (lua_State *L) {
     Instruction i = *(ci->u.l.savedpc++);
     StkId ra;
     if ((L->hookmask & (LUA_MASKLINE | LUA_MASKCOUNT)) &&
+        hookedproto(L, cl->p) &&
         (--L->hookcount == 0 || L->hookmask & LUA_MASKLINE)) {
       Protect(traceexec(L));
     }
@@ -611,8 +663,18 @@ void luaV_execute (lua_State *L) {
       )
       vmcase(OP_SELF,
         StkId rb = RB(i);
+        TValue *rc = RKC(i);
+        const TValue *tm;
+        const TValue *res;
         setobjs2s(L, ra+1, rb);
-        Protect(luaV_gettable(L, rb, RKC(i), ra));
+        if (ttisuserdata(rb) &&  /* method of a userdata with an __index */
+            (tm = fasttm(L, uvalue(rb)->metatable, TM_INDEX)) != NULL &&
+            ttistable(tm) &&  /* table of methods... */
+            !ttisnil(res = luaH_get(hvalue(tm), rc))) {  /* ...with 'rc'? */
+          setobj2s(L, ra, res);
+        }
+        else
+          Protect(luaV_gettable(L, rb, rc, ra));
       )
       vmcase(OP_ADD,
         arith_op(luai_numadd, TM_ADD);
@@ -752,6 +814,7 @@ void luaV_execute (lua_State *L) {
       vmcasenb(OP_RETURN,
         int b = GETARG_B(i);
         if (b != 0) L->top = ra+b-1;
+       ret:
         if (cl->p->sizep > 0) luaF_close(L, base);
         b = luaD_poscall(L, ra);
         if (!(ci->callstatus & CIST_REENTRY))  /* 'ci' still the called one */
@@ -844,6 +907,17 @@ void luaV_execute (lua_State *L) {
         int j;
         int n = cast_int(base - ci->func) - cl->p->numparams - 1;
         if (b < 0) {  /* B == 0? */
+          Instruction ni = *ci->u.l.savedpc;
+          if (GET_OPCODE(ni) == OP_RETURN && GETARG_A(ni) == GETARG_A(i) &&
+              GETARG_B(ni) == 0 &&
+              !(L->hookmask & (LUA_MASKLINE | LUA_MASKCOUNT))) {
+            /* 'return ...': results go straight from the var. arguments
+               to their final position, without passing through 'ra' */
+            ci->u.l.savedpc++;  /* skip the OP_RETURN */
+            ra = base - n;
+            L->top = base;
+            goto ret;
+          }
           b = n;  /* get all var. arguments */
           Protect(luaD_checkstack(L, n));
           ra = RA(i);  /* previous call may change the stack */
@@ -15,9 +15,13 @@
 
 #define tostring(L,o) (ttisstring(o) || (luaV_tostring(L, o)))
 
-#define tonumber(o,n)	(ttisnumber(o) || (((o) = luaV_tonumber(o,n)) != NULL))
+#define tonumber(o,n)  \
+	(ttisnumber(o) || (((o) = luaV_tonumber(L,o,n)) != NULL))
 
-#define equalobj(L,o1,o2)  (ttisequal(o1, o2) && luaV_equalobj_(L, o1, o2))
+/* a rope may be equal to a string of another variant */
+#define equalobj(L,o1,o2)  \
+	((ttisequal(o1, o2) || ttisrope(o1) || ttisrope(o2)) && \
+	 luaV_equalobj_(L, o1, o2))
 
 #define luaV_rawequalobj(o1,o2)		equalobj(NULL,o1,o2)
 
@@ -28,7 +32,8 @@ LUAI_FUNC int luaV_equalobj_ (lua_State *L, const TValue *t1, const TValue *t2);
 
 LUAI_FUNC int luaV_lessthan (lua_State *L, const TValue *l, const TValue *r);
 LUAI_FUNC int luaV_lessequal (lua_State *L, const TValue *l, const TValue *r);
-LUAI_FUNC const TValue *luaV_tonumber (const TValue *obj, TValue *n);
+LUAI_FUNC const TValue *luaV_tonumber (lua_State *L, const TValue *obj,
+                                       TValue *n);
 LUAI_FUNC int luaV_tostring (lua_State *L, StkId obj);
 LUAI_FUNC void luaV_gettable (lua_State *L, const TValue *t, TValue *key,
                                             StkId val);
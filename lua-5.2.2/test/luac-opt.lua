@@ -0,0 +1,88 @@
+-- check that 'luac -O' keeps the behaviour of the code it optimizes
+-- run from the src directory after 'make': ./lua ../test/luac-opt.lua
+
+local LUA = arg[1] or "./lua"
+local LUAC = arg[2] or "./luac"
+
+local sample = [=[
+local function f(n)
+  if n > 10 then
+    return "big"
+  else
+    return "small"
+  end
+end
+
+local function g(t)
+  local s = 0
+  for i = 1, #t do
+    if t[i] % 2 == 0 then s = s + t[i] else s = s - 1 end
+  end
+  return s
+end
+
+local function h(x)
+  local y; y = x * 2
+  local z = y
+  z = z
+  while x > 0 do
+    x = x - 1
+    if x == 3 then break end
+  end
+  repeat x = x + 1 until x >= 5
+  return y, z, x
+end
+
+-- comparisons turned into booleans use a skipping LOADBOOL
+local a, b, c = 1, 2, 3
+local x = (a == b) and c
+local y = (a < b) and c
+local z = not (a <= b) or (b == c)
+local w = a ~= b
+print(x, y, z, w)
+print((a == b) and c or (c > b))
+
+for k, v in pairs({ 1, 2, 3 }) do
+  print(k, v, f(v * 5), g({ v, v + 1, v + 2 }), h(v))
+end
+
+local t = {}
+for i = 1, 3 do t[i] = function () return i end end
+print(t[1](), t[2](), t[3]())
+print(pcall(error, "oops"))
+]=]
+
+local function run(cmd)
+  local p = assert(io.popen(cmd .. " 2>&1"))
+  local out = p:read("*a")
+  p:close()
+  return out
+end
+
+local function count(file, opt)
+  local listing = run(LUAC .. (opt and " -O" or "") .. " -l -p " .. file)
+  local n = 0
+  for _ in listing:gmatch("\n\t%d+\t") do n = n + 1 end
+  return n
+end
+
+local src = os.tmpname()
+local bin = os.tmpname()
+local fh = assert(io.open(src, "w"))
+fh:write(sample)
+fh:close()
+
+local expected = run(LUA .. " " .. src)
+local compiled = run(LUAC .. " -O -o " .. bin .. " " .. src)
+local got = compiled == "" and run(LUA .. " " .. bin) or compiled
+local before, after = count(src, false), count(src, true)
+os.remove(src)
+os.remove(bin)
+
+if got ~= expected then
+  io.stderr:write("luac -O changed the output\nexpected:\n", expected,
+                  "got:\n", got)
+  os.exit(1)
+end
+print(string.format("luac -O: %d -> %d instructions, same output",
+                    before, after))
@@ -0,0 +1,91 @@
+-- measure message throughput of the 'sched' library
+-- build Lua with the library and run from the src directory:
+--   make linux MYCFLAGS=-DLUA_USE_SCHED MYLIBS=-lpthread
+--   ./lua ../test/sched-bench.lua [messages] [senders] [workers]
+
+local sched = require "sched"
+
+local N = tonumber(arg[1]) or 1000000
+local P = tonumber(arg[2]) or 4
+local W = tonumber(arg[3])  -- default: number of processors
+
+-- wall-clock time: 'os.clock' adds up the time of all threads
+local function now ()
+  local f = io.open("/proc/uptime")
+  if f then
+    local t = f:read("*n")
+    f:close()
+    return t
+  end
+  return os.time()
+end
+
+local function report (name, n, t)
+  print(string.format("%-30s %8.2f s %12.0f msg/s", name, t, n / t))
+end
+
+print(string.format("%d workers, %d messages", sched.workers(W), N))
+
+
+-- one task sends numbers to the main state
+do
+  local ch = sched.channel()
+  local t = now()
+  sched.spawn(function (ch, n)
+    for i = 1, n do ch:send(i) end
+  end, ch, N)
+  local sum = 0
+  for i = 1, N do sum = sum + ch:recv() end
+  report("1 sender, numbers", N, now() - t)
+  assert(sum == N * (N + 1) / 2)
+end
+
+
+-- one task sends small tables to the main state
+do
+  local ch = sched.channel()
+  local t = now()
+  sched.spawn(function (ch, n)
+    for i = 1, n do ch:send({i, "x", true}) end
+  end, ch, N)
+  local sum = 0
+  for i = 1, N do sum = sum + ch:recv()[1] end
+  report("1 sender, tables", N, now() - t)
+  assert(sum == N * (N + 1) / 2)
+end
+
+
+-- several tasks send to the same channel
+do
+  local ch = sched.channel()
+  local n = math.floor(N / P)
+  local t = now()
+  for p = 1, P do
+    sched.spawn(function (ch, n)
+      for i = 1, n do ch:send(i) end
+    end, ch, n)
+  end
+  local sum = 0
+  for i = 1, n * P do sum = sum + ch:recv() end
+  report(P .. " senders, numbers", n * P, now() - t)
+  assert(sum == P * n * (n + 1) / 2)
+end
+
+
+-- two tasks pass a message back and forth; each trip is two messages
+do
+  local ping, pong, done = sched.channel(), sched.channel(), sched.channel()
+  local n = math.floor(N / 2)
+  local t = now()
+  sched.spawn(function (ping, pong, n)
+    for i = 1, n do pong:send(ping:recv() + 1) end
+  end, ping, pong, n)
+  sched.spawn(function (ping, pong, done, n)
+    local v = 0
+    for i = 1, n do ping:send(v); v = pong:recv() end
+    done:send(v)
+  end, ping, pong, done, n)
+  local v = done:recv()
+  report("2 tasks, ping-pong", 2 * n, now() - t)
+  assert(v == n)
+end